@@ -46,6 +46,10 @@ SPINLOCK_INLINE
 spinlock_data_t spinlock_data_get(volatile spinlock_data_t *sd);
 SPINLOCK_INLINE
 spinlock_data_t spinlock_data_testandset(volatile spinlock_data_t *sd);
+SPINLOCK_INLINE
+bool spinlock_data_compareandswap(volatile spinlock_data_t *sd,
+				  spinlock_data_t oldval,
+				  spinlock_data_t newval);
 
 ////////////////////////////////////////////////////////////
 
@@ -118,5 +122,39 @@ spinlock_data_testandset(volatile spinlock_data_t *sd)
 	return x;
 }
 
+/*
+ * Compare-and-swap a spinlock_data_t: if it contains OLDVAL, replace
+ * that with NEWVAL. Returns true if the swap happened. Like the
+ * test-and-set above this is one LL/SC attempt, so it can fail even
+ * if the value matched; callers retry.
+ */
+SPINLOCK_INLINE
+bool
+spinlock_data_compareandswap(volatile spinlock_data_t *sd,
+			     spinlock_data_t oldval, spinlock_data_t newval)
+{
+	spinlock_data_t x;
+	spinlock_data_t y;
+
+	/*
+	 * Load the existing value into X; if it isn't OLDVAL, skip
+	 * the store. Otherwise Y is stored and then holds the SC's
+	 * success flag.
+	 */
+
+	y = newval;
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 instructions */
+		".set volatile;"	/* avoid unwanted optimization */
+		"ll %0, 0(%3);"		/*   x = *sd */
+		"bne %0, %2, 1f;"	/*   if (x != oldval) goto 1 */
+		"sc %1, 0(%3);"		/*   *sd = y; y = success? */
+		"1:"
+		".set pop"		/* restore assembler mode */
+		: "=&r" (x), "+r" (y) : "r" (oldval), "r" (sd));
+	return x == oldval && y != 0;
+}
+
 
 #endif /* _MIPS_SPINLOCK_H_ */
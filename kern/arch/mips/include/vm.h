@@ -114,14 +114,13 @@ paddr_t ram_getfirst(void);
 /*
  * TLB shootdown bits.
  *
- * We'll take up to 16 invalidations before just flushing the whole TLB.
+ * TLB entries are tagged with the owning pid, and mappings only ever
+ * go away all at once when an address space is destroyed, so a
+ * shootdown names a pid and drops all of its entries.
  */
 
 struct tlbshootdown {
-	/*
-	 * Change this to what you need for your VM design.
-	 */
-	int ts_placeholder;
+	pid_t ts_pid;		/* pid whose translations to drop */
 };
 
 #define TLBSHOOTDOWN_MAX 16
@@ -36,6 +36,7 @@
 #include <spl.h>
 #include <thread.h>
 #include <current.h>
+#include <proc.h>
 #include <vm.h>
 #include <mainbus.h>
 #include <syscall.h>
@@ -195,6 +196,19 @@ mips_trap(struct trapframe *tf)
 		}
 
 		curthread->t_in_interrupt = old_in;
+
+#if OPT_SYSCALLS
+		/*
+		 * Don't go back to a user thread whose process is
+		 * exiting; this is what catches threads that never
+		 * make system calls.
+		 */
+		if (!iskern && doadjust && curproc != NULL &&
+		    curproc->p_exiting) {
+			cpu_irqon();
+			uthread_exitcheck();
+		}
+#endif
 		goto done2;
 	}
 
@@ -315,6 +329,12 @@ mips_trap(struct trapframe *tf)
 	panic("I can't handle this... I think I'll just die now...\n");
 
  done:
+#if OPT_SYSCALLS
+	/* Threads of an exiting process leave instead of returning. */
+	if (!iskern) {
+		uthread_exitcheck();
+	}
+#endif
 	/*
 	 * Turn interrupts off on the processor, without affecting the
 	 * stored interrupt state.
@@ -33,7 +33,10 @@
 #include <lib.h>
 #include <mips/trapframe.h>
 #include <current.h>
+#include <copyinout.h>
 #include <syscall.h>
+#include <cpu.h>
+#include <sysstat.h>
 
 
 /*
@@ -82,11 +85,17 @@ syscall(struct trapframe *tf)
 	int callno;
 	int32_t retval;
 	int err;
+	uint64_t start;
+#if OPT_SYSCALLS
+	off_t pos, retval64;
+	int whence;
+#endif
 
 	KASSERT(curthread != NULL);
 	KASSERT(curthread->t_curspl == 0);
 	KASSERT(curthread->t_iplhigh_count == 0);
 
+	start = cpu_cycles();
 	callno = tf->tf_v0;
 
 	/*
@@ -110,28 +119,151 @@ syscall(struct trapframe *tf)
 				 (userptr_t)tf->tf_a1);
 		break;
 
+	    case SYS_nanosleep:
+		err = sys_nanosleep((userptr_t)tf->tf_a0,
+				    (userptr_t)tf->tf_a1);
+		break;
+
 	    /* Add stuff here */
 #if OPT_SYSCALLS
+	    case SYS_open:
+		err = sys_open((userptr_t)tf->tf_a0,
+			       (int)tf->tf_a1,
+			       (mode_t)tf->tf_a2,
+			       &retval);
+		break;
+	    case SYS_close:
+		err = sys_close((int)tf->tf_a0);
+		break;
+	    case SYS_pipe:
+		err = sys_pipe((userptr_t)tf->tf_a0);
+		break;
+	    case SYS_fcntl:
+		err = sys_fcntl((int)tf->tf_a0, (int)tf->tf_a1,
+				(int)tf->tf_a2, &retval);
+		break;
+	    case SYS_poll:
+		err = sys_poll((userptr_t)tf->tf_a0, (unsigned)tf->tf_a1,
+			       (int)tf->tf_a2, &retval);
+		break;
+	    case SYS_sendfile:
+		err = sys_sendfile((int)tf->tf_a0, (int)tf->tf_a1,
+				   (userptr_t)tf->tf_a2, (size_t)tf->tf_a3,
+				   &retval);
+		break;
 	    case SYS_write:
-	        retval = sys_write((int)tf->tf_a0,
+		err = sys_write((int)tf->tf_a0,
 				(userptr_t)tf->tf_a1,
-				(size_t)tf->tf_a2);
-		/* error: function not implemented */
-                if (retval<0) err = ENOSYS; 
-		else err = 0;
-                break;
+				(size_t)tf->tf_a2,
+				&retval);
+		break;
 	    case SYS_read:
-	        retval = sys_read((int)tf->tf_a0,
+		err = sys_read((int)tf->tf_a0,
+			       (userptr_t)tf->tf_a1,
+			       (size_t)tf->tf_a2,
+			       &retval);
+		break;
+	    case SYS_pwrite:
+	    case SYS_pread:
+		/* 64-bit offset on the user stack (a3 is skipped) */
+		err = copyin((userptr_t)tf->tf_sp + 16, &pos, sizeof(pos));
+		if (err) {
+			break;
+		}
+		if (callno == SYS_pwrite) {
+			err = sys_pwrite((int)tf->tf_a0,
+					 (userptr_t)tf->tf_a1,
+					 (size_t)tf->tf_a2,
+					 pos, &retval);
+		}
+		else {
+			err = sys_pread((int)tf->tf_a0,
+					(userptr_t)tf->tf_a1,
+					(size_t)tf->tf_a2,
+					pos, &retval);
+		}
+		break;
+	    case SYS_writev:
+		err = sys_writev((int)tf->tf_a0,
+				 (userptr_t)tf->tf_a1,
+				 (int)tf->tf_a2,
+				 &retval);
+		break;
+	    case SYS_readv:
+		err = sys_readv((int)tf->tf_a0,
 				(userptr_t)tf->tf_a1,
-				(size_t)tf->tf_a2);
-		/* error: function not implemented */
-                if (retval<0) err = ENOSYS; 
-		else err = 0;
-                break;
+				(int)tf->tf_a2,
+				&retval);
+		break;
+	    case SYS_lseek:
+		/* 64-bit offset in a2/a3, whence on the user stack */
+		err = copyin((userptr_t)tf->tf_sp + 16,
+			     &whence, sizeof(whence));
+		if (err) {
+			break;
+		}
+		pos = ((off_t)tf->tf_a2 << 32) | (uint32_t)tf->tf_a3;
+		err = sys_lseek((int)tf->tf_a0, pos, whence, &retval64);
+		if (err == 0) {
+			/* 64-bit return value in v0/v1 */
+			retval = (int32_t)(retval64 >> 32);
+			tf->tf_v1 = (uint32_t)retval64;
+		}
+		break;
 	    case SYS__exit:
-	        /* TODO: just avoid crash */
- 	        sys__exit((int)tf->tf_a0);
-                break;
+		sys__exit((int)tf->tf_a0);
+		break;
+	    case SYS_execv:
+		err = sys_execv((userptr_t)tf->tf_a0,
+				(userptr_t)tf->tf_a1);
+		break;
+	    case SYS_getpid:
+		err = sys_getpid(&retval);
+		break;
+	    case SYS_waitpid:
+		err = sys_waitpid((pid_t)tf->tf_a0,
+				  (userptr_t)tf->tf_a1,
+				  (int)tf->tf_a2,
+				  &retval);
+		break;
+	    case SYS_spawn:
+		err = sys_spawn((userptr_t)tf->tf_a0,
+				(userptr_t)tf->tf_a1,
+				(userptr_t)tf->tf_a2,
+				(int)tf->tf_a3,
+				&retval);
+		break;
+	    case SYS___thread_create:
+		err = sys_thread_create((userptr_t)tf->tf_a0,
+					(userptr_t)tf->tf_a1,
+					(userptr_t)tf->tf_a2,
+					(userptr_t)tf->tf_a3,
+					&retval);
+		break;
+	    case SYS_thread_exit:
+		sys_thread_exit((int)tf->tf_a0);
+		break;
+	    case SYS_thread_join:
+		err = sys_thread_join((int)tf->tf_a0,
+				      (userptr_t)tf->tf_a1);
+		break;
+	    case SYS_sysring_enter:
+		err = sys_sysring_enter((userptr_t)tf->tf_a0,
+					(unsigned)tf->tf_a1,
+					&retval);
+		break;
+	    case SYS_aio_read:
+		err = sys_aio_read((userptr_t)tf->tf_a0);
+		break;
+	    case SYS_aio_write:
+		err = sys_aio_write((userptr_t)tf->tf_a0);
+		break;
+	    case SYS_aio_wait:
+		err = sys_aio_wait((userptr_t)tf->tf_a0,
+				   (unsigned)tf->tf_a1,
+				   (int)tf->tf_a2,
+				   &retval);
+		break;
 #endif
 
 	    default:
@@ -163,6 +295,12 @@ syscall(struct trapframe *tf)
 
 	tf->tf_epc += 4;
 
+	/*
+	 * Account the call. Calls that don't come back here (_exit,
+	 * a successful execv) aren't counted.
+	 */
+	sysstat_record(callno, cpu_cycles() - start);
+
 	/* Make sure the syscall code didn't forget to lower spl */
 	KASSERT(curthread->t_curspl == 0);
 	/* ...or leak any spinlocks */
@@ -35,12 +35,16 @@
 #include <spinlock.h>
 #include <proc.h>
 #include <current.h>
+#include <thread.h>
 #include <mips/tlb.h>
+#include <synch.h>
 
 #include <vm.h>
+#include <addrspace.h>
 #include <uio.h>
 #include <vnode.h>
 #include <elf.h>
+#include <vdso.h>
 #include "PageTable.h"
 
 /*
@@ -72,13 +76,15 @@
 /*
  * Wrap ram_stealmem in a spinlock.
  */
-static struct spinlock stealmem_lock = SPINLOCK_INITIALIZER;
+static struct spinlock stealmem_lock =
+	SPINLOCK_NAMED_INITIALIZER("stealmem_lock");
 
 #if DUMBVM_WITH_FREE
 
 /* G.Cabodi - support for free/alloc */
 
-static struct spinlock freemem_lock = SPINLOCK_INITIALIZER;
+static struct spinlock freemem_lock =
+	SPINLOCK_QUEUED_INITIALIZER("freemem_lock");
 
 
 static unsigned char *freeRamFrames = NULL;
@@ -121,6 +127,7 @@ vm_bootstrap(void)
   if(!pagetable_init(((int)ram_getsize())/PAGE_SIZE)){
 	panic("Page table allocation fails\n");
   }
+  as_bootstrap();
 
 
 }
@@ -226,6 +233,10 @@ alloc_kpages(unsigned npages)
 
 	dumbvm_can_sleep();
 	pa = getppages(npages);
+	if (pa==0 && thread_stackpool_reclaim() > 0) {
+		/* try again with the pooled kernel stacks given back */
+		pa = getppages(npages);
+	}
 	if (pa==0) {
 		return 0;
 	}
@@ -247,38 +258,49 @@ free_kpages(vaddr_t addr){
 void
 vm_tlbshootdown(const struct tlbshootdown *ts)
 {
-	(void)ts;
-	panic("dumbvm tried to do tlb shootdown?!\n");
+	uint32_t ehi, elo;
+	int i, spl;
+
+	spl = splhigh();
+	for (i=0; i<NUM_TLB; i++) {
+		tlb_read(&ehi, &elo, i);
+		if ((pid_t)(ehi & 0xfff) == ts->ts_pid) {
+			tlb_write(TLBHI_INVALID(i), TLBLO_INVALID(), i);
+		}
+	}
+	splx(spl);
 }
 
+/*
+ * Fill the page at PADDR with FILESIZE bytes from V at OFFSET, going
+ * through the kernel mapping of the frame: the page is only entered
+ * in the page table once it is complete, so that other threads of
+ * the process never see it half loaded. VADDR is the user address
+ * the data belongs at; only its offset within the page matters.
+ */
 static
 int
-my_load_segment(struct addrspace *as, struct vnode *v,
-                off_t offset, vaddr_t vaddr,
-                size_t memsize, size_t filesize,
-                int is_executable)
+my_load_segment(struct vnode *v, off_t offset, paddr_t paddr,
+                vaddr_t vaddr, size_t filesize)
 {
     struct iovec iov;
     struct uio u;
+    size_t pageoff;
     int result;
 
-    if (filesize > memsize) {
-        kprintf("ELF: warning: segment filesize > segment memsize\n");
-        filesize = memsize;
+    pageoff = vaddr & ~PAGE_FRAME;
+    if (filesize > PAGE_SIZE - pageoff) {
+        filesize = PAGE_SIZE - pageoff;
+    }
+    if (filesize == 0) {
+        return 0;
     }
 
     DEBUG(DB_EXEC, "ELF: Loading %lu bytes to 0x%lx\n",
           (unsigned long) filesize, (unsigned long) vaddr);
 
-    iov.iov_ubase = (userptr_t)vaddr;
-    iov.iov_len = memsize;		 // length of the memory space
-    u.uio_iov = &iov;
-    u.uio_iovcnt = 1;
-    u.uio_resid = filesize;          // amount to read from the file
-    u.uio_offset = offset;
-    u.uio_segflg = is_executable ? UIO_USERISPACE : UIO_USERSPACE;
-    u.uio_rw = UIO_READ;
-    u.uio_space = as;
+    uio_kinit(&iov, &u, (void *)(PADDR_TO_KVADDR(paddr) + pageoff),
+              filesize, offset, UIO_READ);
 
     result = VOP_READ(v, &u);
     if (result) {
@@ -291,23 +313,22 @@ my_load_segment(struct addrspace *as, struct vnode *v,
         return ENOEXEC;
     }
 
-#if 0
-    {
-		size_t fillamt;
-
-		fillamt = memsize - filesize;
-		if (fillamt > 0) {
-			DEBUG(DB_EXEC, "ELF: Zero-filling %lu more bytes\n",
-			      (unsigned long) fillamt);
-			u.uio_resid += fillamt;
-			result = uiomovezeros(fillamt, &u);
-		}
-	}
-#endif
-
     return result;
 }
 
+/*
+ * Bytes of segment PH backed by the file in the page at offset I.
+ */
+static
+size_t
+segment_filebytes(const Elf_Phdr *ph, size_t i)
+{
+    if (i >= ph->p_filesz) {
+        return 0;
+    }
+    return ph->p_filesz - i < PAGE_SIZE ? ph->p_filesz - i : PAGE_SIZE;
+}
+
 
 #define TO_TLB_FLAG(p) (p &= (TLBLO_VALID | TLBLO_DIRTY))
 
@@ -327,8 +348,8 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 
 	switch (faulttype) {
 	    case VM_FAULT_READONLY:
-		/* We always create pages read-write, so we can't get this */
-		panic("dumbvm: got VM_FAULT_READONLY\n");
+		/* Write to a read-only page (text, or the vdso pages) */
+		return EFAULT;
 	    case VM_FAULT_READ:
 	    case VM_FAULT_WRITE:
 		break;
@@ -379,90 +400,142 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 	pid_t pid = curproc -> pid;
 	uint16_t flag=0x0;
 	flag = flag | TLBLO_VALID | TLBLO_DIRTY;
-	(void) p_temp;
+	size_t to_read;
+	vaddr_t temp;
+
+	/*
+	 * The shared time page belongs to no process, so it is not in
+	 * the page table: map it read-only straight from the kernel.
+	 */
+	if (faultaddress == VDSO_TIMEPAGE) {
+		paddr = vdso_timepage();
+		if (paddr == 0) {
+			return EFAULT;
+		}
+		flag = TLBLO_VALID;
+		goto tlbload;
+	}
+
+	/*
+	 * Threads of the process share the address space: only one of
+	 * them at a time may look a page up and fill it in, or two could
+	 * both miss and enter the same page twice.
+	 */
+	P(as->as_faultsem);
 
 	int result = pagetable_getpaddr(faultaddress,&p_temp,&pid,&flag); // tenta di trovare l'indirizzo in pagetable in p_temp passato per riferimento
 	if(result==1){ //trovato! l'inserisco in TLB
 		paddr = p_temp;	
 
 	}
-	else if(result<0) // l'indirizzo passato non era nel range valido della pagetable
-		 return EFAULT;
+	else if(result<0) { // l'indirizzo passato non era nel range valido della pagetable
+		V(as->as_faultsem);
+		return EFAULT;
+	}
 
 	else if (faultaddress >= vbase1 && faultaddress < vtop1) { // se vero siamo in segmento di codice
-	paddr = getppages(1);
-	paddr &= PAGE_FRAME;
-	as_zero_region(paddr, 1);
-	
-	i = faultaddress - vbase1 ;
-
-	vaddr_t temp = as->ph1.p_vaddr + i;
-	result = pagetable_addentry(temp,paddr,pid,flag);
-	if(result<=0) return EFAULT;
-
-	if(faulttype == VM_FAULT_READ){
-
-			ssize_t to_read = PAGE_SIZE;
-
-			if((unsigned int) (i + PAGE_SIZE) > as->ph1.p_filesz) {
-				to_read = as->ph1.p_filesz - i;	
-			}
-
-//(unsigned int) (i + PAGE_SIZE)>as->ph1.p_filesz ? as->ph1.p_filesz - i : PAGE_SIZE
-			result = my_load_segment(as, as->v, i + as -> ph1.p_offset , temp ,
-				              PAGE_SIZE,to_read,
-				              as->ph1.p_flags & PF_X);
-			if(result<0){
-				return -1;
-				}
-			if(to_read != PAGE_SIZE){
-				flag=0x0;
-				pagetable_change_flag(paddr,flag | TLBLO_VALID);
-			}
-			return 0;
+		paddr = getppages(1);
+		if (paddr == 0) {
+			V(as->as_faultsem);
+			return ENOMEM;
+		}
+		paddr &= PAGE_FRAME;
+		as_zero_region(paddr, 1);
 
+		i = faultaddress - vbase1 ;
+		temp = as->ph1.p_vaddr + i;
+
+		/* load first, then publish the page */
+		to_read = segment_filebytes(&as->ph1, i);
+		result = my_load_segment(as->v, i + as->ph1.p_offset,
+					 paddr, temp, to_read);
+		if (result) {
+			freeppages(paddr, 1);
+			V(as->as_faultsem);
+			return result;
+		}
+		if(to_read != PAGE_SIZE){
+			flag = TLBLO_VALID;
 		}
-		//paddr = (faultaddress - vbase1) + as->as_pbase1;
 
+		result = pagetable_addentry(temp,paddr,pid,flag);
+		if(result<=0) {
+			V(as->as_faultsem);
+			return EFAULT;
+		}
+		as->as_resident++;
 	}
 	else if (faultaddress >= vbase2 && faultaddress < vtop2) {
 		paddr = getppages(1);
+		if (paddr == 0) {
+			V(as->as_faultsem);
+			return ENOMEM;
+		}
 		paddr &= PAGE_FRAME;
 		as_zero_region(paddr, 1);
 
-		
-		int i = faultaddress - vbase2 ;
-		vaddr_t temp = as->ph2.p_vaddr + i;
-		result = pagetable_addentry(temp,paddr,pid, flag);
-		if(result<=0) return EFAULT;
-		//if(faulttype == VM_FAULT_READ){
-		
-			result = my_load_segment(as, as->v, i + as -> ph2.p_offset , temp ,
-				              PAGE_SIZE,(unsigned int) (i + PAGE_SIZE) > as->ph2.p_filesz ? as->ph2.p_filesz - i : PAGE_SIZE,
-				              as->ph2.p_flags & PF_X);
-
+		i = faultaddress - vbase2 ;
+		temp = as->ph2.p_vaddr + i;
 
-			if(result<0){
-				return -1;
-				}
-			return 0;
-			//}
+		to_read = segment_filebytes(&as->ph2, i);
+		result = my_load_segment(as->v, i + as->ph2.p_offset,
+					 paddr, temp, to_read);
+		if (result) {
+			freeppages(paddr, 1);
+			V(as->as_faultsem);
+			return result;
+		}
 
-		//paddr = (faultaddress - vbase2) + as->as_pbase2;
+		result = pagetable_addentry(temp,paddr,pid, flag);
+		if(result<=0) {
+			V(as->as_faultsem);
+			return EFAULT;
 		}
+		as->as_resident++;
+	}
 
 
 	else if (faultaddress >= stackbase && faultaddress < stacktop) {//se falso tutto quello di prima sono in stack
 		paddr = getppages(1);
+		if (paddr == 0) {
+			V(as->as_faultsem);
+			return ENOMEM;
+		}
 		paddr &= PAGE_FRAME;
 		as_zero_region(paddr, 1);
 		flag |= (TLBLO_VALID | TLBLO_DIRTY) >> 9;
 		result = pagetable_addentry(faultaddress,paddr,pid,flag); // qui puoi scrivere
-		//paddr = (faultaddress - stackbase) + as->as_stackpbase;
+		if(result<=0) {
+			V(as->as_faultsem);
+			return EFAULT;
+		}
+		as->as_resident++;
+	}
+	else if (faultaddress == VDSO_PROCPAGE) {
+		/* per-process page: filled once, read-only to the process */
+		paddr = getppages(1);
+		if (paddr == 0) {
+			V(as->as_faultsem);
+			return ENOMEM;
+		}
+		paddr &= PAGE_FRAME;
+		as_zero_region(paddr, 1);
+		vdso_fillproc(paddr, pid);
+		flag = TLBLO_VALID;
+		result = pagetable_addentry(faultaddress,paddr,pid,flag);
+		if(result<=0) {
+			V(as->as_faultsem);
+			return EFAULT;
+		}
+		as->as_resident++;
 	}
 	else {
+		V(as->as_faultsem);
 		return EFAULT;
 	}
+	V(as->as_faultsem);
+
+ tlbload:
 
 	/* make sure it's page-aligned */
 
@@ -491,9 +564,16 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 		return 0;
 	}
 
-	kprintf("dumbvm: Ran out of TLB entries - cannot handle page fault\n");
+	/*
+	 * No free slot. Every slot can belong to this process now (more
+	 * threads means more stacks), so evict one at random; whatever
+	 * it mapped is still in the page table and will fault back in.
+	 */
+	ehi = faultaddress | pid;
+	elo = paddr | flag;
+	tlb_random(ehi, elo);
 	splx(spl);
-	return EFAULT;
+	return 0;
 }
 
 
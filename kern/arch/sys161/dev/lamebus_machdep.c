@@ -52,12 +52,18 @@
  */
 #define CPU_FREQUENCY 25000000 /* 25 MHz */
 
+/* Wiring of LAMEbus interrupts to bits in the cause register */
+#define LAMEBUS_IRQ_BIT  0x00000400	/* all system bus slots */
+#define LAMEBUS_IPI_BIT  0x00000800	/* inter-processor interrupt */
+#define MIPS_TIMER_BIT   0x00008000	/* on-chip timer */
+
 /*
  * Access to the on-chip timer.
  *
  * The c0_count register increments on every cycle; when the value
  * matches the c0_compare register, the timer interrupt line is
- * asserted. Writing to c0_compare again clears the interrupt.
+ * asserted and (on System/161) c0_count starts over from 0. Writing
+ * to c0_compare again clears the interrupt.
  */
 static
 void
@@ -75,6 +81,80 @@ mips_timer_set(uint32_t count)
 		:: "r" (count));
 }
 
+/*
+ * Read back c0_count, c0_compare, and the cause register ($9, $11,
+ * and $13 respectively).
+ */
+static
+uint32_t
+mips_timer_count(void)
+{
+	uint32_t val;
+
+	__asm volatile(
+		".set push;"
+		".set mips32;"
+		"mfc0 %0, $9;"
+		".set pop"
+		: "=r" (val));
+	return val;
+}
+
+static
+uint32_t
+mips_timer_compare(void)
+{
+	uint32_t val;
+
+	__asm volatile(
+		".set push;"
+		".set mips32;"
+		"mfc0 %0, $11;"
+		".set pop"
+		: "=r" (val));
+	return val;
+}
+
+static
+uint32_t
+mips_cause(void)
+{
+	uint32_t val;
+
+	__asm volatile(
+		".set push;"
+		".set mips32;"
+		"mfc0 %0, $13;"
+		".set pop"
+		: "=r" (val));
+	return val;
+}
+
+/*
+ * Monotonic cycle counter.
+ *
+ * Because c0_count starts over at every clock interrupt, it can only
+ * time intervals shorter than a tick with no interrupt in between.
+ * So each CPU keeps the sum of the compare values at which its count
+ * has started over, and cpu_cycles adds the current count to that.
+ *
+ * Secondary CPUs begin with an offset handed over from CPU 0's
+ * counter as they start up (see mainbus_start_cpus), so readings
+ * taken on different CPUs are comparable. They can disagree by the
+ * few cycles it takes the boot CPU's store to become visible.
+ */
+#define MIPS_TIMER_MAXCPUS 32
+
+static uint64_t mips_timer_base[MIPS_TIMER_MAXCPUS];
+
+/* Handshake between the boot CPU and one starting CPU at a time. */
+#define SYNC_IDLE	0
+#define SYNC_ASKED	1
+#define SYNC_ANSWERED	2
+static volatile spinlock_data_t mips_timer_syncbusy;
+static volatile unsigned mips_timer_syncstate;
+static volatile uint64_t mips_timer_synctime;
+
 /*
  * LAMEbus data for the system. (We have only one LAMEbus per system.)
  * This does not need to be locked, because it's constant once
@@ -119,12 +199,148 @@ mainbus_bootstrap(void)
 }
 
 /*
- * Start all secondary CPUs.
+ * Move the current CPU's next clock interrupt. The interrupt handler
+ * below rearms the timer for one period, so only the next interrupt
+ * is affected.
+ *
+ * c0_count restarts from 0 when it matches c0_compare, so the new
+ * deadline has to be set relative to where count is now; setting
+ * compare below count would leave the timer silent until count wraps
+ * all the way around. And if the interrupt is already pending, leave
+ * compare alone: writing it would clear the interrupt, and the
+ * handler is about to rearm the timer anyway.
+ */
+void
+mainbus_settick(unsigned ticks)
+{
+	uint32_t count, delta;
+
+	KASSERT(curthread->t_curspl > 0);
+
+	if (ticks == 0) {
+		ticks = 1;
+	}
+	if (mips_cause() & MIPS_TIMER_BIT) {
+		return;
+	}
+	count = mips_timer_count();
+
+	/* c0_compare is 32 bits */
+	if (ticks > (0xffffffffU - count) / (CPU_FREQUENCY / HZ)) {
+		delta = 0xffffffffU - count;
+	}
+	else {
+		delta = ticks * (CPU_FREQUENCY / HZ);
+	}
+	mips_timer_set(count + delta);
+}
+
+/*
+ * Read CPU NUM's monotonic cycle counter, running on that CPU with
+ * interrupts off.
+ *
+ * If the timer interrupt is pending, count has already started over
+ * but the handler hasn't yet added compare to the base; do that here.
+ * (If the interrupt isn't pending when we look at the cause register
+ * it wasn't pending when we read count either, because only writing
+ * compare clears it.)
+ */
+static
+uint64_t
+mips_timer_cycles(unsigned num)
+{
+	uint64_t base;
+	uint32_t count;
+
+	KASSERT(num < MIPS_TIMER_MAXCPUS);
+	base = mips_timer_base[num];
+	count = mips_timer_count();
+	if (mips_cause() & MIPS_TIMER_BIT) {
+		base += mips_timer_compare();
+		count = mips_timer_count();
+	}
+	return base + count;
+}
+
+uint64_t
+cpu_cycles(void)
+{
+	uint64_t ret;
+	int spl;
+
+	/*
+	 * This must work before curcpu initialization (spinlocks call
+	 * it with lockstat on). Then only the boot CPU is running, and
+	 * with interrupts off.
+	 */
+	if (!CURCPU_EXISTS()) {
+		return mips_timer_cycles(0);
+	}
+
+	spl = splhigh();
+	ret = mips_timer_cycles(curcpu->c_number);
+	splx(spl);
+	return ret;
+}
+
+uint64_t
+mainbus_ticks(void)
+{
+	return cpu_cycles() / (CPU_FREQUENCY / HZ);
+}
+
+/*
+ * Start all secondary CPUs, then give each in turn the current value
+ * of our cycle counter to offset its own from (see mainbus_cpu_hatch).
  */
 void
 mainbus_start_cpus(void)
 {
-	lamebus_start_cpus(lamebus);
+	unsigned i, n;
+	int spl;
+
+	n = lamebus_start_cpus(lamebus);
+	for (i=0; i<n; i++) {
+		while (mips_timer_syncstate != SYNC_ASKED) {
+			/* spin */
+		}
+		spl = splhigh();
+		mips_timer_synctime = cpu_cycles();
+		membar_store_store();
+		mips_timer_syncstate = SYNC_ANSWERED;
+		splx(spl);
+	}
+}
+
+/*
+ * Called on each secondary CPU as it starts, with interrupts off:
+ * line our cycle counter up with the boot CPU's.
+ *
+ * This doesn't use a struct spinlock because with lockstat on,
+ * acquiring one reads the counter we haven't set up yet.
+ */
+void
+mainbus_cpu_hatch(void)
+{
+	unsigned num = curcpu->c_number;
+	uint64_t mine;
+
+	KASSERT(curthread->t_curspl > 0);
+	KASSERT(num < MIPS_TIMER_MAXCPUS);
+
+	while (spinlock_data_testandset(&mips_timer_syncbusy) != 0) {
+		/* spin */
+	}
+	mips_timer_syncstate = SYNC_ASKED;
+	while (mips_timer_syncstate != SYNC_ANSWERED) {
+		/* spin */
+	}
+	membar_load_load();
+	mine = cpu_cycles();
+	mips_timer_base[num] = mips_timer_synctime - mine;
+	mips_timer_syncstate = SYNC_IDLE;
+	membar_any_any();
+	spinlock_data_set(&mips_timer_syncbusy, 0);
 }
 
 /*
@@ -279,11 +495,6 @@ mainbus_send_ipi(struct cpu *target)
  * Interrupt dispatcher.
  */
 
-/* Wiring of LAMEbus interrupts to bits in the cause register */
-#define LAMEBUS_IRQ_BIT  0x00000400	/* all system bus slots */
-#define LAMEBUS_IPI_BIT  0x00000800	/* inter-processor interrupt */
-#define MIPS_TIMER_BIT   0x00008000	/* on-chip timer */
-
 void
 mainbus_interrupt(struct trapframe *tf)
 {
@@ -304,6 +515,8 @@ mainbus_interrupt(struct trapframe *tf)
 		seen = true;
 	}
 	if (cause & MIPS_TIMER_BIT) {
+		/* count started over when it matched compare */
+		mips_timer_base[curcpu->c_number] += mips_timer_compare();
 		/* Reset the timer (this clears the interrupt) */
 		mips_timer_set(CPU_FREQUENCY / HZ);
 		/* and call hardclock */
@@ -174,6 +174,7 @@ con_input(void *vcs, int ch)
 	cs->cs_gotchars_head = nexthead;
 
 	V(cs->cs_rsem);
+	pollqueue_wakeup(&cs->cs_pollq);
 }
 
 /*
@@ -240,6 +241,16 @@ con_eachopen(struct device *dev, int openflags)
 	return 0;
 }
 
+/*
+ * Check if there's input waiting.
+ */
+static
+bool
+con_haveinput(struct con_softc *cs)
+{
+	return cs->cs_gotchars_head != cs->cs_gotchars_tail;
+}
+
 static
 int
 con_io(struct device *dev, struct uio *uio)
@@ -247,6 +258,7 @@ con_io(struct device *dev, struct uio *uio)
 	int result;
 	char ch;
 	struct lock *lk;
+	size_t startresid = uio->uio_resid;
 
 	(void)dev;  // unused
 
@@ -262,6 +274,12 @@ con_io(struct device *dev, struct uio *uio)
 
 	while (uio->uio_resid > 0) {
 		if (uio->uio_rw==UIO_READ) {
+			if (uio->uio_nonblock &&
+			    !con_haveinput(the_console)) {
+				/* return what we have, if anything */
+				lock_release(lk);
+				return uio->uio_resid == startresid ? EAGAIN : 0;
+			}
 			ch = getch();
 			if (ch=='\r') {
 				ch = '\n';
@@ -302,10 +320,29 @@ con_ioctl(struct device *dev, int op, userptr_t data)
 	return EINVAL;
 }
 
+/*
+ * Input may be pending; output always goes out (eventually).
+ */
+static
+int
+con_poll(struct device *dev, int events, int *revents, struct pollentry *pe)
+{
+	struct con_softc *cs = dev->d_data;
+
+	pollqueue_add(&cs->cs_pollq, pe);
+
+	*revents = events & POLLOUT;
+	if ((events & POLLIN) && con_haveinput(cs)) {
+		*revents |= POLLIN;
+	}
+	return 0;
+}
+
 static const struct device_ops console_devops = {
 	.devop_eachopen = con_eachopen,
 	.devop_io = con_io,
 	.devop_ioctl = con_ioctl,
+	.devop_poll = con_poll,
 };
 
 static
@@ -386,6 +423,7 @@ config_con(struct con_softc *cs, int unit)
 	cs->cs_wsem = wsem;
 	cs->cs_gotchars_head = 0;
 	cs->cs_gotchars_tail = 0;
+	pollqueue_init(&cs->cs_pollq);
 
 	the_console = cs;
 	con_userlock_read = rlk;
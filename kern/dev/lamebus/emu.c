@@ -1090,6 +1090,7 @@ static const struct vnode_ops emufs_fileops = {
 	.vop_mmap = emufs_mmap,
 	.vop_truncate = emufs_truncate,
 	.vop_namefile = emufs_uio_op_notdir,
+	.vop_poll = vnode_poll_ready,
 
 	.vop_creat = emufs_creat_notdir,
 	.vop_symlink = emufs_symlink_notdir,
@@ -1124,6 +1125,7 @@ static const struct vnode_ops emufs_dirops = {
 	.vop_mmap = emufs_void_op_isdir,
 	.vop_truncate = emufs_truncate_isdir,
 	.vop_namefile = emufs_namefile,
+	.vop_poll = vnode_poll_ready,
 
 	.vop_creat = emufs_creat,
 	.vop_symlink = emufs_symlink,
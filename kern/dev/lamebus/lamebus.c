@@ -193,7 +193,7 @@ lamebus_find_cpus(struct lamebus_softc *lamebus)
  * LAMEbus; if in some environment there are other CPUs about as well
  * this logic will have to be made more complex.
  */
-void
+unsigned
 lamebus_start_cpus(struct lamebus_softc *lamebus)
 {
 	uint32_t cpumask, self, bit;
@@ -203,7 +203,7 @@ lamebus_start_cpus(struct lamebus_softc *lamebus)
 	unsigned cpunum;
 
 	if (lamebus->ls_uniprocessor) {
-		return;
+		return 0;
 	}
 
 	cpumask = read_ctl_register(lamebus, CTLREG_CPUS);
@@ -230,6 +230,8 @@ lamebus_start_cpus(struct lamebus_softc *lamebus)
 
 	/* Now, enable them all. */
 	write_ctl_register(lamebus, CTLREG_CPUE, cpumask);
+
+	return cpunum - 1;
 }
 
 /*
@@ -102,9 +102,9 @@ struct lamebus_softc *lamebus_init(void);
 void lamebus_find_cpus(struct lamebus_softc *lamebus);
 
 /*
- * Start up secondary CPUs.
+ * Start up secondary CPUs. Returns how many were started.
  */
-void lamebus_start_cpus(struct lamebus_softc *lamebus);
+unsigned lamebus_start_cpus(struct lamebus_softc *lamebus);
 
 /*
  * Look for a not-in-use slot containing a device whose vendor and device
@@ -151,6 +151,7 @@ semfs_wakeup(struct semfs_sem *sem, unsigned newcount)
 	else {
 		cv_broadcast(sem->sems_cv, sem->sems_lock);
 	}
+	pollqueue_wakeup(&sem->sems_pollq);
 }
 
 /*
@@ -191,6 +192,7 @@ semfs_read(struct vnode *vn, struct uio *uio)
 	struct semfs_vnode *semv = vn->vn_data;
 	struct semfs_sem *sem;
 	size_t consume;
+	off_t startoffset = uio->uio_offset;
 
 	sem = semfs_getsem(semv);
 
@@ -212,6 +214,11 @@ semfs_read(struct vnode *vn, struct uio *uio)
 		if (uio->uio_resid == 0) {
 			break;
 		}
+		if (sem->sems_count == 0 && uio->uio_nonblock) {
+			/* keep what we got, if anything */
+			lock_release(sem->sems_lock);
+			return uio->uio_offset == startoffset ? EAGAIN : 0;
+		}
 		if (sem->sems_count == 0) {
 			DEBUG(DB_SEMFS, "semfs: sem%u: blocking\n",
 			      semv->semv_semnum);
@@ -222,6 +229,29 @@ semfs_read(struct vnode *vn, struct uio *uio)
 	return 0;
 }
 
+/*
+ * Poll. Readable (P won't block) while the count is nonzero; always
+ * writable.
+ */
+static
+int
+semfs_poll(struct vnode *vn, int events, int *revents, struct pollentry *pe)
+{
+	struct semfs_vnode *semv = vn->vn_data;
+	struct semfs_sem *sem;
+
+	sem = semfs_getsem(semv);
+
+	lock_acquire(sem->sems_lock);
+	pollqueue_add(&sem->sems_pollq, pe);
+	*revents = events & POLLOUT;
+	if ((events & POLLIN) && sem->sems_count > 0) {
+		*revents |= POLLIN;
+	}
+	lock_release(sem->sems_lock);
+	return 0;
+}
+
 /*
  * Write. This is V(); increase the count by the amount written.
  * Don't actually bother to transfer any data.
@@ -666,6 +696,7 @@ static const struct vnode_ops semfs_dirops = {
 	.vop_mmap = vopfail_mmap_isdir,
 	.vop_truncate = vopfail_truncate_isdir,
 	.vop_namefile = semfs_namefile,
+	.vop_poll = vnode_poll_ready,
 
 	.vop_creat = semfs_creat,
 	.vop_symlink = vopfail_symlink_nosys,
@@ -699,6 +730,7 @@ static const struct vnode_ops semfs_semops = {
 	.vop_mmap = vopfail_mmap_perm,
 	.vop_truncate = semfs_truncate,
 	.vop_namefile = vopfail_uio_notdir,
+	.vop_poll = semfs_poll,
 
 	.vop_creat = vopfail_creat_notdir,
 	.vop_symlink = vopfail_symlink_notdir,
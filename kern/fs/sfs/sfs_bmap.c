@@ -52,11 +52,13 @@ sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, bool doalloc,
 	/*
 	 * I/O buffer for handling indirect blocks.
 	 *
-	 * Note: in real life (and when you've done the fs assignment)
-	 * you would get space from the disk buffer cache for this,
-	 * not use a static area.
+	 * This is allocated per call rather than static because lookups
+	 * run with the big lock held shared, so several threads can be
+	 * in here at once; a whole block is too much for the kernel
+	 * stack. In real life you would get space from the disk buffer
+	 * cache for this.
 	 */
-	static uint32_t idbuf[SFS_DBPERIDB];
+	uint32_t *idbuf;
 
 	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
 	daddr_t block;
@@ -64,9 +66,9 @@ sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, bool doalloc,
 	uint32_t idnum, idoff;
 	int result;
 
-	KASSERT(sizeof(idbuf)==SFS_BLOCKSIZE);
+	KASSERT(SFS_DBPERIDB * sizeof(idbuf[0]) == SFS_BLOCKSIZE);
 
-	/* Since we're using a static buffer, we'd better be locked. */
+	/* Block maps are protected by the big lock. */
 	KASSERT(vfs_biglock_do_i_hold());
 
 	/*
@@ -136,7 +138,13 @@ sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, bool doalloc,
 		*diskblock = 0;
 		return 0;
 	}
-	else if (idblock==0) {
+
+	idbuf = kmalloc(SFS_BLOCKSIZE);
+	if (idbuf == NULL) {
+		return ENOMEM;
+	}
+
+	if (idblock==0) {
 		/*
 		 * There's no indirect block allocated, but we need to
 		 * allocate a block whose number needs to be stored in
@@ -145,6 +153,7 @@ sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, bool doalloc,
 		 */
 		result = sfs_balloc(sfs, &idblock);
 		if (result) {
+			kfree(idbuf);
 			return result;
 		}
 
@@ -155,14 +164,15 @@ sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, bool doalloc,
 		sv->sv_dirty = true;
 
 		/* Clear the indirect block buffer */
-		bzero(idbuf, sizeof(idbuf));
+		bzero(idbuf, SFS_BLOCKSIZE);
 	}
 	else {
 		/*
 		 * We already have an indirect block allocated; load it.
 		 */
-		result = sfs_readblock(sfs, idblock, idbuf, sizeof(idbuf));
+		result = sfs_readblock(sfs, idblock, idbuf, SFS_BLOCKSIZE);
 		if (result) {
+			kfree(idbuf);
 			return result;
 		}
 	}
@@ -174,6 +184,7 @@ sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, bool doalloc,
 	if (block==0 && doalloc) {
 		result = sfs_balloc(sfs, &block);
 		if (result) {
+			kfree(idbuf);
 			return result;
 		}
 
@@ -181,11 +192,13 @@ sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, bool doalloc,
 		idbuf[idoff] = block;
 
 		/* The indirect block is now dirty; write it back */
-		result = sfs_writeblock(sfs, idblock, idbuf, sizeof(idbuf));
+		result = sfs_writeblock(sfs, idblock, idbuf, SFS_BLOCKSIZE);
 		if (result) {
+			kfree(idbuf);
 			return result;
 		}
 	}
+	kfree(idbuf);
 
 	/* Hand back the result and return. */
 	if (block != 0 && !sfs_bused(sfs, block)) {
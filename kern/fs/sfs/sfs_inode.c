@@ -35,10 +35,39 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <lib.h>
+#include <synch.h>
 #include <vfs.h>
 #include <sfs.h>
+#include <slab.h>
 #include "sfsprivate.h"
 
+/*
+ * sfs_vnodes come from a cache shared by all mounts, made by the
+ * first mount. There is no constructor: vnode_init belongs to the
+ * vnode layer and has to be redone each time anyway.
+ */
+static struct kmem_cache *sfs_vnode_cache;
+
+/*
+ * Create the vnode cache if it isn't there yet. Called from mount
+ * with the big lock held.
+ */
+int
+sfs_vnode_cacheinit(void)
+{
+	KASSERT(vfs_biglock_do_i_hold());
+
+	if (sfs_vnode_cache != NULL) {
+		return 0;
+	}
+	sfs_vnode_cache = kmem_cache_create("sfs_vnode",
+					    sizeof(struct sfs_vnode), 0,
+					    NULL, NULL);
+	if (sfs_vnode_cache == NULL) {
+		return ENOMEM;
+	}
+	return 0;
+}
 
 /*
  * Write an on-disk inode structure back out to disk.
@@ -115,6 +144,7 @@ sfs_reclaim(struct vnode *v)
 	}
 
 	/* Remove the vnode structure from the table in the struct sfs_fs. */
+	rwlock_acquire_write(sfs->sfs_vnlock);
 	num = vnodearray_num(sfs->sfs_vnodes);
 	ix = num;
 	for (i=0; i<num; i++) {
@@ -130,33 +160,31 @@ sfs_reclaim(struct vnode *v)
 		      sfs->sfs_sb.sb_volname, sv->sv_ino);
 	}
 	vnodearray_remove(sfs->sfs_vnodes, ix);
+	rwlock_release_write(sfs->sfs_vnlock);
 
 	vnode_cleanup(&sv->sv_absvn);
 
 	vfs_biglock_release();
 
 	/* Release the storage for the vnode structure itself. */
-	kfree(sv);
+	kmem_cache_free(sfs_vnode_cache, sv);
 
 	/* Done */
 	return 0;
 }
 
 /*
- * Function to load a inode into memory as a vnode, or dig up one
- * that's already resident.
+ * Search the vnode table for an inode that's already resident. Call
+ * with sfs_vnlock held in either mode.
  */
-int
-sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
-		 struct sfs_vnode **ret)
+static
+struct sfs_vnode *
+sfs_findvnode(struct sfs_fs *sfs, uint32_t ino)
 {
 	struct vnode *v;
 	struct sfs_vnode *sv;
-	const struct vnode_ops *ops;
 	unsigned i, num;
-	int result;
 
-	/* Look in the vnodes table */
 	num = vnodearray_num(sfs->sfs_vnodes);
 
 	/* Linear search. Is this too slow? You decide. */
@@ -171,20 +199,51 @@ sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 		}
 
 		if (sv->sv_ino==ino) {
-			/* Found */
+			return sv;
+		}
+	}
+	return NULL;
+}
 
-			/* forcetype is only allowed when creating objects */
-			KASSERT(forcetype==SFS_TYPE_INVAL);
+/*
+ * Function to load a inode into memory as a vnode, or dig up one
+ * that's already resident.
+ *
+ * Lookups call this with the big lock held only shared, so several
+ * threads can be loading at once. The table search is done under
+ * sfs_vnlock in read mode; on a miss the inode is read without any
+ * table lock and then inserted under sfs_vnlock in write mode, after
+ * checking that nobody else loaded the same inode in the meantime.
+ * Reclaim holds the big lock exclusively, so a vnode found here
+ * cannot be in the middle of being torn down.
+ */
+int
+sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
+		 struct sfs_vnode **ret)
+{
+	struct sfs_vnode *sv, *other;
+	const struct vnode_ops *ops;
+	int result;
 
-			VOP_INCREF(&sv->sv_absvn);
-			*ret = sv;
-			return 0;
-		}
+	KASSERT(vfs_biglock_do_i_hold());
+
+	/* Look in the vnodes table */
+	rwlock_acquire_read(sfs->sfs_vnlock);
+	sv = sfs_findvnode(sfs, ino);
+	if (sv != NULL) {
+		/* forcetype is only allowed when creating objects */
+		KASSERT(forcetype==SFS_TYPE_INVAL);
+
+		VOP_INCREF(&sv->sv_absvn);
+		rwlock_release_read(sfs->sfs_vnlock);
+		*ret = sv;
+		return 0;
 	}
+	rwlock_release_read(sfs->sfs_vnlock);
 
 	/* Didn't have it loaded; load it */
 
-	sv = kmalloc(sizeof(struct sfs_vnode));
+	sv = kmem_cache_alloc(sfs_vnode_cache);
 	if (sv==NULL) {
 		return ENOMEM;
 	}
@@ -198,7 +257,7 @@ sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 	/* Read the block the inode is in */
 	result = sfs_readblock(sfs, ino, &sv->sv_i, sizeof(sv->sv_i));
 	if (result) {
-		kfree(sv);
+		kmem_cache_free(sfs_vnode_cache, sv);
 		return result;
 	}
 
@@ -235,18 +294,33 @@ sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 	/* Call the common vnode initializer */
 	result = vnode_init(&sv->sv_absvn, ops, &sfs->sfs_absfs, sv);
 	if (result) {
-		kfree(sv);
+		kmem_cache_free(sfs_vnode_cache, sv);
 		return result;
 	}
 
 	/* Set the other fields in our vnode structure */
 	sv->sv_ino = ino;
 
+	rwlock_acquire_write(sfs->sfs_vnlock);
+
+	/* If someone beat us to it, use theirs and throw ours away */
+	other = sfs_findvnode(sfs, ino);
+	if (other != NULL) {
+		KASSERT(forcetype==SFS_TYPE_INVAL);
+		VOP_INCREF(&other->sv_absvn);
+		rwlock_release_write(sfs->sfs_vnlock);
+		vnode_cleanup(&sv->sv_absvn);
+		kmem_cache_free(sfs_vnode_cache, sv);
+		*ret = other;
+		return 0;
+	}
+
 	/* Add it to our table */
 	result = vnodearray_add(sfs->sfs_vnodes, &sv->sv_absvn, NULL);
+	rwlock_release_write(sfs->sfs_vnlock);
 	if (result) {
 		vnode_cleanup(&sv->sv_absvn);
-		kfree(sv);
+		kmem_cache_free(sfs_vnode_cache, sv);
 		return result;
 	}
 
@@ -296,24 +370,24 @@ sfs_getroot(struct fs *fs, struct vnode **ret)
 	struct sfs_vnode *sv;
 	int result;
 
-	vfs_biglock_acquire();
+	vfs_biglock_acquire_shared();
 
 	result = sfs_loadvnode(sfs, SFS_ROOTDIR_INO, SFS_TYPE_INVAL, &sv);
 	if (result) {
 		kprintf("sfs: %s: getroot: Cannot load root vnode\n",
 			sfs->sfs_sb.sb_volname);
-		vfs_biglock_release();
+		vfs_biglock_release_shared();
 		return result;
 	}
 
 	if (sv->sv_i.sfi_type != SFS_TYPE_DIR) {
 		kprintf("sfs: %s: getroot: not directory (type %u)\n",
 			sfs->sfs_sb.sb_volname, sv->sv_i.sfi_type);
-		vfs_biglock_release();
+		vfs_biglock_release_shared();
 		return EINVAL;
 	}
 
-	vfs_biglock_release();
+	vfs_biglock_release_shared();
 
 	*ret = &sv->sv_absvn;
 	return 0;
@@ -415,15 +415,13 @@ sfs_metaio(struct sfs_vnode *sv, off_t actualpos, void *data, size_t len,
 	int result;
 
 	/*
-	 * I/O buffer for metadata ops.
-	 *
-	 * Note: in real life (and when you've done the fs assignment) you
-	 * would get space from the disk buffer cache for this, not use a
-	 * static area.
+	 * I/O buffer for metadata ops. Per-call, because directory
+	 * reads happen under the shared big lock, and allocated,
+	 * because a whole block is too much for the kernel stack.
 	 */
-	static char metaiobuf[SFS_BLOCKSIZE];
+	char *metaiobuf;
 
-	/* We're using a global static buffer; it had better be locked */
+	/* Directory contents are protected by the big lock */
 	KASSERT(vfs_biglock_do_i_hold());
 
 	/* Figure out which block of the vnode (directory, whatever) this is */
@@ -446,9 +444,15 @@ sfs_metaio(struct sfs_vnode *sv, off_t actualpos, void *data, size_t len,
 		return 0;
 	}
 
+	metaiobuf = kmalloc(SFS_BLOCKSIZE);
+	if (metaiobuf == NULL) {
+		return ENOMEM;
+	}
+
 	/* Read the block */
-	result = sfs_readblock(sfs, diskblock, metaiobuf, sizeof(metaiobuf));
+	result = sfs_readblock(sfs, diskblock, metaiobuf, SFS_BLOCKSIZE);
 	if (result) {
+		kfree(metaiobuf);
 		return result;
 	}
 
@@ -462,8 +466,9 @@ sfs_metaio(struct sfs_vnode *sv, off_t actualpos, void *data, size_t len,
 
 		/* Write the block back */
 		result = sfs_writeblock(sfs, diskblock,
-					metaiobuf, sizeof(metaiobuf));
+					metaiobuf, SFS_BLOCKSIZE);
 		if (result) {
+			kfree(metaiobuf);
 			return result;
 		}
 
@@ -476,5 +481,6 @@ sfs_metaio(struct sfs_vnode *sv, off_t actualpos, void *data, size_t len,
 	}
 
 	/* Done */
+	kfree(metaiobuf);
 	return 0;
 }
@@ -65,6 +65,8 @@ struct addrspace {
 
         struct vnode *v;
         Elf_Ehdr eh;
+        unsigned as_resident;   /* pages entered in the page table */
+        struct semaphore *as_faultsem; /* one page fill at a time */
 
         /* Put stuff here for your VM system */
 
@@ -75,6 +77,9 @@ struct addrspace {
 /*
  * Functions in addrspace.c:
  *
+ *    as_bootstrap - set up the address space cache. Called once, from
+ *                vm_bootstrap.
+ *
  *    as_create - create a new empty address space. You need to make
  *                sure this gets called in all the right places. You
  *                may find you want to change the argument list. May
@@ -93,8 +98,9 @@ struct addrspace {
  *                avoid potentially "seeing" it while it's being
  *                destroyed.
  *
- *    as_destroy - dispose of an address space. You may need to change
- *                the way this works if implementing user-level threads.
+ *    as_destroy - dispose of an address space. Must be called by the
+ *                last thread of the owning process; drops the process's
+ *                translations from every CPU's TLB.
  *
  *    as_define_region - set up a region of memory within the address
  *                space.
@@ -113,6 +119,7 @@ struct addrspace {
  * functions are found in dumbvm.c.
  */
 #define VADDR_SIZE 1048576
+void              as_bootstrap(void);
 struct addrspace *as_create(void);
 int               as_copy(struct addrspace *src, struct addrspace **ret);
 void              as_activate(void);
@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef _ARGBUF_H_
+#define _ARGBUF_H_
+
+/*
+ * Argument block for a new program image.
+ *
+ * The argv strings are packed back to back, NUL-terminated, into a
+ * single ARG_MAX-sized kernel buffer as they are copied in, so a
+ * program's arguments cost one allocation no matter how many there
+ * are. The space the argv pointer array will need on the user stack
+ * is charged against ARG_MAX as each string is added.
+ *
+ * Functions:
+ *     argbuf_init       - allocate the buffer. Returns ENOMEM on error.
+ *     argbuf_cleanup    - free the buffer.
+ *     argbuf_fromkernel - fill from an argv array in kernel memory.
+ *     argbuf_copyin     - fill from a NULL-terminated argv array in
+ *                         user memory.
+ *     argbuf_copyout    - lay out argv (pointers followed by strings)
+ *                         below *STACKPTR in the current address
+ *                         space with one copyout. Updates *STACKPTR
+ *                         and hands back the user address of argv.
+ *                         This rewrites the buffer in place, so it
+ *                         may only be done once.
+ *
+ * All of these except argbuf_cleanup return 0 or an error code; E2BIG
+ * means the arguments do not fit in ARG_MAX.
+ */
+
+struct argbuf {
+	char *ab_buf;		/* ARG_MAX bytes of packed strings */
+	size_t ab_len;		/* Bytes of ab_buf in use */
+	int ab_argc;		/* Number of strings in ab_buf */
+};
+
+int argbuf_init(struct argbuf *ab);
+void argbuf_cleanup(struct argbuf *ab);
+int argbuf_fromkernel(struct argbuf *ab, int argc, char **argv);
+int argbuf_copyin(struct argbuf *ab, userptr_t uargv);
+int argbuf_copyout(struct argbuf *ab, vaddr_t *stackptr, userptr_t *uargv);
+
+
+#endif /* _ARGBUF_H_ */
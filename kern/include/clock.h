@@ -48,6 +48,15 @@
 void hardclock_bootstrap(void);
 void hardclock(void);
 
+/*
+ * Tickless idle: an idle CPU calls hardclock_idle() before waiting
+ * for an interrupt and hardclock_busy() after, with interrupts off.
+ * While idle its hardclocks stop (on CPU 0, until the next timeout
+ * is due); c_hardclocks counts only the ones taken.
+ */
+void hardclock_idle(void);
+void hardclock_busy(void);
+
 /*
  * timerclock() is called on one CPU once a second to allow simple
  * timed operations. (This is a fairly simpleminded interface.)
@@ -79,5 +88,10 @@ void timespec_sub(const struct timespec *t1,
  */
 void clocksleep(int seconds);
 
+/*
+ * ticksleep() suspends execution for TICKS hardclock ticks.
+ */
+void ticksleep(unsigned ticks);
+
 
 #endif /* _CLOCK_H_ */
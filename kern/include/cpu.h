@@ -35,6 +35,17 @@
 #include <threadlist.h>
 #include <machine/vm.h>  /* for TLBSHOOTDOWN_MAX */
 
+/*
+ * Number of scheduler priority levels, and so of run queues per CPU.
+ * Level 0 is the highest priority. See thread.c.
+ */
+#define SCHED_NLEVELS	4
+
+/*
+ * Number of free kernel stacks each cpu keeps for reuse. See thread.c.
+ */
+#define STACKPOOL_MAX	4
+
 
 /*
  * Per-cpu structure
@@ -60,6 +71,7 @@ struct cpu {
 	struct thread *c_curthread;	/* Current thread on cpu */
 	struct threadlist c_zombies;	/* List of exited threads */
 	unsigned c_hardclocks;		/* Counter of hardclock() calls */
+	bool c_tickless;		/* Periodic hardclock stopped */
 	unsigned c_spinlocks;		/* Counter of spinlocks held */
 
 	/*
@@ -67,9 +79,17 @@ struct cpu {
 	 * Protected by the runqueue lock.
 	 */
 	bool c_isidle;			/* True if this cpu is idle */
-	struct threadlist c_runqueue;	/* Run queue for this cpu */
+	struct threadlist c_runqueue[SCHED_NLEVELS]; /* Run queues, by level */
 	struct spinlock c_runqueue_lock;
 
+	/*
+	 * Used by this cpu; other cpus only empty it, when memory
+	 * runs short. Protected by the stack pool lock.
+	 */
+	void *c_stackpool[STACKPOOL_MAX]; /* Free kernel stacks */
+	unsigned c_numstacks;
+	struct spinlock c_stackpool_lock;
+
 	/*
 	 * Accessed by other cpus.
 	 * Protected by the IPI lock.
@@ -120,6 +140,15 @@ void cpu_identify(char *buf, size_t max);
 void cpu_irqoff(void);
 void cpu_irqon(void);
 
+/*
+ * Read the cycle counter. It is monotonic and 64 bits wide, so it
+ * doesn't wrap, and the counters of different CPUs are lined up at
+ * startup closely enough that a reading taken on one CPU can be
+ * subtracted from one taken on another. (On sys161 this is built from
+ * the timer's count register and is provided by the platform code.)
+ */
+uint64_t cpu_cycles(void);
+
 /*
  * Idle or shut down (respectively) the processor.
  *
@@ -150,6 +179,8 @@ void cpu_halt(void);
  * ipi_send sends an IPI to one CPU.
  * ipi_broadcast sends an IPI to all CPUs except the current one.
  * ipi_tlbshootdown is like ipi_send but carries TLB shootdown data.
+ * ipi_tlbshootdown_broadcast sends the same shootdown to all CPUs
+ * except the current one.
  *
  * interprocessor_interrupt is called on the target CPU when an IPI is
  * received.
@@ -164,6 +195,7 @@ void cpu_halt(void);
 void ipi_send(struct cpu *target, int code);
 void ipi_broadcast(int code);
 void ipi_tlbshootdown(struct cpu *target, const struct tlbshootdown *mapping);
+void ipi_tlbshootdown_broadcast(const struct tlbshootdown *mapping);
 
 void interprocessor_interrupt(void);
 
@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef _KERN_AIO_H_
+#define _KERN_AIO_H_
+
+/*
+ * Asynchronous file I/O.
+ *
+ * aio_read and aio_write queue a transfer described by a control
+ * block and return at once; the transfer is done by kernel worker
+ * threads. Each finished request posts an event to the process's
+ * completion queue, and aio_wait collects them. aio_offset is always
+ * used (as by pread/pwrite) and the open file's seek position is left
+ * alone.
+ *
+ * The buffer of an aio_read is filled in when its event is collected
+ * by aio_wait, not before; the buffer of an aio_write is copied when
+ * the request is queued and may be reused right away.
+ */
+
+struct aiocb {
+	int aio_fildes;		/* file handle */
+#ifdef _KERNEL
+	userptr_t aio_buf;	/* data buffer */
+#else
+	void *aio_buf;
+#endif
+	__u32 aio_nbytes;	/* byte count */
+	__u32 aio_data;		/* not interpreted; copied to the event */
+	off_t aio_offset;	/* file position */
+};
+
+struct aio_event {
+	__u32 ae_data;		/* aio_data of the request */
+	int ae_error;		/* 0 or an errno value */
+	__i32 ae_result;	/* bytes transferred, or -1 */
+};
+
+/* Flags for aio_wait */
+#define AIO_NOWAIT  1		/* return 0 instead of sleeping */
+
+/* Largest transfer accepted by one request */
+#define AIO_MAXBYTES  (64*1024)
+
+/* Most requests a process may have queued or uncollected at once */
+#define AIO_MAXREQS   32
+
+
+#endif /* _KERN_AIO_H_ */
@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef _KERN_SYSRING_H_
+#define _KERN_SYSRING_H_
+
+/*
+ * Batched system call ring.
+ *
+ * A process fills in submission entries (sqes) in memory of its own
+ * and passes the ring to sysring_enter(), which runs the pending
+ * operations in order and posts one completion entry (cqe) each, all
+ * in a single trip into the kernel.
+ *
+ * Both rings have sr_entries slots, a power of two; the head and tail
+ * counters run freely and are reduced modulo sr_entries to index the
+ * arrays. The process owns sr_sqtail and sr_cqhead; the kernel
+ * advances sr_sqhead and sr_cqtail. Submission stops early when the
+ * completion ring is full.
+ */
+
+struct sysring_sqe {
+	int sqe_op;		/* SYSRING_OP_* */
+	int sqe_fd;		/* file handle (unused by open) */
+#ifdef _KERNEL
+	userptr_t sqe_buf;	/* buffer; pathname for open */
+#else
+	void *sqe_buf;
+#endif
+	__u32 sqe_len;		/* byte count; mode for open */
+	int sqe_flags;		/* flags for open, whence for lseek */
+	__u32 sqe_data;		/* not interpreted; copied to the cqe */
+	off_t sqe_off;		/* offset for lseek */
+};
+
+struct sysring_cqe {
+	__u32 cqe_data;		/* sqe_data of the request */
+	int cqe_error;		/* 0 or an errno value */
+	off_t cqe_result;	/* bytes transferred, new fd, or offset */
+};
+
+struct sysring {
+	unsigned sr_sqhead;	/* next sqe the kernel will run */
+	unsigned sr_sqtail;	/* next free sqe */
+	unsigned sr_cqhead;	/* next cqe the process will read */
+	unsigned sr_cqtail;	/* next free cqe */
+	unsigned sr_entries;	/* slots in each ring */
+#ifdef _KERNEL
+	userptr_t sr_sqes;	/* submission array */
+	userptr_t sr_cqes;	/* completion array */
+#else
+	struct sysring_sqe *sr_sqes;
+	struct sysring_cqe *sr_cqes;
+#endif
+};
+
+/* Operations */
+#define SYSRING_OP_NOP    0	/* does nothing; completes with 0 */
+#define SYSRING_OP_READ   1
+#define SYSRING_OP_WRITE  2
+#define SYSRING_OP_LSEEK  3
+#define SYSRING_OP_OPEN   4
+#define SYSRING_OP_CLOSE  5
+
+/* Largest ring accepted */
+#define SYSRING_MAXENTRIES  4096
+
+
+#endif /* _KERN_SYSRING_H_ */
@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef _KERN_VDSO_H_
+#define _KERN_VDSO_H_
+
+/*
+ * Kernel-maintained pages mapped read-only into every user address
+ * space, so that reading the clock or one's own pid needs no trap.
+ *
+ * VDSO_TIMEPAGE is a single page shared by all processes. The kernel
+ * rewrites the snapshot in it on every hardclock, incrementing vt_seq
+ * before and after, so vt_seq is odd while an update is in progress.
+ * A reader loads vt_seq, copies the fields, and starts over if vt_seq
+ * was odd or has changed in the meantime. The snapshot is only as
+ * fresh as the last clock tick (1/HZ seconds).
+ *
+ * VDSO_PROCPAGE is private to each process.
+ *
+ * Both live just below the user stack region.
+ */
+
+#define VDSO_TIMEPAGE	0x7ff00000
+#define VDSO_PROCPAGE	0x7ff01000
+
+struct vdso_time {
+	volatile __u32 vt_seq;		/* update count; odd = in progress */
+	__u32 vt_nsec;			/* nanoseconds */
+	__time_t vt_sec;		/* seconds since the epoch */
+};
+
+struct vdso_proc {
+	__pid_t vp_pid;			/* process id */
+};
+
+#endif /* _KERN_VDSO_H_ */
@@ -133,6 +133,12 @@ void kheap_nextgeneration(void);
 void kheap_dump(void);
 void kheap_dumpall(void);
 
+/*
+ * kmalloc_cpu_init gives a CPU its own caches of free blocks; see
+ * kmalloc.c. Called from cpu_create.
+ */
+void kmalloc_cpu_init(unsigned cpunum);
+
 /*
  * C string functions.
  *
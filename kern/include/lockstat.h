@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef _LOCKSTAT_H_
+#define _LOCKSTAT_H_
+
+/*
+ * Lock statistics, for the "lockstat" build option.
+ *
+ * For every spinlock, sleep lock and wait channel, grouped by name,
+ * this counts acquisitions, how many of them were contended, the
+ * total cycles spent waiting, and the longest hold. For a wait
+ * channel an "acquisition" is one wchan_sleep, every one of them
+ * counts as contended, and the hold time is how long it slept.
+ *
+ * Locks of the same name are lumped together, so for instance all
+ * the vnode count locks show up as one line. Spinlocks with no name
+ * (see spinlock_setname) are told apart by the address they were
+ * acquired from instead.
+ *
+ * As with sysstat, each CPU keeps its own table, updated only by
+ * that CPU with interrupts off, so recording takes no lock; the
+ * report adds the tables up. Hold and wait times are differences of
+ * cpu_cycles() readings, which are comparable across CPUs, so a sleep
+ * lock released on a different CPU than it was acquired on still
+ * gets a sensible hold time.
+ *
+ * Without the option, none of this is compiled and the hooks in
+ * spinlock.c, synch.c and thread.c disappear.
+ */
+
+#include "opt-lockstat.h"
+
+/* Kinds of lock. */
+#define LOCKSTAT_SPIN   0	/* struct spinlock */
+#define LOCKSTAT_SLEEP  1	/* struct lock */
+#define LOCKSTAT_WCHAN  2	/* struct wchan */
+
+#define LOCKSTAT_NAMELEN  24	/* longer names are cut short */
+#define LOCKSTAT_NENTRIES 256	/* per CPU; must be a power of 2 */
+#define LOCKSTAT_MAXCPUS  32
+#define LOCKSTAT_TOP      20	/* lines in the menu report */
+
+/* Report buffer size used by the menu. */
+#define LOCKSTAT_REPORTMAX (8*1024)
+
+#if OPT_LOCKSTAT
+
+/*
+ * Functions:
+ *     lockstat_cpu_init - allocate the table for CPU number CPUNUM.
+ *     lockstat_acquire  - account one acquisition of the lock of kind
+ *                         KIND called NAME (or, if NAME is NULL,
+ *                         acquired at SITE). CONTENDED is true if it
+ *                         had to wait, WAIT the cycles spent waiting.
+ *     lockstat_hold     - account a hold of HOLD cycles for the same
+ *                         lock.
+ *     lockstat_report   - format the TOP locks with the most waiting
+ *                         into BUF (at most LEN bytes including the
+ *                         NUL); returns the length of the text.
+ *     lockstat_reset    - zero every CPU's table.
+ */
+void lockstat_cpu_init(unsigned cpunum);
+void lockstat_acquire(unsigned kind, const char *name, vaddr_t site,
+		      bool contended, uint64_t wait);
+void lockstat_hold(unsigned kind, const char *name, vaddr_t site,
+		   uint64_t hold);
+size_t lockstat_report(char *buf, size_t len, unsigned top);
+void lockstat_reset(void);
+
+#endif /* OPT_LOCKSTAT */
+
+
+#endif /* _LOCKSTAT_H_ */
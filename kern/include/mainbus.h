@@ -45,6 +45,9 @@ void mainbus_bootstrap(void);
 /* Start up secondary CPUs, once their cpu structures are set up */
 void mainbus_start_cpus(void);
 
+/* Per-CPU setup on a secondary CPU as it starts, interrupts still off */
+void mainbus_cpu_hatch(void);
+
 /* Bus-level interrupt handler, called from cpu-level trap/interrupt code */
 void mainbus_interrupt(struct trapframe *);
 
@@ -55,6 +58,21 @@ size_t mainbus_ramsize(void);
 /* Switch on an inter-processor interrupt. (Low-level.) */
 void mainbus_send_ipi(struct cpu *target);
 
+/*
+ * Make the current CPU's next clock interrupt come TICKS hardclock
+ * periods from now rather than one; later ones are periodic again.
+ * TICKS may be cut down to what the hardware can do. Call with
+ * interrupts off. (For tickless idle; see clock.c.)
+ */
+void mainbus_settick(unsigned ticks);
+
+/*
+ * Hardclock periods since boot, from the cycle counter rather than
+ * from counting interrupts, so it keeps going while CPUs are tickless
+ * and reads the same on every CPU.
+ */
+uint64_t mainbus_ticks(void);
+
 /*
  * The various ways to shut down the system. (These are very low-level
  * and should generally not be called directly - md_poweroff, for
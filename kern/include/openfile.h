@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef _OPENFILE_H_
+#define _OPENFILE_H_
+
+/*
+ * Open files and per-process file tables.
+ */
+
+#include <spinlock.h>
+
+struct lock;
+struct proc;
+struct vnode;
+
+/*
+ * An open file: the object returned by open(), shared by every file
+ * table slot (in this or other processes) that refers to it, and
+ * holding the seek position those slots share.
+ *
+ * of_lock is a sleep lock held across I/O so that the read or write
+ * and the update of of_offset happen atomically; of_reflock is a
+ * spinlock so references can be taken without sleeping. Changes to
+ * of_flags (fcntl) also go under of_reflock, so they need not wait
+ * for I/O that may block indefinitely.
+ */
+struct openfile {
+	struct vnode *of_vnode;		/* Underlying object */
+	volatile int of_flags;		/* Flags from open(); of_reflock */
+	off_t of_offset;		/* Current seek position */
+	struct lock *of_lock;		/* Protects of_offset */
+	struct spinlock of_reflock;	/* Protects of_refcount */
+	unsigned of_refcount;		/* References to this open file */
+};
+
+/*
+ * Functions on open files:
+ *     openfile_create - wrap vnode V in a new open file. Consumes the
+ *                       caller's reference to V on success.
+ *     openfile_open   - vfs_open PATH and wrap it in an open file.
+ *                       May destroy PATH.
+ *     openfile_incref - take another reference.
+ *     openfile_decref - drop a reference; the last one closes the file.
+ */
+int openfile_create(struct vnode *v, int flags, struct openfile **ret);
+int openfile_open(char *path, int flags, mode_t mode, struct openfile **ret);
+void openfile_incref(struct openfile *of);
+void openfile_decref(struct openfile *of);
+
+/*
+ * Functions on the file table of a process (proc->p_filetable):
+ *     filetable_get      - look up FD in the current process; hands
+ *                          back a new reference. EBADF if not open.
+ *     filetable_place    - put OF in the lowest free slot of the
+ *                          current process and hand back the slot.
+ *                          Consumes the caller's reference on success.
+ *     filetable_setfd    - put OF in slot FD of P, closing what was
+ *                          there. Consumes the caller's reference.
+ *     filetable_clear    - empty slot FD of the current process and
+ *                          hand back what was in it (or NULL).
+ *     filetable_console  - open the console as fds 0, 1 and 2 of the
+ *                          current process.
+ *     filetable_inherit  - fill DST's table from the current process:
+ *                          slot i of DST gets the file at FDMAP[i], or
+ *                          stays empty if FDMAP[i] is negative. With a
+ *                          NULL FDMAP, DST gets every open file.
+ *     filetable_closeall - close everything in P's table.
+ */
+int filetable_get(int fd, struct openfile **ret);
+int filetable_place(struct openfile *of, int *fd);
+void filetable_setfd(struct proc *p, int fd, struct openfile *of);
+struct openfile *filetable_clear(int fd);
+int filetable_console(void);
+int filetable_inherit(struct proc *dst, const int *fdmap, int nfds);
+void filetable_closeall(struct proc *p);
+
+
+#endif /* _OPENFILE_H_ */
@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef _POLL_H_
+#define _POLL_H_
+
+/*
+ * Wait queues for poll().
+ *
+ * Each object a process can poll keeps a pollqueue. poll() makes a
+ * pollwaiter for itself and hands VOP_POLL one pollentry per file;
+ * the object links the entry onto its queue and, whenever something
+ * changes that might make a poller's answer different, calls
+ * pollqueue_wakeup(), which wakes every waiter registered there. The
+ * waiter then asks all its objects again.
+ *
+ * Lock order: object's lock, then pq_lock, then pw_lock. Wakeups
+ * may be done from interrupt handlers.
+ *
+ * A waiter may have a deadline in hardclock ticks, kept as a timeout
+ * (see timeout.h) that wakes it once the deadline passes.
+ */
+
+#include <spinlock.h>
+#include <timeout.h>
+#include <kern/poll.h>
+
+struct wchan;
+struct pollwaiter;
+
+struct pollentry {
+	struct pollentry *pe_next;	/* on pe_queue */
+	struct pollentry *pe_prev;
+	struct pollqueue *pe_queue;	/* queue we're on, or NULL */
+	struct pollwaiter *pe_waiter;	/* who to wake */
+};
+
+struct pollqueue {
+	struct spinlock pq_lock;
+	struct pollentry pq_head;	/* sentinel */
+};
+
+struct pollwaiter {
+	struct spinlock pw_lock;
+	struct wchan *pw_wchan;
+	bool pw_fired;			/* something changed since reset */
+	bool pw_timedout;		/* deadline passed */
+	struct timeout pw_timeout;	/* sets pw_timedout */
+};
+
+/*
+ * Functions:
+ *    pollqueue_init/cleanup  - set up/tear down a queue; it must be
+ *                              empty when cleaned up.
+ *    pollqueue_add           - link PE onto PQ. PE may be NULL, in
+ *                              which case nothing happens, so that
+ *                              VOP_POLL can pass its argument along.
+ *    pollqueue_wakeup        - wake everyone registered on PQ.
+ *
+ *    pollwaiter_init/cleanup - set up/tear down a waiter.
+ *    pollentry_init          - bind PE to waiter PW.
+ *    pollentry_remove        - take PE off whatever queue it is on.
+ *    pollwaiter_settimeout   - arrange to be woken after TICKS ticks.
+ *    pollwaiter_wait         - sleep until woken or timed out, then
+ *                              clear pw_fired. Returns true if the
+ *                              deadline has passed.
+ */
+void pollqueue_init(struct pollqueue *pq);
+void pollqueue_cleanup(struct pollqueue *pq);
+void pollqueue_add(struct pollqueue *pq, struct pollentry *pe);
+void pollqueue_wakeup(struct pollqueue *pq);
+
+int pollwaiter_init(struct pollwaiter *pw);
+void pollwaiter_cleanup(struct pollwaiter *pw);
+void pollentry_init(struct pollentry *pe, struct pollwaiter *pw);
+void pollentry_remove(struct pollentry *pe);
+void pollwaiter_settimeout(struct pollwaiter *pw, unsigned ticks);
+bool pollwaiter_wait(struct pollwaiter *pw);
+
+#endif /* _POLL_H_ */
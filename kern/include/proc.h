@@ -36,23 +36,43 @@
  * Note: curproc is defined by <current.h>.
  */
 
+#include <limits.h>
 #include <spinlock.h>
+#include <rcu.h>
 #include <types.h>
 
 struct addrspace;
+struct aioctx;
+struct openfile;
+struct semaphore;
 struct thread;
 struct vnode;
+struct wchan;
+
+/* Maximum number of threads in a user process. */
+#define PROC_MAXTHREADS 32
+
+/*
+ * User thread slot. A thread's tid is the index of its slot, which
+ * is reserved when the thread is created (tid 0 for the initial
+ * thread) and freed when another thread joins it.
+ */
+#define UT_FREE		0
+#define UT_RUNNING	1
+#define UT_EXITED	2
+
+struct uthread {
+	struct thread *ut_thread;	/* NULL until bound, and after exit */
+	int ut_state;			/* UT_* */
+	int ut_status;			/* thread_exit status, once exited */
+};
 
 /*
  * Process structure.
  *
- * Note that we only count the number of threads in each process.
- * (And, unless you implement multithreaded user processes, this
- * number will not exceed 1 except in kproc.) If you want to know
- * exactly which threads are in the process, e.g. for debugging, add
- * an array and a sleeplock to protect it. (You can't use a spinlock
- * to protect an array because arrays need to be able to call
- * kmalloc.)
+ * p_numthreads counts the threads attached to the process; user
+ * processes additionally keep a fixed array of thread slots
+ * (p_uthreads) for thread_join. Both are protected by p_lock.
  *
  * You will most likely be adding stuff to this structure, so you may
  * find you need a sleeplock in here for other reasons as well.
@@ -71,12 +91,43 @@ struct proc {
 	/* VFS */
 	struct vnode *p_cwd;		/* current working directory */
 
+	/* open files, indexed by fd; slots protected by p_lock */
+	struct openfile *p_filetable[OPEN_MAX];
+
+	/* user threads; protected by p_lock */
+	struct uthread p_uthreads[PROC_MAXTHREADS];
+	struct wchan *p_joinwchan;	/* thread_join waits here */
+
+	/* asynchronous I/O completions; set on first use (see aio.h) */
+	struct aioctx *p_aio;
+
 	pid_t pid;
-	/* add more material here as needed */
+	pid_t p_ppid;			/* parent pid, -1 once orphaned */
+
+	/* exit; p_exited and p_ppid protected by the process table lock */
+	int p_exiting;			/* _exit called; p_lock */
+	int p_exited;			/* set once the last thread is gone */
+	int p_waited;			/* claimed by a waiter; p_lock */
+	int p_exitstatus;		/* encoded as for waitpid() */
+	struct semaphore *p_exitsem;	/* V'd once, on exit */
+
+	struct rcu_head p_rcu;		/* for the deferred free */
 };
 
+/*
+ * Process table lookups. These take no lock: the table is read
+ * under rcu_read_lock, and proc_destroy puts off freeing a proc
+ * until any such readers are done.
+ */
 pid_t proc_search_pid(struct proc* p);
 
+/*
+ * Find the process with pid PID, or NULL. The caller must be in an
+ * rcu_read_lock section, and stay in it for as long as it uses the
+ * result; after rcu_read_unlock the proc may be freed at any time.
+ */
+struct proc *proc_lookup(pid_t pid);
+
 /* This is the process structure for the kernel and for kernel-only threads. */
 extern struct proc *kproc;
 
@@ -89,12 +140,58 @@ struct proc *proc_create_runprogram(const char *name);
 /* Destroy a process. */
 void proc_destroy(struct proc *proc);
 
+/*
+ * Called by the exiting process once its thread has detached: record
+ * STATUS (already encoded) and wake the parent. A process nobody
+ * can wait for any more is destroyed right here.
+ */
+void proc_exited(struct proc *proc, int status);
+
+/*
+ * Claim the child of the current process with pid PID for waiting:
+ * returns ESRCH if there is no such process, ECHILD if it isn't our
+ * child or another thread has claimed it already, and otherwise 0
+ * with the child in *RET, for proc_wait. With NOHANG, a child that
+ * hasn't exited yet is left unclaimed and *RET is NULL.
+ */
+int proc_claimchild(pid_t pid, bool nohang, struct proc **ret);
+
+/*
+ * Wait for PROC to exit, destroy it, and return its exit status.
+ * Only one thread may wait for a given process: one that claimed it,
+ * or the menu, for processes it started.
+ */
+int proc_wait(struct proc *proc);
+
 /* Attach a thread to a process. Must not already have a process. */
 int proc_addthread(struct proc *proc, struct thread *t);
 
 /* Detach a thread from its process. */
 void proc_remthread(struct thread *t);
 
+/*
+ * Detach a thread from its process unless it is the last one there.
+ * Returns true if it detached; the last thread stays attached so it
+ * can tear the process down.
+ */
+bool proc_remthread_unlesslast(struct thread *t);
+
+/*
+ * User thread slots:
+ *     proc_uthread_reserve - take a free slot; hands back its tid.
+ *     proc_uthread_release - give back a slot reserved for a thread
+ *                            that was never created.
+ *     proc_uthread_bind    - attach the (current) thread T to slot TID.
+ *     proc_uthread_exit    - record thread T's exit and wake joiners.
+ *     proc_uthread_join    - wait for thread TID to exit and free its
+ *                            slot.
+ */
+int proc_uthread_reserve(struct proc *proc, int *tid);
+void proc_uthread_release(struct proc *proc, int tid);
+void proc_uthread_bind(struct proc *proc, int tid, struct thread *t);
+void proc_uthread_exit(struct proc *proc, struct thread *t, int status);
+int proc_uthread_join(struct proc *proc, int tid, int *status);
+
 /* Fetch the address space of the current process. */
 struct addrspace *proc_getas(void);
 
@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef _RCU_H_
+#define _RCU_H_
+
+/*
+ * Read-copy-update: deferred reclamation for read-mostly data.
+ *
+ * Readers bracket their accesses with rcu_read_lock and
+ * rcu_read_unlock, which only count nesting in the current thread;
+ * they take no lock and write no shared memory. A writer, still
+ * serialized against other writers by whatever lock it already uses,
+ * unlinks an object so no new reader can find it and then hands it
+ * to call_rcu, which calls FUNC(ARG) once every reader that might
+ * still be looking at it has finished.
+ *
+ * That is known by quiescent states: a thread never switches out
+ * inside a read section (the timer won't preempt it there and it may
+ * not sleep), so once every CPU has been through thread_switch or
+ * the idle loop since the object was handed over (a grace period),
+ * no reader can still hold it.
+ *
+ * Callbacks run in thread context just after a context switch, at
+ * splhigh with no locks held. They must not sleep. Read sections
+ * must be short, must not sleep, and may not be used in interrupt
+ * handlers.
+ *
+ * Writers that publish a pointer for readers to find should put
+ * membar_store_store() between initializing the object and storing
+ * the pointer.
+ */
+
+struct rcu_head {
+	struct rcu_head *rh_next;
+	void (*rh_func)(void *);
+	void *rh_arg;
+};
+
+/*
+ * Functions:
+ *    rcu_read_lock    - enter a read section. Nests.
+ *    rcu_read_unlock  - leave it.
+ *    rcu_read_held    - true if the current thread is in a read
+ *                       section. For assertions.
+ *    call_rcu         - call FUNC(ARG) after a grace period. RH is
+ *                       storage for the request, usually a field of
+ *                       the object being freed; it must stay valid
+ *                       until FUNC has been called.
+ *
+ * Hooks for the thread system:
+ *    rcu_cpu_init     - register CPU number CPUNUM.
+ *    rcu_quiescent    - the current CPU is not in a read section.
+ *                       Called from thread_switch.
+ *    rcu_idle_enter   - the current CPU is going idle; it will not
+ *    rcu_idle_exit      hold up grace periods until it comes back.
+ *    rcu_docallbacks  - run callbacks whose grace period is over.
+ */
+void rcu_read_lock(void);
+void rcu_read_unlock(void);
+bool rcu_read_held(void);
+void call_rcu(struct rcu_head *rh, void (*func)(void *), void *arg);
+
+void rcu_cpu_init(unsigned cpunum);
+void rcu_quiescent(void);
+void rcu_idle_enter(void);
+void rcu_idle_exit(void);
+void rcu_docallbacks(void);
+
+#endif /* _RCU_H_ */
@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef _SCHEDSTAT_H_
+#define _SCHEDSTAT_H_
+
+/*
+ * Scheduler latency statistics, for the "schedstat" build option.
+ *
+ * Two kinds of log2 histogram, in cycles:
+ *
+ *   - run-queue wait, per CPU: from thread_make_runnable putting a
+ *     thread on a run queue to thread_switch picking it to run, and
+ *     counted on the CPU that picks it;
+ *
+ *   - off-CPU time, per wait channel name: from a thread going to
+ *     sleep in wchan_sleep (or wchan_sleep_timeout) to its running
+ *     again, so it includes the run-queue wait after the wakeup.
+ *
+ * Bucket B counts intervals of 2^B to 2^(B+1)-1 cycles (bucket 0
+ * also takes 0, and the last bucket everything longer). Wait
+ * channels of the same name share a histogram, as in lockstat.
+ *
+ * As with lockstat, each CPU records into its own tables with
+ * interrupts off and no lock, and the report adds them up. The times
+ * are differences of cpu_cycles() readings; for a thread queued or
+ * woken on one CPU and run on another the two readings come from
+ * different CPUs, which cpu_cycles allows for.
+ *
+ * Without the option, none of this is compiled and the hooks in
+ * thread.c disappear.
+ */
+
+#include "opt-schedstat.h"
+
+#define SCHEDSTAT_NBUCKETS 32	/* up to 2^31 cycles and beyond */
+#define SCHEDSTAT_NAMELEN  24	/* longer names are cut short */
+#define SCHEDSTAT_NENTRIES 64	/* per CPU; must be a power of 2 */
+#define SCHEDSTAT_MAXCPUS  32
+
+/* Report buffer size used by the menu. */
+#define SCHEDSTAT_REPORTMAX (16*1024)
+
+#if OPT_SCHEDSTAT
+
+/*
+ * Functions:
+ *     schedstat_cpu_init - allocate the tables for CPU number CPUNUM.
+ *     schedstat_runwait  - account a run-queue wait of WAIT cycles
+ *                          on the current CPU.
+ *     schedstat_sleep    - account OFFCPU cycles off the CPU for a
+ *                          sleep on a wait channel called NAME.
+ *     schedstat_report   - format the histograms into BUF (at most
+ *                          LEN bytes including the NUL); returns the
+ *                          length of the text.
+ *     schedstat_reset    - zero every CPU's tables.
+ */
+void schedstat_cpu_init(unsigned cpunum);
+void schedstat_runwait(uint64_t wait);
+void schedstat_sleep(const char *name, uint64_t offcpu);
+size_t schedstat_report(char *buf, size_t len);
+void schedstat_reset(void);
+
+#endif /* OPT_SCHEDSTAT */
+
+
+#endif /* _SCHEDSTAT_H_ */
@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef _SLAB_H_
+#define _SLAB_H_
+
+/*
+ * Object caches ("slab" allocator).
+ *
+ * A cache hands out objects of one type, carved from slabs of one or
+ * more pages. The optional constructor is run on each object when
+ * its slab is created and the destructor when the slab is given
+ * back, not on every allocation: objects come out of
+ * kmem_cache_alloc in constructed state, and must be put back with
+ * kmem_cache_free in that same state. So things like locks and wait
+ * channels that an object always has can be set up once and reused
+ * across many allocations.
+ *
+ * Successive slabs start their objects at different offsets (cache
+ * coloring), so the same field of objects in different slabs doesn't
+ * always land on the same cache lines.
+ */
+
+struct kmem_cache;
+
+/*
+ * Functions:
+ *    kmem_cache_create  - make a cache for objects of SIZE bytes,
+ *                         aligned to ALIGN (a power of 2; 0 for the
+ *                         default). CTOR, if not NULL, returns 0 or
+ *                         an error code; DTOR may be NULL. NAME
+ *                         should be a string constant. Returns NULL
+ *                         if out of memory.
+ *    kmem_cache_destroy - destroy a cache, whose objects must all
+ *                         have been freed.
+ *    kmem_cache_alloc   - get a constructed object, or NULL if out of
+ *                         memory (or the constructor failed).
+ *    kmem_cache_free    - give back an object, in constructed state.
+ *    kmem_cache_printstats - print object and slab counts for all
+ *                         caches.
+ */
+struct kmem_cache *kmem_cache_create(const char *name, size_t size,
+				     size_t align,
+				     int (*ctor)(void *obj),
+				     void (*dtor)(void *obj));
+void kmem_cache_destroy(struct kmem_cache *kc);
+void *kmem_cache_alloc(struct kmem_cache *kc);
+void kmem_cache_free(struct kmem_cache *kc, void *obj);
+void kmem_cache_printstats(void);
+
+#endif /* _SLAB_H_ */
@@ -36,6 +36,7 @@
  */
 
 #include <cdefs.h>
+#include "opt-lockstat.h"
 
 /* Inlining support - for making sure an out-of-line copy gets built */
 #ifndef SPINLOCK_INLINE
@@ -53,30 +54,70 @@
  * This structure is made public so spinlocks do not have to be
  * malloc'd; however, code that uses spinlocks should not look inside
  * the structure directly but always use the spinlock API functions.
+ *
+ * A spinlock is either plain or queued. A plain one is a
+ * test-and-test-and-set lock: splk_lock is 0 or 1, and a CPU that
+ * sees it free but loses the race backs off exponentially before
+ * looking again. Nothing stops the same CPU from winning every time.
+ * A queued one (spinlock_init_queued) is a ticket lock: the high half
+ * of splk_lock is the next ticket to hand out and the low half the
+ * ticket now being served, so CPUs get the lock in the order they
+ * asked for it, and each waits in proportion to its place in line
+ * before looking again. Use it for hot locks that every CPU
+ * hammers; it costs an extra atomic operation on release.
  */
 struct spinlock {
 	volatile spinlock_data_t splk_lock; /* Memory word where we spin. */
 	struct cpu *splk_holder;	    /* CPU holding this lock. */
+	bool splk_queued;		    /* Ticket lock? */
+#if OPT_LOCKSTAT
+	const char *splk_name;		    /* Name for lockstat, or NULL. */
+	vaddr_t splk_site;		    /* Where the holder acquired it. */
+	uint64_t splk_stamp;		    /* cpu_cycles() at acquire. */
+#endif
 };
 
 /*
- * Initializer for cases where a spinlock needs to be static or global.
+ * Initializers for cases where a spinlock needs to be static or
+ * global. The name is only kept with the lockstat option.
  */
-#define SPINLOCK_INITIALIZER	{ SPINLOCK_DATA_INITIALIZER, NULL }
+#if OPT_LOCKSTAT
+#define SPINLOCK_INIT_NAME(name) , name, 0, 0
+#else
+#define SPINLOCK_INIT_NAME(name)
+#endif
+#define SPINLOCK_INITIALIZER \
+	{ SPINLOCK_DATA_INITIALIZER, NULL, false SPINLOCK_INIT_NAME(NULL) }
+#define SPINLOCK_NAMED_INITIALIZER(name) \
+	{ SPINLOCK_DATA_INITIALIZER, NULL, false SPINLOCK_INIT_NAME(name) }
+#define SPINLOCK_QUEUED_INITIALIZER(name) \
+	{ SPINLOCK_DATA_INITIALIZER, NULL, true SPINLOCK_INIT_NAME(name) }
+
+/* Ticket halves of splk_lock for queued spinlocks. */
+#define SPINLOCK_TICKET_SHIFT	16
+#define SPINLOCK_TICKET_MASK	0xffff
 
 /*
  * Spinlock functions.
  *
  * init		Initialize the contents of a spinlock.
+ * init_queued	Same, but make it a queued (FIFO) spinlock.
  * cleanup	Opposite of init. Lock must be unlocked.
  *
  * acquire	Get the lock, spinning as necessary. Also disables interrupts.
  * release	Release the lock. May re-enable interrupts.
  *
  * do_i_hold	Check if the current CPU holds the lock.
+ *
+ * setname	Name the lock for lockstat; the string is not copied, so
+ *		it must outlive the lock. Does nothing without lockstat.
+ *
+ * delay	Busy-wait for about CYCLES cycles, as between tries at a
+ *		contended lock. Not a lock operation.
  */
 
 void spinlock_init(struct spinlock *lk);
+void spinlock_init_queued(struct spinlock *lk);
 void spinlock_cleanup(struct spinlock *lk);
 
 void spinlock_acquire(struct spinlock *lk);
@@ -84,5 +125,9 @@ void spinlock_release(struct spinlock *lk);
 
 bool spinlock_do_i_hold(struct spinlock *lk);
 
+void spinlock_setname(struct spinlock *lk, const char *name);
+
+void spinlock_delay(uint32_t cycles);
+
 
 #endif /* _SPINLOCK_H_ */
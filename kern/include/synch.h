@@ -36,6 +36,7 @@
 
 
 #include <spinlock.h>
+#include "opt-lockstat.h"
 
 /*
  * Dijkstra-style semaphore.
@@ -71,11 +72,28 @@ void V(struct semaphore *);
  *
  * The name field is for easier debugging. A copy of the name is
  * (should be) made internally.
+ *
+ * The lock is adaptive: lk_busy is taken with a single test-and-set
+ * when the lock is free; otherwise the acquirer spins for a while as
+ * long as the holder is running on another CPU (and so is likely to
+ * let go soon), and sleeps on lk_wchan if it isn't or if the spin
+ * runs out. lk_holdcpu is the CPU the holder acquired the lock on;
+ * spinners compare its c_curthread with lk_holder rather than look
+ * at the holder's thread structure, which could go away under them.
+ * lk_spinlock protects the wchan and lk_nwaiters, which also counts
+ * CV waiters moved onto lk_wchan by cv_signal/cv_broadcast.
  */
 struct lock {
         char *lk_name;
-        // add what you need here
-        // (don't forget to mark things volatile as needed)
+	volatile spinlock_data_t lk_busy;	/* nonzero if held */
+	struct thread *volatile lk_holder;	/* NULL if not held */
+	struct cpu *volatile lk_holdcpu;	/* CPU lk_holder was on */
+	volatile unsigned lk_nwaiters;		/* threads in the sleep path */
+	struct spinlock lk_spinlock;
+	struct wchan *lk_wchan;
+#if OPT_LOCKSTAT
+	uint64_t lk_stamp;			/* cpu_cycles() at acquire */
+#endif
 };
 
 struct lock *lock_create(const char *name);
@@ -85,6 +103,8 @@ void lock_destroy(struct lock *);
  * Operations:
  *    lock_acquire - Get the lock. Only one thread can hold the lock at the
  *                   same time.
+ *    lock_acquire_timeout - Same, but give up with ETIMEDOUT if the
+ *                   lock can't be had within TICKS hardclock ticks.
  *    lock_release - Free the lock. Only the thread holding the lock may do
  *                   this.
  *    lock_do_i_hold - Return true if the current thread holds the lock;
@@ -93,6 +113,7 @@ void lock_destroy(struct lock *);
  * These operations must be atomic. You get to write them.
  */
 void lock_acquire(struct lock *);
+int lock_acquire_timeout(struct lock *, unsigned ticks);
 void lock_release(struct lock *);
 bool lock_do_i_hold(struct lock *);
 
@@ -109,12 +130,19 @@ bool lock_do_i_hold(struct lock *);
  *
  * The name field is for easier debugging. A copy of the name is
  * (should be) made internally.
+ *
+ * Signal and broadcast use wait morphing: since the caller holds the
+ * lock, a woken waiter could only block on it again, so instead of
+ * being made runnable it is moved from cv_wchan straight onto the
+ * lock's wait channel, and runs when lock_release hands it the lock.
+ * A broadcast thus wakes waiters one at a time as the lock frees up
+ * rather than all at once.
  */
 
 struct cv {
         char *cv_name;
-        // add what you need here
-        // (don't forget to mark things volatile as needed)
+	struct wchan *cv_wchan;
+	struct spinlock cv_spinlock;	/* protects cv_wchan */
 };
 
 struct cv *cv_create(const char *name);
@@ -124,6 +152,9 @@ void cv_destroy(struct cv *);
  * Operations:
  *    cv_wait      - Release the supplied lock, go to sleep, and, after
  *                   waking up again, re-acquire the lock.
+ *    cv_wait_timeout - Same, but stop waiting after TICKS hardclock
+ *                   ticks if not signalled. Returns ETIMEDOUT if so
+ *                   (with the lock held again), 0 otherwise.
  *    cv_signal    - Wake up one thread that's sleeping on this CV.
  *    cv_broadcast - Wake up all threads sleeping on this CV.
  *
@@ -134,8 +165,57 @@ void cv_destroy(struct cv *);
  * These operations must be atomic. You get to write them.
  */
 void cv_wait(struct cv *cv, struct lock *lock);
+int cv_wait_timeout(struct cv *cv, struct lock *lock, unsigned ticks);
 void cv_signal(struct cv *cv, struct lock *lock);
 void cv_broadcast(struct cv *cv, struct lock *lock);
 
 
+/*
+ * Reader-writer lock.
+ *
+ * Any number of readers, or one writer. Writers are preferred: once
+ * a writer is waiting, new readers wait too, so a steady stream of
+ * readers can't starve writers. To keep writers from starving
+ * readers in turn, a writer that releases the lock while both kinds
+ * are waiting admits a batch of up to RWLOCK_MAXBATCH of the waiting
+ * readers (rw_batch) before the next writer gets in.
+ *
+ * Neither mode is recursive: a thread that already holds the lock
+ * must not acquire it again, in either mode.
+ */
+struct rwlock {
+	char *rw_name;
+	struct spinlock rw_spinlock;	/* protects everything below */
+	struct wchan *rw_rwchan;	/* readers wait here */
+	struct wchan *rw_wwchan;	/* writers wait here */
+	unsigned rw_readers;		/* readers holding the lock */
+	struct thread *rw_writer;	/* writer holding it, or NULL */
+	unsigned rw_rwaiting;		/* readers waiting */
+	unsigned rw_wwaiting;		/* writers waiting */
+	unsigned rw_batch;		/* readers still to admit ahead of
+					   waiting writers */
+};
+
+/* Largest batch of readers let in ahead of a waiting writer */
+#define RWLOCK_MAXBATCH  16
+
+struct rwlock *rwlock_create(const char *name);
+void rwlock_destroy(struct rwlock *);
+
+/*
+ * Operations:
+ *    rwlock_acquire_read  - Get the lock in shared mode.
+ *    rwlock_release_read  - Give up shared mode.
+ *    rwlock_acquire_write - Get the lock in exclusive mode.
+ *    rwlock_release_write - Give up exclusive mode.
+ *    rwlock_do_i_hold_write - true if the current thread holds the
+ *                   lock in exclusive mode. (Readers aren't tracked.)
+ */
+void rwlock_acquire_read(struct rwlock *);
+void rwlock_release_read(struct rwlock *);
+void rwlock_acquire_write(struct rwlock *);
+void rwlock_release_write(struct rwlock *);
+bool rwlock_do_i_hold_write(struct rwlock *);
+
+
 #endif /* _SYNCH_H_ */
@@ -35,6 +35,8 @@
 #include "opt-syscalls.h"
 
 struct trapframe; /* from <machine/trapframe.h> */
+struct vnode;     /* from <vnode.h> */
+struct argbuf;    /* from <argbuf.h> */
 
 /*
  * The system call dispatcher.
@@ -53,6 +55,13 @@ void enter_forked_process(struct trapframe *tf);
 __DEAD void enter_new_process(int argc, userptr_t argv, userptr_t env,
 		       vaddr_t stackptr, vaddr_t entrypoint);
 
+/* Leave if the current process is exiting (proc_syscalls.c). */
+void uthread_exitcheck(void);
+
+/* Build the image for a new process (runprogram.c). Consumes V. */
+int loadprogram(struct vnode *v, struct argbuf *ab,
+		vaddr_t *entrypoint, vaddr_t *stackptr, userptr_t *uargv);
+
 
 /*
  * Prototypes for IN-KERNEL entry points for system call implementations.
@@ -60,11 +69,37 @@ __DEAD void enter_new_process(int argc, userptr_t argv, userptr_t env,
 
 int sys_reboot(int code);
 int sys___time(userptr_t user_seconds, userptr_t user_nanoseconds);
+int sys_nanosleep(userptr_t req, userptr_t rem);
 
 #if OPT_SYSCALLS
-int sys_write(int fd, userptr_t buf_ptr, size_t size);
-int sys_read(int fd, userptr_t buf_ptr, size_t size);
-void sys__exit(int status);
+int sys_open(userptr_t path, int flags, mode_t mode, int *retval);
+int sys_close(int fd);
+int sys_write(int fd, userptr_t buf_ptr, size_t size, int *retval);
+int sys_read(int fd, userptr_t buf_ptr, size_t size, int *retval);
+int sys_pwrite(int fd, userptr_t buf_ptr, size_t size, off_t pos, int *retval);
+int sys_pread(int fd, userptr_t buf_ptr, size_t size, off_t pos, int *retval);
+int sys_writev(int fd, userptr_t iov, int iovcnt, int *retval);
+int sys_readv(int fd, userptr_t iov, int iovcnt, int *retval);
+int sys_lseek(int fd, off_t pos, int whence, off_t *retval);
+int sys_pipe(userptr_t fds);
+int sys_fcntl(int fd, int cmd, int arg, int *retval);
+int sys_poll(userptr_t fds, unsigned nfds, int timeout, int *retval);
+int sys_sendfile(int outfd, int infd, userptr_t offset, size_t count,
+		 int *retval);
+__DEAD void sys__exit(int status);
+int sys_execv(userptr_t progname, userptr_t args);
+int sys_getpid(pid_t *retval);
+int sys_waitpid(pid_t pid, userptr_t status, int options, pid_t *retval);
+int sys_spawn(userptr_t progname, userptr_t args, userptr_t fdmap, int nfds,
+	      pid_t *retval);
+int sys_thread_create(userptr_t entry, userptr_t arg1, userptr_t arg2,
+		      userptr_t stack, int *retval);
+__DEAD void sys_thread_exit(int status);
+int sys_thread_join(int tid, userptr_t status);
+int sys_sysring_enter(userptr_t ring, unsigned to_submit, int *retval);
+int sys_aio_read(userptr_t cb);
+int sys_aio_write(userptr_t cb);
+int sys_aio_wait(userptr_t events, unsigned nevents, int flags, int *retval);
 #endif
 
 #endif /* _SYSCALL_H_ */
@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef _SYSSTAT_H_
+#define _SYSSTAT_H_
+
+/*
+ * System call statistics: per system call number, a count and a
+ * latency histogram in cycles with power-of-two buckets (bucket b
+ * counts calls that took [2^b, 2^(b+1)) cycles; the last one also
+ * takes everything longer).
+ *
+ * Each CPU has its own set, updated only by that CPU with interrupts
+ * off, so recording takes no lock. Readers add the sets up; they may
+ * see a call counted but not yet its histogram entry.
+ */
+
+#define SYSSTAT_NCALLS   136	/* covers all of kern/syscall.h */
+#define SYSSTAT_NBUCKETS 24	/* up to 2^23 cycles and beyond */
+#define SYSSTAT_MAXCPUS  32
+
+struct sysstat {
+	uint32_t ss_count[SYSSTAT_NCALLS];
+	uint64_t ss_cycles[SYSSTAT_NCALLS];	/* total, for the mean */
+	uint32_t ss_hist[SYSSTAT_NCALLS][SYSSTAT_NBUCKETS];
+};
+
+/*
+ * Functions:
+ *     sysstat_cpu_init - allocate the set for CPU number CPUNUM.
+ *     sysstat_record   - account one call of CALLNO taking CYCLES.
+ *     sysstat_report   - format the totals as text into BUF (at most
+ *                        LEN bytes including the terminating NUL);
+ *                        returns the length of the text.
+ *     sysstat_reset    - zero every CPU's set.
+ *     devsysstat_create - attach the read-only "sysstat:" device,
+ *                        which reads back the report.
+ */
+void sysstat_cpu_init(unsigned cpunum);
+void sysstat_record(unsigned callno, uint64_t cycles);
+size_t sysstat_report(char *buf, size_t len);
+void sysstat_reset(void);
+void devsysstat_create(void);
+
+/* Report buffer size used by the menu and the device; longer reports
+   are cut short. */
+#define SYSSTAT_REPORTMAX  (16*1024)
+
+
+#endif /* _SYSSTAT_H_ */
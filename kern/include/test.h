@@ -54,6 +54,7 @@ int semtest(int, char **);
 int locktest(int, char **);
 int cvtest(int, char **);
 int cvtest2(int, char **);
+int spinlockbench(int, char **);
 
 /* semaphore unit tests */
 int semu1(int, char **);
@@ -96,7 +97,7 @@ int kmalloctest4(int, char **);
 int nettest(int, char **);
 
 /* Routine for running a user-level program. */
-int runprogram(char *progname);
+int runprogram(char *progname, int argc, char **argv);
 
 /* Kernel menu system. */
 void menu(char *argstr);
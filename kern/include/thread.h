@@ -39,6 +39,7 @@
 #include <array.h>
 #include <spinlock.h>
 #include <threadlist.h>
+#include "opt-schedstat.h"
 
 struct cpu;
 
@@ -72,6 +73,7 @@ struct thread {
 	 */
 	char *t_name;			/* Name of this thread */
 	const char *t_wchan_name;	/* Name of wait channel, if sleeping */
+	struct wchan *t_wchan;		/* Wait channel, if sleeping */
 	threadstate_t t_state;		/* State this thread is in */
 
 	/*
@@ -84,6 +86,20 @@ struct thread {
 	struct cpu *t_cpu;		/* CPU thread runs on */
 	struct proc *t_proc;		/* Process thread belongs to */
 
+	/*
+	 * Scheduler state. t_level is the thread's MLFQ level (0 is
+	 * highest priority) and t_ticks the hardclocks it has used of
+	 * its current quantum. Changed only by the thread's own CPU
+	 * while it runs, or with the thread off the CPU under the run
+	 * queue or wait channel lock that owns it.
+	 */
+	unsigned t_level;
+	unsigned t_ticks;
+	unsigned t_lastrun;		/* t_cpu's c_hardclocks when it last ran */
+#if OPT_SCHEDSTAT
+	uint64_t t_readytime;		/* cpu_cycles() when put on a run queue */
+#endif
+
 	/*
 	 * Interrupt state fields.
 	 *
@@ -105,6 +121,12 @@ struct thread {
 	 * Public fields
 	 */
 
+	/* depth of shared holds on the VFS big lock (vfslist.c) */
+	unsigned t_vfsshared;
+
+	/* depth of rcu_read_lock nesting (rcu.c) */
+	unsigned t_rcu_nest;
+
 	/* add more here as needed */
 };
 
@@ -157,16 +179,23 @@ __DEAD void thread_exit(void);
  */
 void thread_yield(void);
 
+/*
+ * Free the kernel stacks kept for reuse on every cpu and return how
+ * many there were. Called by the VM system when it runs out of pages.
+ */
+unsigned thread_stackpool_reclaim(void);
+
 /*
  * Reshuffle the run queue. Called from the timer interrupt.
  */
 void schedule(void);
 
 /*
- * Potentially migrate ready threads to other CPUs. Called from the
- * timer interrupt.
+ * Charge a hardclock to the current thread, and switch away from it
+ * if its quantum is up or a higher priority thread is waiting.
+ * Called from the timer interrupt.
  */
-void thread_consider_migration(void);
+void thread_tick(void);
 
 
 #endif /* _THREAD_H_ */
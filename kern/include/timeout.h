@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef _TIMEOUT_H_
+#define _TIMEOUT_H_
+
+/*
+ * Timeouts: call a function once some number of hardclock ticks
+ * from now.
+ *
+ * Pending timeouts live on a hierarchical timer wheel, so arming and
+ * cancelling are constant time and each tick only looks at the
+ * timeouts that fall due on it (plus, once every TIMEOUT_SLOTS
+ * ticks, one slot's worth being moved down a level). The wheel is
+ * driven by hardclock on CPU 0, and the functions are called there,
+ * in interrupt context, with no locks held. They must not sleep.
+ *
+ * Ticks are counted by mainbus_ticks(), not by CPU 0's interrupts,
+ * so CPU 0 can stop its tick while idle: it sleeps until the earliest
+ * pending timeout (timeout_idle) and is woken early if an earlier
+ * one is armed meanwhile.
+ *
+ * The caller provides the storage for a struct timeout and must keep
+ * it valid until the timeout has fired or timeout_cancel has
+ * returned.
+ */
+
+#include <kern/time.h>
+
+struct timeout {
+	struct timeout *to_next;	/* on the wheel */
+	struct timeout **to_pprev;	/* NULL if not pending */
+	uint64_t to_expire;		/* tick to fire on */
+	void (*to_func)(void *);
+	void *to_arg;
+};
+
+/* Wheel geometry: 4 levels of 64 slots covers 2^24 ticks (~46 hours). */
+#define TIMEOUT_LEVELS		4
+#define TIMEOUT_SLOTBITS	6
+#define TIMEOUT_SLOTS		(1U << TIMEOUT_SLOTBITS)
+#define TIMEOUT_MAXTICKS	((1U << (TIMEOUT_LEVELS*TIMEOUT_SLOTBITS)) - 1)
+
+/*
+ * Functions:
+ *    timeout_init     - bind TO to FUNC(ARG). Not yet pending.
+ *    timeout_set      - (re)arm TO to fire TICKS ticks from now.
+ *                       TICKS is at least 1 and at most
+ *                       TIMEOUT_MAXTICKS; values outside are clamped.
+ *    timeout_cancel   - disarm TO. Returns true if it was pending,
+ *                       i.e. the function now won't be called. If
+ *                       the function is running on another CPU,
+ *                       waits for it to finish first, so afterwards
+ *                       TO may be freed either way.
+ *    timeout_pending  - true if TO is armed and hasn't fired.
+ *    timeout_now      - the current tick count.
+ *    timespec_to_ticks - convert a duration to ticks, rounding up.
+ *
+ *    timeout_tick     - called on each hardclock on CPU 0; runs
+ *                       every tick up to mainbus_ticks().
+ *    timeout_idle     - called by CPU 0, interrupts off, before it
+ *                       idles without its tick. Returns how many
+ *                       ticks it may sleep, between 1 and MAX, and
+ *                       has timeout_set send it IPI_UNIDLE if it
+ *                       arms an earlier timeout.
+ *    timeout_busy     - undo timeout_idle once CPU 0 is ticking.
+ */
+void timeout_init(struct timeout *to, void (*func)(void *), void *arg);
+void timeout_set(struct timeout *to, unsigned ticks);
+bool timeout_cancel(struct timeout *to);
+bool timeout_pending(struct timeout *to);
+uint64_t timeout_now(void);
+unsigned timespec_to_ticks(const struct timespec *ts);
+
+void timeout_tick(void);
+unsigned timeout_idle(unsigned max);
+void timeout_busy(void);
+
+#endif /* _TIMEOUT_H_ */
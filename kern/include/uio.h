@@ -78,6 +78,7 @@ struct uio {
 	enum uio_seg      uio_segflg;	/* What kind of pointer we have */
 	enum uio_rw       uio_rw;	/* Whether op is a read or write */
 	struct addrspace *uio_space;	/* Address space for user pointer */
+	bool              uio_nonblock;	/* Fail with EAGAIN, don't block */
 };
 
 
@@ -95,7 +96,9 @@ struct uio {
  *   (4) set up uio_seg and uio_rw correctly;
  *   (5) if uio_seg is UIO_SYSSPACE, set uio_space to NULL; otherwise,
  *       initialize uio_space to the address space in which the buffer
- *       should be found.
+ *       should be found;
+ *   (6) set uio_nonblock if the object should fail with EAGAIN
+ *       rather than wait (O_NONBLOCK).
  *
  * After calling,
  *   (1) the contents of uio_iov and uio_iovcnt may be altered and
@@ -138,5 +141,20 @@ int uiomovezeros(size_t len, struct uio *uio);
 void uio_kinit(struct iovec *, struct uio *,
 	       void *kbuf, size_t len, off_t pos, enum uio_rw rw);
 
+/*
+ * Initialize a uio suitable for I/O to or from a user buffer in the
+ * current process's address space.
+ */
+void uio_uinit(struct iovec *, struct uio *,
+	       userptr_t ubuf, size_t len, off_t pos, enum uio_rw rw);
+
+/*
+ * Same, for IOVCNT user buffers described by an iovec array that has
+ * already been copied into the kernel. LEN is the sum of their
+ * lengths, which the caller has checked doesn't overflow.
+ */
+void uio_uinitv(struct iovec *, unsigned iovcnt, struct uio *,
+		size_t len, off_t pos, enum uio_rw rw);
+
 
 #endif /* _UIO_H_ */
@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef _VDSO_H_
+#define _VDSO_H_
+
+/*
+ * Kernel side of the user-visible time and process pages. The layout
+ * and user addresses are in <kern/vdso.h>.
+ *
+ *    vdso_bootstrap  - allocate the shared time page. Called once
+ *                      the VM system and the clock are up.
+ *    vdso_update     - refresh the time snapshot, if that hasn't
+ *                      been done this tick. Called from hardclock()
+ *                      on every CPU, and when a CPU stops idling.
+ *    vdso_timepage   - physical address of the shared time page, or
+ *                      0 before vdso_bootstrap.
+ *    vdso_fillproc   - fill in a freshly zeroed process page at PADDR
+ *                      for process PID.
+ */
+
+#include <kern/vdso.h>
+
+void vdso_bootstrap(void);
+void vdso_update(void);
+paddr_t vdso_timepage(void);
+void vdso_fillproc(paddr_t paddr, pid_t pid);
+
+#endif /* _VDSO_H_ */
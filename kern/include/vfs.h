@@ -57,6 +57,10 @@ struct vnode;  /* abstract structure for an on-disk file (vnode.h) */
  *    vfs_sync      - force all dirty buffers to disk
  *    vfs_getroot   - get root vnode for the filesystem named DEVNAME
  *    vfs_getdevname - get mounted device name for the filesystem passed in
+ *    vfs_getdev    - if DEVNAME names a device itself (not a filesystem
+ *                    on it), get its vnode. Takes no lock; returns
+ *                    ENODEV in all other cases, for the caller to
+ *                    fall back on vfs_getroot.
  */
 
 int vfs_setcurdir(struct vnode *dir);
@@ -65,6 +69,7 @@ int vfs_getcurdir(struct vnode **retdir);
 int vfs_sync(void);
 int vfs_getroot(const char *devname, struct vnode **result);
 const char *vfs_getdevname(struct fs *fs);
+int vfs_getdev(const char *devname, struct vnode **result);
 
 /*
  * VFS layer mid-level operations.
@@ -196,9 +201,21 @@ DEFARRAY(vnode, VFSINLINE);
 /*
  * Global one-big-lock for all filesystem operations.
  * You must remove this for the filesystem assignment.
+ *
+ * Operations that only look at filesystem state (name lookups) may
+ * take it in shared mode, so they run in parallel with each other.
+ * Both modes nest. Taking it exclusively while holding it shared
+ * drops the shared hold first and takes it back on the final
+ * release, so state seen before may have changed by then; only do
+ * that where nothing but vnode references is being held onto (e.g.
+ * VOP_DECREF leading to a reclaim).
+ *
+ * vfs_biglock_do_i_hold is true in either mode.
  */
 void vfs_biglock_acquire(void);
 void vfs_biglock_release(void);
+void vfs_biglock_acquire_shared(void);
+void vfs_biglock_release_shared(void);
 bool vfs_biglock_do_i_hold(void);
 
 
@@ -33,6 +33,7 @@
 #include <spinlock.h>
 struct uio;
 struct stat;
+struct pollentry;
 
 
 /*
@@ -131,6 +132,13 @@ struct vnode {
  *                      of the file and copy to the specified
  *                      uio. Need not work on objects that are not
  *                      directories.
+ *    vop_poll        - Report in REVENTS which of the poll EVENTS
+ *                      (POLLIN, POLLOUT; see kern/poll.h) could be
+ *                      done now without blocking. If PE is not NULL,
+ *                      first register it on the object's poll queue
+ *                      (see poll.h) so the poller is woken when the
+ *                      answer may change. Objects that never block
+ *                      report everything ready.
  *
  *****************************************
  *
@@ -196,6 +204,8 @@ struct vnode_ops {
 	int (*vop_mmap)(struct vnode *file /* add stuff */);
 	int (*vop_truncate)(struct vnode *file, off_t len);
 	int (*vop_namefile)(struct vnode *file, struct uio *uio);
+	int (*vop_poll)(struct vnode *object, int events, int *revents,
+			struct pollentry *pe);
 
 
 	int (*vop_creat)(struct vnode *dir,
@@ -240,6 +250,7 @@ struct vnode_ops {
 #define VOP_MMAP(vn /*add stuff */)     (__VOP(vn, mmap)(vn /*add stuff */))
 #define VOP_TRUNCATE(vn, pos)           (__VOP(vn, truncate)(vn, pos))
 #define VOP_NAMEFILE(vn, uio)           (__VOP(vn, namefile)(vn, uio))
+#define VOP_POLL(vn, ev, rev, pe)       (__VOP(vn, poll)(vn, ev, rev, pe))
 
 #define VOP_CREAT(vn,nm,excl,mode,res)  (__VOP(vn, creat)(vn,nm,excl,mode,res))
 #define VOP_SYMLINK(vn, name, content)  (__VOP(vn, symlink)(vn, name, content))
@@ -279,6 +290,13 @@ int vnode_init(struct vnode *, const struct vnode_ops *ops,
  */
 void vnode_cleanup(struct vnode *);
 
+/*
+ * vop_poll for objects that never block: everything asked about is
+ * ready, and there is nothing to wait for.
+ */
+int vnode_poll_ready(struct vnode *vn, int events, int *revents,
+		     struct pollentry *pe);
+
 /*
  * Common stubs for vnode functions that just fail, in various ways.
  */
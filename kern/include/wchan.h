@@ -66,6 +66,15 @@ bool wchan_isempty(struct wchan *wc, struct spinlock *lk);
  */
 void wchan_sleep(struct wchan *wc, struct spinlock *lk);
 
+/*
+ * Like wchan_sleep, but give up after TICKS hardclock ticks. Returns
+ * 0 if woken (or moved to another channel) and ETIMEDOUT if the time
+ * ran out first; with TICKS 0, returns ETIMEDOUT at once without
+ * sleeping. Either way the lock is held again on return.
+ */
+int wchan_sleep_timeout(struct wchan *wc, struct spinlock *lk,
+			unsigned ticks);
+
 /*
  * Wake up one thread, or all threads, sleeping on a wait channel.
  * The associated spinlock should be locked.
@@ -76,5 +85,18 @@ void wchan_sleep(struct wchan *wc, struct spinlock *lk);
 void wchan_wakeone(struct wchan *wc, struct spinlock *lk);
 void wchan_wakeall(struct wchan *wc, struct spinlock *lk);
 
+/*
+ * Move one thread, or all threads, sleeping on FROM over to TO
+ * without waking them; they stay asleep until woken from TO. Both
+ * associated spinlocks must be locked. Returns the number moved.
+ *
+ * A moved thread still relocks FROMLK when it finally returns from
+ * wchan_sleep, since that is the lock it went to sleep with.
+ */
+unsigned wchan_moveone(struct wchan *from, struct spinlock *fromlk,
+		       struct wchan *to, struct spinlock *tolk);
+unsigned wchan_moveall(struct wchan *from, struct spinlock *fromlk,
+		       struct wchan *to, struct spinlock *tolk);
+
 
 #endif /* _WCHAN_H_ */
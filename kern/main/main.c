@@ -43,6 +43,8 @@
 #include <current.h>
 #include <synch.h>
 #include <vm.h>
+#include <vdso.h>
+#include <aio.h>
 #include <mainbus.h>
 #include <vfs.h>
 #include <device.h>
@@ -125,8 +127,10 @@ boot(void)
 
 	/* Late phase of initialization. */
 	vm_bootstrap();
+	vdso_bootstrap();
 	kprintf_bootstrap();
 	thread_start_cpus();
+	aio_bootstrap();
 
 	/* Default bootfs - but ignore failure, in case emu0 doesn't exist */
 	vfs_setbootfs("emu0");
@@ -41,6 +41,10 @@
 #include <sfs.h>
 #include <syscall.h>
 #include <test.h>
+#include <sysstat.h>
+#include <lockstat.h>
+#include <schedstat.h>
+#include <slab.h>
 #include "opt-sfs.h"
 #include "opt-net.h"
 
@@ -58,11 +62,7 @@
 
 /*
  * Function for a thread that runs an arbitrary userlevel program by
- * name.
- *
- * Note: this cannot pass arguments to the program. You may wish to
- * change it so it can, because that will make testing much easier
- * in the future.
+ * name, passing it the remaining words of the command line as argv.
  *
  * It copies the program name because runprogram destroys the copy
  * it gets by passing it to vfs_open().
@@ -77,20 +77,21 @@ cmd_progthread(void *ptr, unsigned long nargs)
 
 	KASSERT(nargs >= 1);
 
-	if (nargs > 2) {
-		kprintf("Warning: argument passing from menu not supported\n");
-	}
-
 	/* Hope we fit. */
 	KASSERT(strlen(args[0]) < sizeof(progname));
 
 	strcpy(progname, args[0]);
 
-	result = runprogram(progname);
+	result = runprogram(progname, nargs, args);
 	if (result) {
 		kprintf("Running program %s failed: %s\n", args[0],
 			strerror(result));
+#if OPT_SYSCALLS
+		/* let common_prog collect us */
+		sys__exit(1);
+#else
 		return;
+#endif
 	}
 
 	/* NOTREACHED: runprogram only returns on error. */
@@ -99,14 +100,10 @@ cmd_progthread(void *ptr, unsigned long nargs)
 /*
  * Common code for cmd_prog and cmd_shell.
  *
- * Note that this does not wait for the subprogram to finish, but
- * returns immediately to the menu. This is usually not what you want,
- * so you should have it call your system-calls-assignment waitpid
- * code after forking.
- *
- * Also note that because the subprogram's thread uses the "args"
- * array and strings, until you do this a race condition exists
- * between that code and the menu input code.
+ * With system calls configured in, this waits for the subprogram to
+ * finish (which also keeps the "args" array alive for as long as the
+ * subprogram's thread uses it). Without them nothing ever reports the
+ * exit, so this returns immediately to the menu.
  */
 static
 int
@@ -131,10 +128,10 @@ common_prog(int nargs, char **args)
 		return result;
 	}
 
-	/*
-	 * The new process will be destroyed when the program exits...
-	 * once you write the code for handling that.
-	 */
+#if OPT_SYSCALLS
+	/* proc_wait destroys the process once it has exited. */
+	proc_wait(proc);
+#endif
 
 	return 0;
 }
@@ -369,6 +366,7 @@ cmd_kheapstats(int nargs, char **args)
 	(void)args;
 
 	kheap_printstats();
+	kmem_cache_printstats();
 
 	return 0;
 }
@@ -402,6 +400,101 @@ cmd_kheapdump(int nargs, char **args)
 	return 0;
 }
 
+/*
+ * Command for printing (or clearing) the system call statistics.
+ */
+static
+int
+cmd_sysstat(int nargs, char **args)
+{
+	char *buf;
+
+	if (nargs == 2 && !strcmp(args[1], "reset")) {
+		sysstat_reset();
+		return 0;
+	}
+	if (nargs != 1) {
+		kprintf("Usage: sysstat [reset]\n");
+		return EINVAL;
+	}
+
+	buf = kmalloc(SYSSTAT_REPORTMAX);
+	if (buf == NULL) {
+		return ENOMEM;
+	}
+	sysstat_report(buf, SYSSTAT_REPORTMAX);
+	kprintf("%s", buf);
+	kfree(buf);
+
+	return 0;
+}
+
+#if OPT_LOCKSTAT
+/*
+ * Command for printing (or clearing) the lock statistics.
+ */
+static
+int
+cmd_lockstat(int nargs, char **args)
+{
+	char *buf;
+	unsigned top = LOCKSTAT_TOP;
+
+	if (nargs == 2 && !strcmp(args[1], "reset")) {
+		lockstat_reset();
+		return 0;
+	}
+	if (nargs == 2 && !strcmp(args[1], "all")) {
+		top = (unsigned)-1;
+	}
+	else if (nargs != 1) {
+		kprintf("Usage: lockstat [all|reset]\n");
+		return EINVAL;
+	}
+
+	buf = kmalloc(LOCKSTAT_REPORTMAX);
+	if (buf == NULL) {
+		return ENOMEM;
+	}
+	lockstat_report(buf, LOCKSTAT_REPORTMAX, top);
+	kprintf("%s", buf);
+	kfree(buf);
+
+	return 0;
+}
+#endif
+
+#if OPT_SCHEDSTAT
+/*
+ * Command for printing (or clearing) the scheduler latency histograms.
+ */
+static
+int
+cmd_schedstat(int nargs, char **args)
+{
+	char *buf;
+
+	if (nargs == 2 && !strcmp(args[1], "reset")) {
+		schedstat_reset();
+		return 0;
+	}
+	if (nargs != 1) {
+		kprintf("Usage: schedstat [reset]\n");
+		return EINVAL;
+	}
+
+	buf = kmalloc(SCHEDSTAT_REPORTMAX);
+	if (buf == NULL) {
+		return ENOMEM;
+	}
+	schedstat_report(buf, SCHEDSTAT_REPORTMAX);
+	kprintf("%s", buf);
+	kfree(buf);
+
+	return 0;
+}
+#endif
+
 ////////////////////////////////////////
 //
 // Menus.
@@ -442,6 +535,13 @@ static const char *opsmenu[] = {
 	"[pwd]     Print current directory   ",
 	"[sync]    Sync filesystems          ",
 	"[panic]   Intentional panic         ",
+	"[sysstat] System call statistics    ",
+#if OPT_LOCKSTAT
+	"[lockstat] Lock statistics          ",
+#endif
+#if OPT_SCHEDSTAT
+	"[schedstat] Scheduler latency       ",
+#endif
 	"[q]       Quit and shut down        ",
 	NULL
 };
@@ -473,6 +573,7 @@ static const char *testmenu[] = {
 	"[net] Network test                  ",
 #endif
 	"[sy1] Semaphore test                ",
+	"[sp1] Spinlock benchmark            ",
 	"[sy2] Lock test             (1)     ",
 	"[sy3] CV test               (1)     ",
 	"[sy4] CV test #2            (1)     ",
@@ -556,6 +657,13 @@ static struct {
 	{ "kh",         cmd_kheapstats },
 	{ "khgen",      cmd_kheapgeneration },
 	{ "khdump",     cmd_kheapdump },
+	{ "sysstat",	cmd_sysstat },
+#if OPT_LOCKSTAT
+	{ "lockstat",	cmd_lockstat },
+#endif
+#if OPT_SCHEDSTAT
+	{ "schedstat",	cmd_schedstat },
+#endif
 
 	/* base system tests */
 	{ "at",		arraytest },
@@ -573,6 +681,7 @@ static struct {
 	{ "tt2",	threadtest2 },
 	{ "tt3",	threadtest3 },
 	{ "sy1",	semtest },
+	{ "sp1",	spinlockbench },
 
 	/* synchronization assignment tests */
 	{ "sy2",	locktest },
@@ -48,6 +48,13 @@
 #include <current.h>
 #include <addrspace.h>
 #include <vnode.h>
+#include <synch.h>
+#include <wchan.h>
+#include <openfile.h>
+#include <aio.h>
+#include <kern/errno.h>
+#include <slab.h>
+#include <rcu.h>
 
 /*
  * The process for the kernel; this holds all the kernel-only threads.
@@ -59,7 +66,7 @@ struct proc *kproc;
 #define MAX_PROC 100
 static struct _processTable {
   int active;           /* initial value 0 */
-  struct proc *proc[MAX_PROC+1]; /* [0] not used. pids are >= 1 */
+  struct proc *volatile proc[MAX_PROC+1]; /* [0] not used. pids are >= 1 */
   int proc_count;          /* index of last allocated pid */
   struct spinlock lk;	/* Lock for this table */
 } processTable;
@@ -78,7 +85,7 @@ static pid_t proc_get_pid(struct proc* p){
 		}
 	}
    spinlock_release(&processTable.lk);
-   return 1;
+   return -2;
 }
 
 static int proc_remove_pid(struct proc* p){
@@ -98,24 +105,73 @@ static int proc_remove_pid(struct proc* p){
 
 }
 
+/*
+ * Readers of the table don't take processTable.lk; see proc.h. The
+ * slots are only changed under the lock, one pointer store at a time.
+ */
 pid_t proc_search_pid(struct proc* p){
    if(p==NULL) return -2;
    if(!processTable.active) return -1;
    int i;
-   spinlock_acquire(&processTable.lk);
+   rcu_read_lock();
    for(i=1;i<MAX_PROC+1;i++){
 	if(processTable.proc[i] == p){	
-		spinlock_release(&processTable.lk);
+		rcu_read_unlock();
 		return (pid_t) i;	
 		}
 	}
-   spinlock_release(&processTable.lk);
+   rcu_read_unlock();
    return 0;
 
 }
 
+struct proc *proc_lookup(pid_t pid){
+   KASSERT(rcu_read_held());
+   if(pid<0 || pid>MAX_PROC) return NULL;
+   if(!processTable.active) return NULL;
+   return processTable.proc[pid];
+}
+
 
 
+/*
+ * Proc structures come from a cache. The exit semaphore, join wchan
+ * and p_lock are made once per structure, by proc_ctor, and kept
+ * across uses; proc_destroy must return them as it found them.
+ */
+static struct kmem_cache *proc_cache;
+
+static
+int
+proc_ctor(void *obj)
+{
+	struct proc *proc = obj;
+
+	proc->p_exitsem = sem_create("proc_exit", 0);
+	if (proc->p_exitsem == NULL) {
+		return ENOMEM;
+	}
+	proc->p_joinwchan = wchan_create("proc_join");
+	if (proc->p_joinwchan == NULL) {
+		sem_destroy(proc->p_exitsem);
+		return ENOMEM;
+	}
+	spinlock_init(&proc->p_lock);
+	spinlock_setname(&proc->p_lock, "p_lock");
+	return 0;
+}
+
+static
+void
+proc_dtor(void *obj)
+{
+	struct proc *proc = obj;
+
+	spinlock_cleanup(&proc->p_lock);
+	wchan_destroy(proc->p_joinwchan);
+	sem_destroy(proc->p_exitsem);
+}
+
 /*
  * Create a proc structure.
  */
@@ -124,35 +180,70 @@ struct proc *
 proc_create(const char *name)
 {
 	struct proc *proc;
+	int i;
 
-	proc = kmalloc(sizeof(*proc));
+	proc = kmem_cache_alloc(proc_cache);
 	if (proc == NULL) {
 		return NULL;
 	}
 	proc->p_name = kstrdup(name);
 	if (proc->p_name == NULL) {
-		kfree(proc);
+		kmem_cache_free(proc_cache, proc);
 		return NULL;
 	}
 
+	/* p_exitsem, p_joinwchan, p_lock: proc_ctor */
 	proc->p_numthreads = 0;
-	spinlock_init(&proc->p_lock);
 
 	/* VM fields */
 	proc->p_addrspace = NULL;
 
 	/* VFS fields */
 	proc->p_cwd = NULL;
+	for (i=0; i<OPEN_MAX; i++) {
+		proc->p_filetable[i] = NULL;
+	}
+
+	/* threads; slot 0 is the initial thread's */
+	for (i=0; i<PROC_MAXTHREADS; i++) {
+		proc->p_uthreads[i].ut_thread = NULL;
+		proc->p_uthreads[i].ut_state = UT_FREE;
+		proc->p_uthreads[i].ut_status = 0;
+	}
+	proc->p_uthreads[0].ut_state = UT_RUNNING;
+
+	proc->p_aio = NULL;
+
+	/* exit fields */
+	proc->p_ppid = -1;
+	proc->p_exiting = 0;
+	proc->p_exited = 0;
+	proc->p_waited = 0;
+	proc->p_exitstatus = 0;
 
 	proc->pid = proc_get_pid(proc);
 	if(proc->pid<0) {
-		kfree(proc);
+		kfree(proc->p_name);
+		kmem_cache_free(proc_cache, proc);
 		return NULL;
 	}
 
 	return proc;
 }
 
+/*
+ * Free a proc structure once no table reader can see it.
+ */
+static
+void
+proc_free(void *obj)
+{
+	struct proc *proc = obj;
+
+	kfree(proc->p_name);
+	kmem_cache_free(proc_cache, proc);
+}
+
 /*
  * Destroy a proc structure.
  *
@@ -176,10 +267,14 @@ proc_destroy(struct proc *proc)
 	/*
 	 * We don't take p_lock in here because we must have the only
 	 * reference to this structure. (Otherwise it would be
-	 * incorrect to destroy it.)
+	 * incorrect to destroy it.) A proc_claimchild in a read
+	 * section may still take p_lock to find the proc claimed;
+	 * the structure stays valid for that until proc_free.
 	 */
 
 	/* VFS fields */
+	aio_proc_cleanup(proc);
+	filetable_closeall(proc);
 	if (proc->p_cwd) {
 		VOP_DECREF(proc->p_cwd);
 		proc->p_cwd = NULL;
@@ -235,10 +330,133 @@ proc_destroy(struct proc *proc)
 
 	KASSERT(proc->p_numthreads == 0);
 	KASSERT(proc_remove_pid(proc));
-	spinlock_cleanup(&proc->p_lock);
 
-	kfree(proc->p_name);
-	kfree(proc);
+	/*
+	 * p_exitsem goes back to the cache at 0: every V on it has
+	 * been matched by a P (see proc_exited).
+	 */
+
+	/* Lockless readers of the table may still be looking at it. */
+	call_rcu(&proc->p_rcu, proc_free, proc);
+}
+
+/*
+ * Exit side of proc_wait.
+ *
+ * Children of the exiting process become orphans: nobody will wait
+ * for them, so those that have already exited are reaped here and
+ * the rest will destroy themselves when they exit. The same goes for
+ * PROC itself if its parent is already gone.
+ *
+ * The process table lock orders this against a parent exiting at the
+ * same time. A child that finds its parent gone destroys itself and
+ * never V's p_exitsem. One that finds it still there will V, maybe
+ * not until after the parent has seen p_exited; so the parent, like
+ * proc_wait, always P's an exited child before destroying it. Either
+ * way exactly one side does the cleanup, and only after the child is
+ * done with its proc.
+ */
+void
+proc_exited(struct proc *proc, int status)
+{
+	struct proc *child;
+	int i, orphan;
+
+	KASSERT(proc != NULL);
+	KASSERT(proc != kproc);
+	KASSERT(proc->p_numthreads == 0);
+
+ again:
+	spinlock_acquire(&processTable.lk);
+	for (i=1; i<MAX_PROC+1; i++) {
+		child = processTable.proc[i];
+		if (child == NULL || child->p_ppid != proc->pid) {
+			continue;
+		}
+		child->p_ppid = -1;
+		if (child->p_exited) {
+			/*
+			 * Can't sleep or destroy under a spinlock;
+			 * rescan afterwards.
+			 */
+			spinlock_release(&processTable.lk);
+			P(child->p_exitsem);
+			proc_destroy(child);
+			goto again;
+		}
+	}
+
+	proc->p_exitstatus = status;
+	proc->p_exited = 1;
+	orphan = proc->p_ppid < 0;
+	spinlock_release(&processTable.lk);
+
+	if (orphan) {
+		proc_destroy(proc);
+	}
+	else {
+		V(proc->p_exitsem);
+	}
+}
+
+int
+proc_claimchild(pid_t pid, bool nohang, struct proc **ret)
+{
+	struct proc *p;
+	int result;
+
+	if (pid < 1 || pid > MAX_PROC) {
+		return ESRCH;
+	}
+
+	/*
+	 * No table lock: the read section keeps P from being freed
+	 * while we look at it. Only we can destroy our own children
+	 * (after claiming them), and their p_ppid can't change while
+	 * we're running, so checking it unlocked is fine; p_lock
+	 * settles which of our threads gets to claim.
+	 */
+	result = 0;
+	*ret = NULL;
+	rcu_read_lock();
+	p = proc_lookup(pid);
+	if (p == NULL) {
+		result = ESRCH;
+	}
+	else if (p->p_ppid != curproc->pid) {
+		result = ECHILD;
+	}
+	else {
+		spinlock_acquire(&p->p_lock);
+		if (p->p_waited) {
+			result = ECHILD;
+		}
+		else if (!nohang || p->p_exited) {
+			p->p_waited = 1;
+			*ret = p;
+		}
+		spinlock_release(&p->p_lock);
+	}
+	rcu_read_unlock();
+	return result;
+}
+
+/*
+ * Wait side: only the parent (or the menu, for processes it started)
+ * may call this, and only once per process; see proc_claimchild.
+ */
+int
+proc_wait(struct proc *proc)
+{
+	int status;
+
+	KASSERT(proc != NULL);
+	KASSERT(proc != curproc);
+
+	P(proc->p_exitsem);
+	status = proc->p_exitstatus;
+	proc_destroy(proc);
+	return status;
 }
 
 /*
@@ -248,6 +466,7 @@ void
 proc_bootstrap(void)
 {
 	spinlock_init(&processTable.lk);
+	spinlock_setname(&processTable.lk, "processTable.lk");
 	/* kernel process is not registered in the table */
 	processTable.active = 1;
 	processTable.proc_count=0;
@@ -257,6 +476,11 @@ proc_bootstrap(void)
         	processTable.proc[i]=NULL;
 	}
    	spinlock_release(&processTable.lk);
+	proc_cache = kmem_cache_create("proc", sizeof(struct proc), 0,
+				       proc_ctor, proc_dtor);
+	if (proc_cache == NULL) {
+		panic("proc_bootstrap: Out of memory\n");
+	}
 	kproc = proc_create("[kernel]");
 	if (kproc == NULL) {
 		panic("proc_create for kproc failed\n");
@@ -298,6 +522,9 @@ proc_create_runprogram(const char *name)
 	}
 	spinlock_release(&curproc->p_lock);
 
+	/* Whoever creates it is responsible for waiting for it. */
+	newproc->p_ppid = curproc->pid;
+
 	return newproc;
 }
 
@@ -356,6 +583,127 @@ proc_remthread(struct thread *t)
 	splx(spl);
 }
 
+/*
+ * Like proc_remthread, but the check for other threads and the
+ * detach are one step, so of several threads leaving at once exactly
+ * one finds itself last.
+ */
+bool
+proc_remthread_unlesslast(struct thread *t)
+{
+	struct proc *proc;
+	int spl;
+
+	proc = t->t_proc;
+	KASSERT(proc != NULL);
+
+	spinlock_acquire(&proc->p_lock);
+	KASSERT(proc->p_numthreads > 0);
+	if (proc->p_numthreads == 1) {
+		spinlock_release(&proc->p_lock);
+		return false;
+	}
+	proc->p_numthreads--;
+	spinlock_release(&proc->p_lock);
+
+	spl = splhigh();
+	t->t_proc = NULL;
+	splx(spl);
+	return true;
+}
+
+/*
+ * User thread slots.
+ */
+int
+proc_uthread_reserve(struct proc *proc, int *tid)
+{
+	int i;
+
+	spinlock_acquire(&proc->p_lock);
+	for (i=0; i<PROC_MAXTHREADS; i++) {
+		if (proc->p_uthreads[i].ut_state == UT_FREE) {
+			proc->p_uthreads[i].ut_state = UT_RUNNING;
+			proc->p_uthreads[i].ut_thread = NULL;
+			spinlock_release(&proc->p_lock);
+			*tid = i;
+			return 0;
+		}
+	}
+	spinlock_release(&proc->p_lock);
+	return EAGAIN;
+}
+
+void
+proc_uthread_release(struct proc *proc, int tid)
+{
+	KASSERT(tid >= 0 && tid < PROC_MAXTHREADS);
+
+	spinlock_acquire(&proc->p_lock);
+	KASSERT(proc->p_uthreads[tid].ut_state == UT_RUNNING);
+	proc->p_uthreads[tid].ut_state = UT_FREE;
+	spinlock_release(&proc->p_lock);
+}
+
+void
+proc_uthread_bind(struct proc *proc, int tid, struct thread *t)
+{
+	KASSERT(tid >= 0 && tid < PROC_MAXTHREADS);
+
+	spinlock_acquire(&proc->p_lock);
+	KASSERT(proc->p_uthreads[tid].ut_state == UT_RUNNING);
+	proc->p_uthreads[tid].ut_thread = t;
+	spinlock_release(&proc->p_lock);
+}
+
+void
+proc_uthread_exit(struct proc *proc, struct thread *t, int status)
+{
+	int i;
+
+	spinlock_acquire(&proc->p_lock);
+	for (i=0; i<PROC_MAXTHREADS; i++) {
+		if (proc->p_uthreads[i].ut_thread == t) {
+			proc->p_uthreads[i].ut_thread = NULL;
+			proc->p_uthreads[i].ut_state = UT_EXITED;
+			proc->p_uthreads[i].ut_status = status;
+			wchan_wakeall(proc->p_joinwchan, &proc->p_lock);
+			break;
+		}
+	}
+	spinlock_release(&proc->p_lock);
+}
+
+int
+proc_uthread_join(struct proc *proc, int tid, int *status)
+{
+	struct uthread *ut;
+
+	if (tid < 0 || tid >= PROC_MAXTHREADS) {
+		return ESRCH;
+	}
+	ut = &proc->p_uthreads[tid];
+
+	spinlock_acquire(&proc->p_lock);
+	if (ut->ut_thread == curthread) {
+		spinlock_release(&proc->p_lock);
+		/* joining ourselves would never return */
+		return EINVAL;
+	}
+	while (ut->ut_state == UT_RUNNING) {
+		wchan_sleep(proc->p_joinwchan, &proc->p_lock);
+	}
+	if (ut->ut_state == UT_FREE) {
+		/* never existed, or somebody else joined it first */
+		spinlock_release(&proc->p_lock);
+		return ESRCH;
+	}
+	*status = ut->ut_status;
+	ut->ut_state = UT_FREE;
+	spinlock_release(&proc->p_lock);
+	return 0;
+}
+
 /*
  * Fetch the address space of (the current) process.
  *
@@ -0,0 +1,458 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * Asynchronous file I/O: aio_read, aio_write, aio_wait.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <kern/aio.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <thread.h>
+#include <proc.h>
+#include <current.h>
+#include <copyinout.h>
+#include <uio.h>
+#include <vnode.h>
+#include <openfile.h>
+#include <aio.h>
+#include <syscall.h>
+
+/*
+ * Per-process completion context. ac_pending counts requests that
+ * are queued or being worked on; finished ones wait on the done list
+ * until aio_wait collects them.
+ */
+struct aioctx {
+	struct spinlock ac_lock;	/* protects everything below */
+	struct wchan *ac_wchan;		/* aio_wait and cleanup sleep here */
+	unsigned ac_pending;		/* requests not finished yet */
+	unsigned ac_ndone;		/* requests on the done list */
+	struct aioreq *ac_donehead;
+	struct aioreq *ac_donetail;
+};
+
+/*
+ * One request. ar_kbuf holds the data on the kernel side: copied in
+ * from the process at submit time for a write, filled by the worker
+ * for a read and copied out when the event is collected.
+ */
+struct aioreq {
+	struct aioreq *ar_next;		/* on the work queue or done list */
+	struct aioctx *ar_ctx;		/* where to post the completion */
+	struct openfile *ar_file;	/* released once the I/O is done */
+	enum uio_rw ar_rw;
+	void *ar_kbuf;
+	userptr_t ar_ubuf;
+	size_t ar_len;
+	off_t ar_offset;
+	__u32 ar_data;
+	int ar_error;
+	size_t ar_result;
+};
+
+/* The work queue shared by all processes. */
+static struct spinlock aio_qlock = SPINLOCK_INITIALIZER;
+static struct wchan *aio_qwchan;
+static struct aioreq *aio_qhead, *aio_qtail;
+
+/*
+ * Free a request.
+ */
+static
+void
+aioreq_destroy(struct aioreq *req)
+{
+	KASSERT(req->ar_file == NULL);
+	if (req->ar_kbuf != NULL) {
+		kfree(req->ar_kbuf);
+	}
+	kfree(req);
+}
+
+/*
+ * Do the transfer for REQ and post the completion.
+ */
+static
+void
+aio_perform(struct aioreq *req)
+{
+	struct aioctx *ctx = req->ar_ctx;
+	struct openfile *of = req->ar_file;
+	struct iovec iov;
+	struct uio u;
+
+	uio_kinit(&iov, &u, req->ar_kbuf, req->ar_len, req->ar_offset,
+		  req->ar_rw);
+	u.uio_nonblock = (of->of_flags & O_NONBLOCK) != 0;
+	if (req->ar_rw == UIO_READ) {
+		req->ar_error = VOP_READ(of->of_vnode, &u);
+	}
+	else {
+		req->ar_error = VOP_WRITE(of->of_vnode, &u);
+	}
+	req->ar_result = req->ar_len - u.uio_resid;
+
+	openfile_decref(of);
+	req->ar_file = NULL;
+	if (req->ar_rw == UIO_WRITE) {
+		/* nothing to hand back */
+		kfree(req->ar_kbuf);
+		req->ar_kbuf = NULL;
+	}
+
+	req->ar_next = NULL;
+	spinlock_acquire(&ctx->ac_lock);
+	if (ctx->ac_donetail == NULL) {
+		ctx->ac_donehead = req;
+	}
+	else {
+		ctx->ac_donetail->ar_next = req;
+	}
+	ctx->ac_donetail = req;
+	ctx->ac_ndone++;
+	KASSERT(ctx->ac_pending > 0);
+	ctx->ac_pending--;
+	wchan_wakeall(ctx->ac_wchan, &ctx->ac_lock);
+	spinlock_release(&ctx->ac_lock);
+}
+
+/*
+ * Worker thread: take requests off the queue forever.
+ */
+static
+void
+aio_worker(void *unused1, unsigned long unused2)
+{
+	struct aioreq *req;
+
+	(void)unused1;
+	(void)unused2;
+
+	while (1) {
+		spinlock_acquire(&aio_qlock);
+		while (aio_qhead == NULL) {
+			wchan_sleep(aio_qwchan, &aio_qlock);
+		}
+		req = aio_qhead;
+		aio_qhead = req->ar_next;
+		if (aio_qhead == NULL) {
+			aio_qtail = NULL;
+		}
+		spinlock_release(&aio_qlock);
+
+		aio_perform(req);
+	}
+}
+
+void
+aio_bootstrap(void)
+{
+	unsigned i;
+	int result;
+
+	aio_qwchan = wchan_create("aio");
+	if (aio_qwchan == NULL) {
+		panic("aio_bootstrap: out of memory\n");
+	}
+	for (i=0; i<AIO_NWORKERS; i++) {
+		result = thread_fork("aio worker", NULL, aio_worker, NULL, i);
+		if (result) {
+			panic("aio_bootstrap: thread_fork: %s\n",
+			      strerror(result));
+		}
+	}
+}
+
+/*
+ * Get the current process's completion context, creating it on
+ * first use. Once set, p_aio stays put until the process exits.
+ */
+static
+int
+aio_getctx(struct aioctx **ret)
+{
+	struct proc *p = curproc;
+	struct aioctx *ctx;
+
+	if (p->p_aio != NULL) {
+		*ret = p->p_aio;
+		return 0;
+	}
+
+	ctx = kmalloc(sizeof(*ctx));
+	if (ctx == NULL) {
+		return ENOMEM;
+	}
+	ctx->ac_wchan = wchan_create("aio_wait");
+	if (ctx->ac_wchan == NULL) {
+		kfree(ctx);
+		return ENOMEM;
+	}
+	spinlock_init(&ctx->ac_lock);
+	ctx->ac_pending = 0;
+	ctx->ac_ndone = 0;
+	ctx->ac_donehead = ctx->ac_donetail = NULL;
+
+	spinlock_acquire(&p->p_lock);
+	if (p->p_aio == NULL) {
+		p->p_aio = ctx;
+		ctx = NULL;
+	}
+	*ret = p->p_aio;
+	spinlock_release(&p->p_lock);
+
+	if (ctx != NULL) {
+		/* another thread got there first */
+		spinlock_cleanup(&ctx->ac_lock);
+		wchan_destroy(ctx->ac_wchan);
+		kfree(ctx);
+	}
+	return 0;
+}
+
+void
+aio_proc_cleanup(struct proc *proc)
+{
+	struct aioctx *ctx = proc->p_aio;
+	struct aioreq *req;
+
+	if (ctx == NULL) {
+		return;
+	}
+
+	spinlock_acquire(&ctx->ac_lock);
+	while (ctx->ac_pending > 0) {
+		wchan_sleep(ctx->ac_wchan, &ctx->ac_lock);
+	}
+	spinlock_release(&ctx->ac_lock);
+
+	while (ctx->ac_donehead != NULL) {
+		req = ctx->ac_donehead;
+		ctx->ac_donehead = req->ar_next;
+		aioreq_destroy(req);
+	}
+
+	proc->p_aio = NULL;
+	spinlock_cleanup(&ctx->ac_lock);
+	wchan_destroy(ctx->ac_wchan);
+	kfree(ctx);
+}
+
+/*
+ * Common code for aio_read and aio_write: check the request and put
+ * it on the work queue.
+ */
+static
+int
+aio_submit(userptr_t ucb, enum uio_rw rw)
+{
+	struct aiocb cb;
+	struct aioctx *ctx;
+	struct aioreq *req;
+	struct openfile *of;
+	int accmode, result;
+
+	result = copyin(ucb, &cb, sizeof(cb));
+	if (result) {
+		return result;
+	}
+	if (cb.aio_nbytes > AIO_MAXBYTES || cb.aio_offset < 0) {
+		return EINVAL;
+	}
+
+	result = filetable_get(cb.aio_fildes, &of);
+	if (result) {
+		return result;
+	}
+	accmode = of->of_flags & O_ACCMODE;
+	if ((rw == UIO_READ && accmode == O_WRONLY) ||
+	    (rw == UIO_WRITE && accmode == O_RDONLY)) {
+		result = EBADF;
+		goto fail_file;
+	}
+
+	result = aio_getctx(&ctx);
+	if (result) {
+		goto fail_file;
+	}
+	spinlock_acquire(&ctx->ac_lock);
+	if (ctx->ac_pending + ctx->ac_ndone >= AIO_MAXREQS) {
+		spinlock_release(&ctx->ac_lock);
+		result = EAGAIN;
+		goto fail_file;
+	}
+	ctx->ac_pending++;
+	spinlock_release(&ctx->ac_lock);
+
+	req = kmalloc(sizeof(*req));
+	if (req == NULL) {
+		result = ENOMEM;
+		goto fail_slot;
+	}
+	/* never kmalloc(0) */
+	req->ar_kbuf = kmalloc(cb.aio_nbytes > 0 ? cb.aio_nbytes : 1);
+	if (req->ar_kbuf == NULL) {
+		result = ENOMEM;
+		goto fail_req;
+	}
+	if (rw == UIO_WRITE) {
+		result = copyin(cb.aio_buf, req->ar_kbuf, cb.aio_nbytes);
+		if (result) {
+			goto fail_buf;
+		}
+	}
+
+	req->ar_next = NULL;
+	req->ar_ctx = ctx;
+	req->ar_file = of;
+	req->ar_rw = rw;
+	req->ar_ubuf = cb.aio_buf;
+	req->ar_len = cb.aio_nbytes;
+	req->ar_offset = cb.aio_offset;
+	req->ar_data = cb.aio_data;
+	req->ar_error = 0;
+	req->ar_result = 0;
+
+	spinlock_acquire(&aio_qlock);
+	if (aio_qtail == NULL) {
+		aio_qhead = req;
+	}
+	else {
+		aio_qtail->ar_next = req;
+	}
+	aio_qtail = req;
+	wchan_wakeone(aio_qwchan, &aio_qlock);
+	spinlock_release(&aio_qlock);
+	return 0;
+
+ fail_buf:
+	kfree(req->ar_kbuf);
+ fail_req:
+	kfree(req);
+ fail_slot:
+	spinlock_acquire(&ctx->ac_lock);
+	ctx->ac_pending--;
+	spinlock_release(&ctx->ac_lock);
+ fail_file:
+	openfile_decref(of);
+	return result;
+}
+
+int
+sys_aio_read(userptr_t ucb)
+{
+	return aio_submit(ucb, UIO_READ);
+}
+
+int
+sys_aio_write(userptr_t ucb)
+{
+	return aio_submit(ucb, UIO_WRITE);
+}
+
+/*
+ * aio_wait: collect up to NEVENTS finished requests into EVENTS,
+ * sleeping until there is at least one unless AIO_NOWAIT is given.
+ * Returns the number collected, which is 0 if nothing is in flight.
+ * Data for reads is copied out to the requests' buffers here; events
+ * are consumed even if copying them out fails.
+ */
+int
+sys_aio_wait(userptr_t uevents, unsigned nevents, int flags, int *retval)
+{
+	struct aio_event events[AIO_MAXREQS];
+	struct aioctx *ctx = curproc->p_aio;
+	struct aioreq *list, *req;
+	unsigned n;
+	int result;
+
+	if (flags & ~AIO_NOWAIT) {
+		return EINVAL;
+	}
+	if (nevents > AIO_MAXREQS) {
+		nevents = AIO_MAXREQS;
+	}
+	if (ctx == NULL || nevents == 0) {
+		*retval = 0;
+		return 0;
+	}
+
+	spinlock_acquire(&ctx->ac_lock);
+	while (ctx->ac_ndone == 0 && ctx->ac_pending > 0 &&
+	       (flags & AIO_NOWAIT) == 0) {
+		wchan_sleep(ctx->ac_wchan, &ctx->ac_lock);
+	}
+	/* detach the first N events */
+	list = ctx->ac_donehead;
+	req = NULL;
+	for (n=0; n<nevents && ctx->ac_donehead != NULL; n++) {
+		req = ctx->ac_donehead;
+		ctx->ac_donehead = req->ar_next;
+	}
+	if (req != NULL) {
+		req->ar_next = NULL;
+	}
+	if (ctx->ac_donehead == NULL) {
+		ctx->ac_donetail = NULL;
+	}
+	ctx->ac_ndone -= n;
+	spinlock_release(&ctx->ac_lock);
+
+	for (n=0; list != NULL; n++) {
+		req = list;
+		list = req->ar_next;
+
+		if (req->ar_rw == UIO_READ && req->ar_result > 0) {
+			result = copyout(req->ar_kbuf, req->ar_ubuf,
+					 req->ar_result);
+			if (result && req->ar_error == 0) {
+				req->ar_error = result;
+			}
+		}
+		events[n].ae_data = req->ar_data;
+		events[n].ae_error = req->ar_error;
+		events[n].ae_result = req->ar_error ? -1 : (__i32)req->ar_result;
+		aioreq_destroy(req);
+	}
+
+	if (n > 0) {
+		result = copyout(events, uevents, n * sizeof(events[0]));
+		if (result) {
+			return result;
+		}
+	}
+	*retval = n;
+	return 0;
+}
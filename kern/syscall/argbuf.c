@@ -0,0 +1,196 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * Argument marshalling for runprogram and execv.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <limits.h>
+#include <lib.h>
+#include <copyinout.h>
+#include <vm.h>
+#include <argbuf.h>
+
+/*
+ * Maximum number of argv pointers fetched with one copyin.
+ */
+#define ARGBUF_PTRCHUNK  64
+
+int
+argbuf_init(struct argbuf *ab)
+{
+	ab->ab_buf = kmalloc(ARG_MAX);
+	if (ab->ab_buf == NULL) {
+		return ENOMEM;
+	}
+	ab->ab_len = 0;
+	ab->ab_argc = 0;
+	return 0;
+}
+
+void
+argbuf_cleanup(struct argbuf *ab)
+{
+	kfree(ab->ab_buf);
+	ab->ab_buf = NULL;
+}
+
+/*
+ * Space left for string bytes if one more string is added: every
+ * string needs an argv slot, and argv needs its NULL terminator.
+ */
+static
+size_t
+argbuf_space(struct argbuf *ab)
+{
+	size_t used;
+
+	used = ab->ab_len + (ab->ab_argc + 2) * sizeof(userptr_t);
+	if (used >= ARG_MAX) {
+		return 0;
+	}
+	return ARG_MAX - used;
+}
+
+int
+argbuf_fromkernel(struct argbuf *ab, int argc, char **argv)
+{
+	size_t len;
+	int i;
+
+	for (i=0; i<argc; i++) {
+		len = strlen(argv[i]) + 1;
+		if (len > argbuf_space(ab)) {
+			return E2BIG;
+		}
+		memcpy(ab->ab_buf + ab->ab_len, argv[i], len);
+		ab->ab_len += len;
+		ab->ab_argc++;
+	}
+	return 0;
+}
+
+/*
+ * Copy in the argv array and its strings in one pass.
+ *
+ * The pointer array is fetched in chunks rather than one pointer at
+ * a time, but a chunk never crosses a page boundary: the array may
+ * end right at the end of valid memory, and we must not fault on
+ * bytes past the NULL that the caller never promised were there.
+ */
+int
+argbuf_copyin(struct argbuf *ab, userptr_t uargv)
+{
+	userptr_t chunk[ARGBUF_PTRCHUNK];
+	vaddr_t uaddr;
+	size_t space, got;
+	unsigned i, n;
+	int result;
+
+	uaddr = (vaddr_t)uargv;
+	if (uaddr % sizeof(userptr_t) != 0) {
+		return EFAULT;
+	}
+
+	while (1) {
+		n = (PAGE_SIZE - (uaddr & ~PAGE_FRAME)) / sizeof(userptr_t);
+		if (n > ARGBUF_PTRCHUNK) {
+			n = ARGBUF_PTRCHUNK;
+		}
+		result = copyin((const_userptr_t)uaddr, chunk,
+				n * sizeof(userptr_t));
+		if (result) {
+			return result;
+		}
+
+		for (i=0; i<n; i++) {
+			if (chunk[i] == NULL) {
+				return 0;
+			}
+			space = argbuf_space(ab);
+			if (space == 0) {
+				return E2BIG;
+			}
+			result = copyinstr(chunk[i], ab->ab_buf + ab->ab_len,
+					   space, &got);
+			if (result == ENAMETOOLONG) {
+				return E2BIG;
+			}
+			if (result) {
+				return result;
+			}
+			ab->ab_len += got;
+			ab->ab_argc++;
+		}
+		uaddr += n * sizeof(userptr_t);
+	}
+}
+
+/*
+ * Build the final argv image in place - the pointer array first,
+ * then the strings it points to - and copy it out in one go.
+ *
+ * The block is placed so that the new stack pointer stays 8-byte
+ * aligned as the MIPS calling convention requires.
+ */
+int
+argbuf_copyout(struct argbuf *ab, vaddr_t *stackptr, userptr_t *uargv)
+{
+	userptr_t *ptrs;
+	size_t ptrlen, off;
+	vaddr_t base;
+	int i, result;
+
+	ptrlen = (ab->ab_argc + 1) * sizeof(userptr_t);
+	KASSERT(ptrlen + ab->ab_len <= ARG_MAX);
+
+	base = *stackptr - ROUNDUP(ptrlen + ab->ab_len, 8);
+
+	memmove(ab->ab_buf + ptrlen, ab->ab_buf, ab->ab_len);
+	ptrs = (userptr_t *)ab->ab_buf;
+	off = ptrlen;
+	for (i=0; i<ab->ab_argc; i++) {
+		ptrs[i] = (userptr_t)(base + off);
+		off += strlen(ab->ab_buf + off) + 1;
+	}
+	ptrs[ab->ab_argc] = NULL;
+	KASSERT(off == ptrlen + ab->ab_len);
+
+	result = copyout(ab->ab_buf, (userptr_t)base, off);
+	if (result) {
+		return result;
+	}
+
+	*stackptr = base;
+	*uargv = (userptr_t)base;
+	return 0;
+}
@@ -1,53 +1,606 @@
 /*
  * AUthor: G.Cabodi
- * Very simple implementation of sys_read and sys_write.
- * just works (partially) on stdin/stdout
+ * File system calls on the per-process file table:
+ * open/close/read/write/readv/writev/pread/pwrite/lseek/pipe/
+ * fcntl/poll/sendfile.
  */
 
 #include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <kern/seek.h>
+#include <kern/stat.h>
 #include <kern/unistd.h>
+#include <limits.h>
 #include <clock.h>
 #include <copyinout.h>
 #include <syscall.h>
 #include <lib.h>
+#include <proc.h>
+#include <current.h>
+#include <synch.h>
+#include <uio.h>
+#include <vfs.h>
+#include <vnode.h>
+#include <openfile.h>
+#include <pipe.h>
+#include <poll.h>
 
 /*
- * simple file system calls for write/read
+ * file system calls
  */
 int
-sys_write(int fd, userptr_t buf_ptr, size_t size)
+sys_open(userptr_t upath, int flags, mode_t mode, int *retval)
 {
-  int i;
-  char *p = (char *)buf_ptr;
+  struct openfile *of;
+  char *path;
+  int fd, result;
 
-  if (fd!=STDOUT_FILENO && fd!=STDERR_FILENO) {
-    kprintf("sys_write supported only to stdout\n");
-    return -1;
+  if ((flags & O_ACCMODE) == O_ACCMODE) {
+    return EINVAL;
   }
 
-  for (i=0; i<(int)size; i++) {
-    putch(p[i]);
+  path = kmalloc(PATH_MAX);
+  if (path == NULL) {
+    return ENOMEM;
+  }
+  result = copyinstr(upath, path, PATH_MAX, NULL);
+  if (result) {
+    kfree(path);
+    return result;
+  }
+
+  result = openfile_open(path, flags, mode, &of);
+  kfree(path);
+  if (result) {
+    return result;
+  }
+
+  result = filetable_place(of, &fd);
+  if (result) {
+    openfile_decref(of);
+    return result;
+  }
+  *retval = fd;
+  return 0;
+}
+
+int
+sys_close(int fd)
+{
+  struct openfile *of;
+
+  of = filetable_clear(fd);
+  if (of == NULL) {
+    return EBADF;
+  }
+  openfile_decref(of);
+  return 0;
+}
+
+/*
+ * Common code for all the reads and writes: transfer LEN bytes
+ * to/from the IOVCNT user buffers in IOV.
+ *
+ * With POS NULL the transfer starts at the seek position; the open
+ * file's lock makes the transfer and the offset update one step with
+ * respect to other users of the same open file. Otherwise it starts
+ * at *POS, the seek position is neither used nor changed, and no lock
+ * is needed, so positional I/O on a shared file runs concurrently.
+ */
+static
+int
+file_rw(int fd, struct iovec *iov, unsigned iovcnt, size_t len,
+        const off_t *pos, enum uio_rw rw, int *retval)
+{
+  struct openfile *of;
+  struct uio u;
+  int accmode, result;
+
+  result = filetable_get(fd, &of);
+  if (result) {
+    return result;
+  }
+  accmode = of->of_flags & O_ACCMODE;
+  if ((rw == UIO_READ && accmode == O_WRONLY) ||
+      (rw == UIO_WRITE && accmode == O_RDONLY)) {
+    openfile_decref(of);
+    return EBADF;
+  }
+
+  if (pos != NULL) {
+    if (!VOP_ISSEEKABLE(of->of_vnode)) {
+      openfile_decref(of);
+      return ESPIPE;
+    }
+    if (*pos < 0) {
+      openfile_decref(of);
+      return EINVAL;
+    }
+  }
+
+  if (pos == NULL) {
+    lock_acquire(of->of_lock);
+  }
+  uio_uinitv(iov, iovcnt, &u, len, pos != NULL ? *pos : of->of_offset, rw);
+  u.uio_nonblock = (of->of_flags & O_NONBLOCK) != 0;
+  if (rw == UIO_READ) {
+    result = VOP_READ(of->of_vnode, &u);
+  }
+  else {
+    result = VOP_WRITE(of->of_vnode, &u);
+  }
+  if (pos == NULL) {
+    if (result == 0) {
+      of->of_offset = u.uio_offset;
+    }
+    lock_release(of->of_lock);
+  }
+  openfile_decref(of);
+
+  if (result) {
+    return result;
+  }
+  *retval = len - u.uio_resid;
+  return 0;
+}
+
+int
+sys_write(int fd, userptr_t buf_ptr, size_t size, int *retval)
+{
+  struct iovec iov;
+
+  iov.iov_ubase = buf_ptr;
+  iov.iov_len = size;
+  return file_rw(fd, &iov, 1, size, NULL, UIO_WRITE, retval);
+}
+
+int
+sys_read(int fd, userptr_t buf_ptr, size_t size, int *retval)
+{
+  struct iovec iov;
+
+  iov.iov_ubase = buf_ptr;
+  iov.iov_len = size;
+  return file_rw(fd, &iov, 1, size, NULL, UIO_READ, retval);
+}
+
+int
+sys_pwrite(int fd, userptr_t buf_ptr, size_t size, off_t pos, int *retval)
+{
+  struct iovec iov;
+
+  iov.iov_ubase = buf_ptr;
+  iov.iov_len = size;
+  return file_rw(fd, &iov, 1, size, &pos, UIO_WRITE, retval);
+}
+
+int
+sys_pread(int fd, userptr_t buf_ptr, size_t size, off_t pos, int *retval)
+{
+  struct iovec iov;
+
+  iov.iov_ubase = buf_ptr;
+  iov.iov_len = size;
+  return file_rw(fd, &iov, 1, size, &pos, UIO_READ, retval);
+}
+
+/*
+ * readv and writev: copy in the iovec array and check it, then do
+ * the whole scatter/gather transfer as one uio. The total has to fit
+ * in the return value.
+ */
+#define RWV_MAXLEN 0x7fffffff
+
+static
+int
+file_rwv(int fd, userptr_t uiov, int iovcnt, enum uio_rw rw, int *retval)
+{
+  struct iovec *iov;
+  size_t len;
+  int i, result;
+
+  if (iovcnt <= 0 || iovcnt > IOV_MAX) {
+    return EINVAL;
+  }
+  iov = kmalloc(iovcnt * sizeof(*iov));
+  if (iov == NULL) {
+    return ENOMEM;
+  }
+  result = copyin(uiov, iov, iovcnt * sizeof(*iov));
+  if (result) {
+    kfree(iov);
+    return result;
+  }
+
+  len = 0;
+  for (i = 0; i < iovcnt; i++) {
+    if (iov[i].iov_len > RWV_MAXLEN - len) {
+      kfree(iov);
+      return EINVAL;
+    }
+    len += iov[i].iov_len;
+  }
+
+  result = file_rw(fd, iov, iovcnt, len, NULL, rw, retval);
+  kfree(iov);
+  return result;
+}
+
+int
+sys_writev(int fd, userptr_t iov, int iovcnt, int *retval)
+{
+  return file_rwv(fd, iov, iovcnt, UIO_WRITE, retval);
+}
+
+int
+sys_readv(int fd, userptr_t iov, int iovcnt, int *retval)
+{
+  return file_rwv(fd, iov, iovcnt, UIO_READ, retval);
+}
+
+int
+sys_lseek(int fd, off_t pos, int whence, off_t *retval)
+{
+  struct openfile *of;
+  struct stat st;
+  off_t newpos;
+  int result;
+
+  result = filetable_get(fd, &of);
+  if (result) {
+    return result;
+  }
+  if (!VOP_ISSEEKABLE(of->of_vnode)) {
+    openfile_decref(of);
+    return ESPIPE;
   }
 
-  return (int)size;
+  lock_acquire(of->of_lock);
+  switch (whence) {
+  case SEEK_SET:
+    newpos = pos;
+    break;
+  case SEEK_CUR:
+    newpos = of->of_offset + pos;
+    break;
+  case SEEK_END:
+    result = VOP_STAT(of->of_vnode, &st);
+    newpos = st.st_size + pos;
+    break;
+  default:
+    result = EINVAL;
+    break;
+  }
+  if (result == 0 && newpos < 0) {
+    result = EINVAL;
+  }
+  if (result == 0) {
+    of->of_offset = newpos;
+    *retval = newpos;
+  }
+  lock_release(of->of_lock);
+  openfile_decref(of);
+  return result;
 }
 
+/*
+ * pipe: fds[0] gets the read end, fds[1] the write end.
+ */
 int
-sys_read(int fd, userptr_t buf_ptr, size_t size)
+sys_pipe(userptr_t fds_ptr)
 {
-  int i;
-  char *p = (char *)buf_ptr;
+  struct vnode *rv, *wv;
+  struct openfile *rof, *wof;
+  int fds[2];
+  int result;
+
+  result = pipe_create(&rv, &wv);
+  if (result) {
+    return result;
+  }
+  result = openfile_create(rv, O_RDONLY, &rof);
+  if (result) {
+    VOP_DECREF(rv);
+    VOP_DECREF(wv);
+    return result;
+  }
+  result = openfile_create(wv, O_WRONLY, &wof);
+  if (result) {
+    openfile_decref(rof);
+    VOP_DECREF(wv);
+    return result;
+  }
 
-  if (fd!=STDIN_FILENO) {
-    kprintf("sys_read supported only to stdin\n");
-    return -1;
+  result = filetable_place(rof, &fds[0]);
+  if (result) {
+    openfile_decref(rof);
+    openfile_decref(wof);
+    return result;
   }
+  result = filetable_place(wof, &fds[1]);
+  if (result) {
+    openfile_decref(filetable_clear(fds[0]));
+    openfile_decref(wof);
+    return result;
+  }
+
+  result = copyout(fds, fds_ptr, sizeof(fds));
+  if (result) {
+    openfile_decref(filetable_clear(fds[1]));
+    openfile_decref(filetable_clear(fds[0]));
+    return result;
+  }
+  return 0;
+}
+
+/*
+ * fcntl: only F_GETFL and F_SETFL. O_NONBLOCK and O_APPEND are the
+ * flags that can be changed.
+ */
+#define FCNTL_SETTABLE (O_NONBLOCK | O_APPEND)
+
+int
+sys_fcntl(int fd, int cmd, int arg, int *retval)
+{
+  struct openfile *of;
+  int result = 0;
 
-  for (i=0; i<(int)size; i++) {
-    p[i] = getch();
-    if (p[i] < 0) 
-      return i;
+  result = filetable_get(fd, &of);
+  if (result) {
+    return result;
+  }
+
+  spinlock_acquire(&of->of_reflock);
+  switch (cmd) {
+  case F_GETFL:
+    *retval = of->of_flags;
+    break;
+  case F_SETFL:
+    of->of_flags = (of->of_flags & ~FCNTL_SETTABLE) | (arg & FCNTL_SETTABLE);
+    *retval = 0;
+    break;
+  default:
+    result = EINVAL;
+    break;
+  }
+  spinlock_release(&of->of_reflock);
+  openfile_decref(of);
+  return result;
+}
+
+/*
+ * Ask every file in KFDS what is ready; register PES (if not NULL)
+ * on their poll queues first. Hands back the number of ready fds.
+ */
+static
+int
+poll_scan(struct pollfd *kfds, struct openfile **ofs, struct pollentry *pes,
+          unsigned nfds)
+{
+  unsigned i;
+  int rev, ready = 0;
+
+  for (i = 0; i < nfds; i++) {
+    if (ofs[i] == NULL) {
+      /* negative fd or not open; revents already set */
+      if (kfds[i].revents != 0) {
+        ready++;
+      }
+      continue;
+    }
+    if (VOP_POLL(ofs[i]->of_vnode, kfds[i].events, &rev,
+                 pes != NULL ? &pes[i] : NULL)) {
+      rev = POLLERR;
+    }
+    kfds[i].revents = rev;
+    if (rev != 0) {
+      ready++;
+    }
+  }
+  return ready;
+}
+
+/*
+ * poll: wait until one of the fds is ready or TIMEOUT milliseconds
+ * pass (forever if negative). Timeouts are rounded up to clock ticks.
+ */
+int
+sys_poll(userptr_t fds_ptr, unsigned nfds, int timeout, int *retval)
+{
+  struct pollfd *kfds;
+  struct openfile **ofs;
+  struct pollentry *pes;
+  struct pollwaiter pw;
+  unsigned i;
+  bool timedout;
+  int ready, result;
+
+  if (nfds > OPEN_MAX) {
+    return EINVAL;
+  }
+
+  kfds = kmalloc((nfds + 1) * sizeof(*kfds));
+  ofs = kmalloc((nfds + 1) * sizeof(*ofs));
+  pes = kmalloc((nfds + 1) * sizeof(*pes));
+  if (kfds == NULL || ofs == NULL || pes == NULL) {
+    result = ENOMEM;
+    goto out_free;
+  }
+  result = copyin(fds_ptr, kfds, nfds * sizeof(*kfds));
+  if (result) {
+    goto out_free;
+  }
+  result = pollwaiter_init(&pw);
+  if (result) {
+    goto out_free;
+  }
+
+  for (i = 0; i < nfds; i++) {
+    kfds[i].revents = 0;
+    ofs[i] = NULL;
+    pollentry_init(&pes[i], &pw);
+    if (kfds[i].fd >= 0 && filetable_get(kfds[i].fd, &ofs[i])) {
+      ofs[i] = NULL;
+      kfds[i].revents = POLLNVAL;
+    }
+  }
+
+  /*
+   * Register on the first pass, so that anything that happens after
+   * an object has been asked wakes us up (pw_fired), and sleep only
+   * if nothing was ready.
+   */
+  ready = poll_scan(kfds, ofs, timeout != 0 ? pes : NULL, nfds);
+  if (ready == 0 && timeout > 0) {
+    pollwaiter_settimeout(&pw, (timeout + 1000/HZ - 1) / (1000/HZ));
+  }
+  while (ready == 0 && timeout != 0) {
+    timedout = pollwaiter_wait(&pw);
+    ready = poll_scan(kfds, ofs, NULL, nfds);
+    if (timedout) {
+      break;
+    }
+  }
+
+  for (i = 0; i < nfds; i++) {
+    pollentry_remove(&pes[i]);
+    if (ofs[i] != NULL) {
+      openfile_decref(ofs[i]);
+    }
+  }
+  pollwaiter_cleanup(&pw);
+
+  result = copyout(kfds, fds_ptr, nfds * sizeof(*kfds));
+  if (result == 0) {
+    *retval = ready;
+  }
+
+ out_free:
+  kfree(pes);
+  kfree(ofs);
+  kfree(kfds);
+  return result;
+}
+
+/*
+ * sendfile: copy up to COUNT bytes from INFD to OUTFD without going
+ * through user space. The data moves a chunk at a time through a
+ * kernel buffer; each half takes only its own file's lock, as
+ * separate read and write calls would, so two opposite copies can't
+ * deadlock. If UOFFSET is not NULL, reading starts at *UOFFSET, which
+ * is updated, and INFD's seek position is left alone; otherwise INFD
+ * is read (and advanced) from its seek position. OUTFD is always
+ * written at its seek position. Returns the number of bytes written;
+ * an error after some data has moved just ends the copy early.
+ */
+#define SENDFILE_CHUNK (16*1024)
+
+int
+sys_sendfile(int outfd, int infd, userptr_t uoffset, size_t count, int *retval)
+{
+  struct openfile *in, *out;
+  struct iovec iov;
+  struct uio u;
+  char *buf;
+  off_t pos;
+  size_t total, len, got, put;
+  int result;
+
+  result = filetable_get(infd, &in);
+  if (result) {
+    return result;
+  }
+  result = filetable_get(outfd, &out);
+  if (result) {
+    openfile_decref(in);
+    return result;
+  }
+  if ((in->of_flags & O_ACCMODE) == O_WRONLY ||
+      (out->of_flags & O_ACCMODE) == O_RDONLY) {
+    result = EBADF;
+    goto out_files;
+  }
+  if (in == out) {
+    result = EINVAL;
+    goto out_files;
+  }
+
+  pos = 0;
+  if (uoffset != NULL) {
+    result = copyin(uoffset, &pos, sizeof(pos));
+    if (result) {
+      goto out_files;
+    }
+    if (pos < 0) {
+      result = EINVAL;
+      goto out_files;
+    }
+  }
+
+  buf = kmalloc(SENDFILE_CHUNK);
+  if (buf == NULL) {
+    result = ENOMEM;
+    goto out_files;
+  }
+
+  total = 0;
+  while (total < count) {
+    len = count - total;
+    if (len > SENDFILE_CHUNK) {
+      len = SENDFILE_CHUNK;
+    }
+
+    lock_acquire(in->of_lock);
+    if (uoffset == NULL) {
+      pos = in->of_offset;
+    }
+    uio_kinit(&iov, &u, buf, len, pos, UIO_READ);
+    u.uio_nonblock = (in->of_flags & O_NONBLOCK) != 0;
+    result = VOP_READ(in->of_vnode, &u);
+    got = len - u.uio_resid;
+    if (result == 0 && uoffset == NULL) {
+      in->of_offset = u.uio_offset;
+    }
+    lock_release(in->of_lock);
+    if (result || got == 0) {
+      break;
+    }
+
+    lock_acquire(out->of_lock);
+    uio_kinit(&iov, &u, buf, got, out->of_offset, UIO_WRITE);
+    u.uio_nonblock = (out->of_flags & O_NONBLOCK) != 0;
+    result = VOP_WRITE(out->of_vnode, &u);
+    put = got - u.uio_resid;
+    out->of_offset += put;
+    lock_release(out->of_lock);
+
+    total += put;
+    pos += put;
+    if (put < got) {
+      /* give back what was read but not written, where we can */
+      if (uoffset == NULL && VOP_ISSEEKABLE(in->of_vnode)) {
+        lock_acquire(in->of_lock);
+        in->of_offset -= got - put;
+        lock_release(in->of_lock);
+      }
+      break;
+    }
+  }
+  kfree(buf);
+
+  if (total > 0) {
+    result = 0;
+  }
+  if (result == 0 && uoffset != NULL) {
+    result = copyout(&pos, uoffset, sizeof(pos));
+  }
+  if (result == 0) {
+    *retval = total;
   }
 
-  return (int)size;
+ out_files:
+  openfile_decref(out);
+  openfile_decref(in);
+  return result;
 }
@@ -0,0 +1,263 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * Open files and per-process file tables.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <limits.h>
+#include <lib.h>
+#include <proc.h>
+#include <current.h>
+#include <synch.h>
+#include <vfs.h>
+#include <openfile.h>
+
+/*
+ * open files
+ */
+int
+openfile_create(struct vnode *v, int flags, struct openfile **ret)
+{
+	struct openfile *of;
+
+	of = kmalloc(sizeof(*of));
+	if (of == NULL) {
+		return ENOMEM;
+	}
+	of->of_lock = lock_create("openfile");
+	if (of->of_lock == NULL) {
+		kfree(of);
+		return ENOMEM;
+	}
+
+	of->of_vnode = v;
+	of->of_flags = flags;
+	of->of_offset = 0;
+	spinlock_init(&of->of_reflock);
+	of->of_refcount = 1;
+
+	*ret = of;
+	return 0;
+}
+
+int
+openfile_open(char *path, int flags, mode_t mode, struct openfile **ret)
+{
+	struct vnode *v;
+	int result;
+
+	result = vfs_open(path, flags, mode, &v);
+	if (result) {
+		return result;
+	}
+
+	result = openfile_create(v, flags, ret);
+	if (result) {
+		vfs_close(v);
+		return result;
+	}
+	return 0;
+}
+
+void
+openfile_incref(struct openfile *of)
+{
+	spinlock_acquire(&of->of_reflock);
+	of->of_refcount++;
+	spinlock_release(&of->of_reflock);
+}
+
+void
+openfile_decref(struct openfile *of)
+{
+	unsigned refs;
+
+	spinlock_acquire(&of->of_reflock);
+	KASSERT(of->of_refcount > 0);
+	refs = --of->of_refcount;
+	spinlock_release(&of->of_reflock);
+
+	if (refs == 0) {
+		vfs_close(of->of_vnode);
+		lock_destroy(of->of_lock);
+		spinlock_cleanup(&of->of_reflock);
+		kfree(of);
+	}
+}
+
+/*
+ * file tables
+ */
+int
+filetable_get(int fd, struct openfile **ret)
+{
+	struct proc *p = curproc;
+	struct openfile *of;
+
+	if (fd < 0 || fd >= OPEN_MAX) {
+		return EBADF;
+	}
+	spinlock_acquire(&p->p_lock);
+	of = p->p_filetable[fd];
+	if (of != NULL) {
+		openfile_incref(of);
+	}
+	spinlock_release(&p->p_lock);
+
+	if (of == NULL) {
+		return EBADF;
+	}
+	*ret = of;
+	return 0;
+}
+
+int
+filetable_place(struct openfile *of, int *fd)
+{
+	struct proc *p = curproc;
+	int i;
+
+	spinlock_acquire(&p->p_lock);
+	for (i=0; i<OPEN_MAX; i++) {
+		if (p->p_filetable[i] == NULL) {
+			p->p_filetable[i] = of;
+			spinlock_release(&p->p_lock);
+			*fd = i;
+			return 0;
+		}
+	}
+	spinlock_release(&p->p_lock);
+	return EMFILE;
+}
+
+void
+filetable_setfd(struct proc *p, int fd, struct openfile *of)
+{
+	struct openfile *old;
+
+	KASSERT(fd >= 0 && fd < OPEN_MAX);
+
+	spinlock_acquire(&p->p_lock);
+	old = p->p_filetable[fd];
+	p->p_filetable[fd] = of;
+	spinlock_release(&p->p_lock);
+
+	if (old != NULL) {
+		openfile_decref(old);
+	}
+}
+
+struct openfile *
+filetable_clear(int fd)
+{
+	struct proc *p = curproc;
+	struct openfile *of;
+
+	if (fd < 0 || fd >= OPEN_MAX) {
+		return NULL;
+	}
+	spinlock_acquire(&p->p_lock);
+	of = p->p_filetable[fd];
+	p->p_filetable[fd] = NULL;
+	spinlock_release(&p->p_lock);
+	return of;
+}
+
+/*
+ * stdin/stdout/stderr for processes started from the kernel menu.
+ * Each gets its own open file, as if opened separately.
+ */
+int
+filetable_console(void)
+{
+	static const int flags[3] = { O_RDONLY, O_WRONLY, O_WRONLY };
+	struct openfile *of;
+	char path[5];
+	int fd, result;
+
+	for (fd=0; fd<3; fd++) {
+		strcpy(path, "con:");
+		result = openfile_open(path, flags[fd], 0, &of);
+		if (result) {
+			return result;
+		}
+		filetable_setfd(curproc, fd, of);
+	}
+	return 0;
+}
+
+int
+filetable_inherit(struct proc *dst, const int *fdmap, int nfds)
+{
+	struct openfile *of;
+	int fd, result;
+
+	if (fdmap == NULL) {
+		nfds = OPEN_MAX;
+	}
+	KASSERT(nfds >= 0 && nfds <= OPEN_MAX);
+
+	for (fd=0; fd<nfds; fd++) {
+		if (fdmap == NULL) {
+			result = filetable_get(fd, &of);
+			if (result) {
+				/* not open: leave the slot empty */
+				continue;
+			}
+		}
+		else {
+			if (fdmap[fd] < 0) {
+				continue;
+			}
+			result = filetable_get(fdmap[fd], &of);
+			if (result) {
+				return result;
+			}
+		}
+		filetable_setfd(dst, fd, of);
+	}
+	return 0;
+}
+
+void
+filetable_closeall(struct proc *p)
+{
+	int fd;
+
+	for (fd=0; fd<OPEN_MAX; fd++) {
+		if (p->p_filetable[fd] != NULL) {
+			filetable_setfd(p, fd, NULL);
+		}
+	}
+}
@@ -1,32 +1,482 @@
 /*
  * AUthor: G.Cabodi
- * Very simple implementation of sys__exit.
- * It just avoids crash/panic. Full process exit still TODO
- * Address space is released
+ * Process system calls: _exit, waitpid, getpid, execv, spawn,
+ * and user threads: thread_create, thread_exit, thread_join.
  */
 
 #include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
 #include <kern/unistd.h>
+#include <kern/wait.h>
+#include <limits.h>
 #include <clock.h>
 #include <copyinout.h>
 #include <syscall.h>
 #include <lib.h>
 #include <proc.h>
+#include <current.h>
+#include <synch.h>
 #include <thread.h>
 #include <addrspace.h>
+#include <vfs.h>
+#include <argbuf.h>
+#include <openfile.h>
+#include <aio.h>
 
 /*
  * simple proc management system calls
  */
+
+/*
+ * Common exit path for user threads. Every thread but the last one
+ * just leaves; the last one out releases the process's resources and
+ * reports the exit status: the one recorded by _exit if some thread
+ * called it, else STATUS.
+ */
+static
+__DEAD
 void
-sys__exit(int status)
+uthread_exit(int status)
 {
-  /* get address space of current process and destroy */
-  struct addrspace *as = proc_getas();
-  as_destroy(as);
-  /* thread exits. proc data structure will be lost */
+  struct proc *p = curproc;
+  struct addrspace *as;
+
+  proc_uthread_exit(p, curthread, status);
+  if (proc_remthread_unlesslast(curthread)) {
+    thread_exit();
+  }
+
+  spinlock_acquire(&p->p_lock);
+  if (!p->p_exiting) {
+    p->p_exiting = 1;
+    p->p_exitstatus = _MKWAIT_EXIT(status);
+  }
+  status = p->p_exitstatus;
+  spinlock_release(&p->p_lock);
+
+  /*
+   * Release what the parent has no use for while we are still
+   * attached: as_destroy needs our pid.
+   */
+  aio_proc_cleanup(p);
+  filetable_closeall(p);
+  as = proc_setas(NULL);
+  as_deactivate();
+  if (as != NULL) {
+    as_destroy(as);
+  }
+
+  /* hand the proc structure over to whoever waits for it */
+  proc_remthread(curthread);
+  proc_exited(p, status);
+
   thread_exit();
+}
+
+/*
+ * _exit ends the whole process: the other threads notice p_exiting
+ * on their way back to user mode (uthread_exitcheck) and leave too.
+ * A thread blocked in the kernel indefinitely holds up the exit.
+ */
+void
+sys__exit(int status)
+{
+  struct proc *p = curproc;
+
+  spinlock_acquire(&p->p_lock);
+  if (!p->p_exiting) {
+    p->p_exiting = 1;
+    p->p_exitstatus = _MKWAIT_EXIT(status);
+  }
+  spinlock_release(&p->p_lock);
+
+  uthread_exit(status);
+}
+
+/*
+ * Called on every return to user mode. p_exiting only ever goes from
+ * 0 to 1, so it can be peeked at without the lock.
+ */
+void
+uthread_exitcheck(void)
+{
+  struct proc *p = curproc;
+
+  if (p != NULL && p->p_exiting) {
+    uthread_exit(0);
+  }
+}
+
+int
+sys_getpid(pid_t *retval)
+{
+  *retval = curproc->pid;
+  return 0;
+}
+
+int
+sys_waitpid(pid_t pid, userptr_t status, int options, pid_t *retval)
+{
+  struct proc *p;
+  int exitstatus;
+  int result;
+
+  if (options & ~WNOHANG) {
+    return EINVAL;
+  }
+  /* two threads of ours may wait for the same child; one gets it */
+  result = proc_claimchild(pid, (options & WNOHANG) != 0, &p);
+  if (result) {
+    return result;
+  }
+  if (p == NULL) {
+    *retval = 0;
+    return 0;
+  }
+
+  exitstatus = proc_wait(p);
+  *retval = pid;
+  if (status != NULL) {
+    return copyout(&exitstatus, status, sizeof(exitstatus));
+  }
+  return 0;
+}
+
+/*
+ * execv: replace the current program image.
+ *
+ * The program name and the whole argv go into kernel memory first
+ * (argv as one packed block, see argbuf.c), since the user memory
+ * they live in is about to disappear. The old address space is kept
+ * until the new executable has been opened and its headers loaded,
+ * so those errors can still be returned to the caller.
+ */
+int
+sys_execv(userptr_t progname, userptr_t args)
+{
+  struct argbuf ab;
+  struct addrspace *as, *oldas;
+  struct vnode *v;
+  vaddr_t entrypoint, stackptr;
+  userptr_t uargv;
+  char *kprogname;
+  int argc, result;
+
+  /* the other threads would be left running in a dead image */
+  if (curproc->p_numthreads > 1) {
+    return EBUSY;
+  }
+
+  kprogname = kmalloc(PATH_MAX);
+  if (kprogname == NULL) {
+    return ENOMEM;
+  }
+  result = copyinstr(progname, kprogname, PATH_MAX, NULL);
+  if (result) {
+    kfree(kprogname);
+    return result;
+  }
+
+  result = argbuf_init(&ab);
+  if (result) {
+    kfree(kprogname);
+    return result;
+  }
+  result = argbuf_copyin(&ab, args);
+  if (result) {
+    argbuf_cleanup(&ab);
+    kfree(kprogname);
+    return result;
+  }
+
+  /* vfs_open may destroy the name; we are done with it anyway */
+  result = vfs_open(kprogname, O_RDONLY, 0, &v);
+  kfree(kprogname);
+  if (result) {
+    argbuf_cleanup(&ab);
+    return result;
+  }
+
+  as = as_create();
+  if (as == NULL) {
+    vfs_close(v);
+    argbuf_cleanup(&ab);
+    return ENOMEM;
+  }
+  as->v = v;
+
+  oldas = proc_setas(as);
+  as_activate();
+
+  result = load_elf(v, &entrypoint, &as->eh);
+  if (result) {
+    /* nothing was faulted in, so this only closes v */
+    proc_setas(oldas);
+    as_activate();
+    as_destroy(as);
+    argbuf_cleanup(&ab);
+    return result;
+  }
+
+  /*
+   * Point of no return. Page table entries are tagged by pid, which
+   * the new image shares, so the old pages must go before the new
+   * stack gets any.
+   */
+  as_destroy(oldas);
+
+  result = as_define_stack(as, &stackptr);
+  if (result == 0) {
+    result = argbuf_copyout(&ab, &stackptr, &uargv);
+  }
+  argc = ab.ab_argc;
+  argbuf_cleanup(&ab);
+  if (result) {
+    /* no image left to return the error to */
+    sys__exit(-1);
+  }
+
+  enter_new_process(argc, uargv, NULL, stackptr, entrypoint);
+
+  panic("enter_new_process returned\n");
+  return EINVAL;
+}
+
+/*
+ * spawn: start PROGNAME with ARGS in a new child process, without
+ * copying the caller's address space first as fork+execv would.
+ *
+ * Slot i of the child's file table gets the caller's fd FDMAP[i]
+ * (or stays closed if that is negative), for i < NFDS; a NULL FDMAP
+ * passes down the caller's whole table. Everything up to building
+ * the new image happens before this returns, so those errors go to
+ * the caller instead of turning into an exit status.
+ */
+struct spawn_info {
+  struct vnode *si_vnode;	/* executable, consumed by the child */
+  struct argbuf *si_args;	/* packed argv */
+  struct semaphore *si_done;	/* V'd when the image is built */
+  int si_result;		/* error from loadprogram */
+};
+
+static
+void
+spawn_start(void *ptr, unsigned long unused)
+{
+  struct spawn_info *si = ptr;
+  vaddr_t entrypoint, stackptr;
+  userptr_t uargv;
+  int argc, result;
+
+  (void)unused;
+
+  argc = si->si_args->ab_argc;
+  result = loadprogram(si->si_vnode, si->si_args,
+                       &entrypoint, &stackptr, &uargv);
+  si->si_result = result;
+  /* si lives on the parent's stack; don't touch it after this */
+  V(si->si_done);
+
+  if (result) {
+    /* the parent reaps us and reports the error */
+    sys__exit(1);
+  }
+
+  enter_new_process(argc, uargv, NULL, stackptr, entrypoint);
+  panic("enter_new_process returned\n");
+}
+
+int
+sys_spawn(userptr_t progname, userptr_t args, userptr_t fdmap, int nfds,
+          pid_t *retval)
+{
+  struct spawn_info si;
+  struct argbuf ab;
+  struct proc *child;
+  char *kprogname;
+  int *kfdmap = NULL;
+  int result;
+
+  if (fdmap != NULL && (nfds < 0 || nfds > OPEN_MAX)) {
+    return EINVAL;
+  }
+
+  kprogname = kmalloc(PATH_MAX);
+  if (kprogname == NULL) {
+    return ENOMEM;
+  }
+  result = copyinstr(progname, kprogname, PATH_MAX, NULL);
+  if (result) {
+    goto fail_name;
+  }
+
+  if (fdmap != NULL && nfds > 0) {
+    kfdmap = kmalloc(nfds * sizeof(int));
+    if (kfdmap == NULL) {
+      result = ENOMEM;
+      goto fail_name;
+    }
+    result = copyin(fdmap, kfdmap, nfds * sizeof(int));
+    if (result) {
+      goto fail_fdmap;
+    }
+  }
+
+  result = argbuf_init(&ab);
+  if (result) {
+    goto fail_fdmap;
+  }
+  result = argbuf_copyin(&ab, args);
+  if (result) {
+    goto fail_args;
+  }
+
+  child = proc_create_runprogram(kprogname);
+  if (child == NULL) {
+    result = ENOMEM;
+    goto fail_args;
+  }
+  if (fdmap == NULL || nfds > 0) {
+    /* an empty map leaves the child with no files at all */
+    result = filetable_inherit(child, kfdmap, nfds);
+    if (result) {
+      goto fail_proc;
+    }
+  }
+
+  si.si_done = sem_create("spawn", 0);
+  if (si.si_done == NULL) {
+    result = ENOMEM;
+    goto fail_proc;
+  }
+  si.si_args = &ab;
+  si.si_result = 0;
+
+  /* vfs_open may destroy the name; the child has its own copy */
+  result = vfs_open(kprogname, O_RDONLY, 0, &si.si_vnode);
+  if (result) {
+    goto fail_sem;
+  }
+
+  result = thread_fork(child->p_name, child, spawn_start, &si, 0);
+  if (result) {
+    vfs_close(si.si_vnode);
+    goto fail_sem;
+  }
+
+  P(si.si_done);
+  sem_destroy(si.si_done);
+  argbuf_cleanup(&ab);
+  kfree(kfdmap);
+  kfree(kprogname);
+
+  if (si.si_result) {
+    /* unless another of our threads has already claimed it */
+    if (proc_claimchild(child->pid, false, &child) == 0) {
+      proc_wait(child);
+    }
+    return si.si_result;
+  }
+  *retval = child->pid;
+  return 0;
+
+ fail_sem:
+  sem_destroy(si.si_done);
+ fail_proc:
+  proc_destroy(child);
+ fail_args:
+  argbuf_cleanup(&ab);
+ fail_fdmap:
+  kfree(kfdmap);
+ fail_name:
+  kfree(kprogname);
+  return result;
+}
+
+/*
+ * thread_create: start a new thread in the current process at ENTRY,
+ * with ARG1 and ARG2 in its first two argument registers and its
+ * stack pointer at STACK, which the caller has allocated. The address
+ * space is shared; the new thread gets its own kernel thread and so
+ * may run on another cpu. Returns the new thread's tid.
+ */
+struct uthread_args {
+  vaddr_t ua_entry;
+  vaddr_t ua_stack;
+  userptr_t ua_arg1;
+  userptr_t ua_arg2;
+};
+
+static
+void
+uthread_start(void *ptr, unsigned long tid)
+{
+  struct uthread_args ua = *(struct uthread_args *)ptr;
+
+  kfree(ptr);
+  proc_uthread_bind(curproc, tid, curthread);
+
+  enter_new_process((int)ua.ua_arg1, ua.ua_arg2, NULL,
+                    ua.ua_stack, ua.ua_entry);
+  panic("enter_new_process returned\n");
+}
+
+int
+sys_thread_create(userptr_t entry, userptr_t arg1, userptr_t arg2,
+                  userptr_t stack, int *retval)
+{
+  struct proc *p = curproc;
+  struct uthread_args *ua;
+  int tid, result;
+
+  if ((vaddr_t)entry >= USERSPACETOP || (vaddr_t)stack >= USERSPACETOP) {
+    return EFAULT;
+  }
+
+  ua = kmalloc(sizeof(*ua));
+  if (ua == NULL) {
+    return ENOMEM;
+  }
+  ua->ua_entry = (vaddr_t)entry;
+  ua->ua_stack = (vaddr_t)stack & ~(vaddr_t)7;
+  ua->ua_arg1 = arg1;
+  ua->ua_arg2 = arg2;
+
+  result = proc_uthread_reserve(p, &tid);
+  if (result) {
+    kfree(ua);
+    return result;
+  }
+
+  result = thread_fork(p->p_name, p, uthread_start, ua, tid);
+  if (result) {
+    proc_uthread_release(p, tid);
+    kfree(ua);
+    return result;
+  }
+
+  *retval = tid;
+  return 0;
+}
+
+void
+sys_thread_exit(int status)
+{
+  uthread_exit(status);
+}
+
+int
+sys_thread_join(int tid, userptr_t status)
+{
+  int exitstatus, result;
 
-  panic("thread_exit returned (should not happen)\n");
-  (void) status; // TODO: status handling
+  result = proc_uthread_join(curproc, tid, &exitstatus);
+  if (result) {
+    return result;
+  }
+  if (status != NULL) {
+    return copyout(&exitstatus, status, sizeof(exitstatus));
+  }
+  return 0;
 }
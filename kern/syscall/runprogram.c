@@ -48,32 +48,30 @@
 #include <elf.h>
 #include <types.h>
 #include <uio.h>
+#include <argbuf.h>
+#include <openfile.h>
 
 /*
- * Load program "progname" and start running it in usermode.
- * Does not return except on error.
- *
- * Calls vfs_open on progname and thus may destroy it.
+ * Set up a fresh address space for the current process (which must
+ * not have one yet) running the executable V, with the arguments in
+ * AB on its stack. V is handed over to the address space and is
+ * closed with it, even on error; on error the half-built address
+ * space stays with curproc and goes away when the process does.
+ * Shared by runprogram and spawn.
  */
 int
-runprogram(char *progname)
+loadprogram(struct vnode *v, struct argbuf *ab,
+	    vaddr_t *entrypoint, vaddr_t *stackptr, userptr_t *uargv)
 {
 	struct addrspace *as;
-	struct vnode *v;
-    	//Elf_Ehdr eh;
-    	//Elf_Phdr ph;
-	vaddr_t entrypoint, stackptr;
 	int result;
 
-	/* Open the file. */
-	result = vfs_open(progname, O_RDONLY, 0, &v);
-	if (result) {
-		return result;
-	}
-
 	/* We should be a new process. */
 	KASSERT(proc_getas() == NULL);
 
+	/* We are its initial thread. */
+	proc_uthread_bind(curproc, 0, curthread);
+
 	/* Create a new address space. */
 	as = as_create();
 	if (as == NULL) {
@@ -81,35 +79,79 @@ runprogram(char *progname)
 		return ENOMEM;
 	}
 
+	/* The address space keeps the file open for demand loading. */
+	as->v = v;
+
 	/* Switch to it and activate it. */
 	proc_setas(as);
 	as_activate();
 
-	as->v = v;
-	
-
 	/* Load the executable. */
-	result = load_elf(v, &entrypoint,&as->eh);
+	result = load_elf(v, entrypoint, &as->eh);
 	if (result) {
-		/* p_addrspace will go away when curproc is destroyed */
-		vfs_close(v);
 		return result;
 	}
 
+	/* Define the user stack in the address space */
+	result = as_define_stack(as, stackptr);
+	if (result) {
+		return result;
+	}
 
-	/* Done with the file now. */
-	//vfs_close(v);
+	/* Put the arguments on the stack. */
+	return argbuf_copyout(ab, stackptr, uargv);
+}
 
-	/* Define the user stack in the address space */
-	result = as_define_stack(as, &stackptr);
+/*
+ * Load program "progname" and start running it in usermode, with
+ * ARGC/ARGV (kernel strings) as its arguments.
+ * Does not return except on error.
+ *
+ * Calls vfs_open on progname and thus may destroy it.
+ */
+int
+runprogram(char *progname, int argc, char **argv)
+{
+	struct vnode *v;
+	struct argbuf ab;
+	vaddr_t entrypoint, stackptr;
+	userptr_t uargv;
+	int result;
+
+	/* Pack the arguments before anything else can go wrong. */
+	result = argbuf_init(&ab);
+	if (result) {
+		return result;
+	}
+	result = argbuf_fromkernel(&ab, argc, argv);
+	if (result) {
+		argbuf_cleanup(&ab);
+		return result;
+	}
+
+	/* Open the file. */
+	result = vfs_open(progname, O_RDONLY, 0, &v);
 	if (result) {
-		/* p_addrspace will go away when curproc is destroyed */
+		argbuf_cleanup(&ab);
 		return result;
 	}
 
+	/* Programs started from the menu talk to the console. */
+	result = filetable_console();
+	if (result) {
+		vfs_close(v);
+		argbuf_cleanup(&ab);
+		return result;
+	}
+
+	result = loadprogram(v, &ab, &entrypoint, &stackptr, &uargv);
+	argbuf_cleanup(&ab);
+	if (result) {
+		return result;
+	}
 
 	/* Warp to user mode. */
-	enter_new_process(0 /*argc*/, NULL /*userspace addr of argv*/,
+	enter_new_process(argc, uargv,
 			  NULL /*userspace addr of environment*/,
 			  stackptr, entrypoint);
 
@@ -117,4 +159,3 @@ runprogram(char *progname)
 	panic("enter_new_process returned\n");
 	return EINVAL;
 }
-
@@ -0,0 +1,193 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * Batched system calls: sysring_enter.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/sysring.h>
+#include <lib.h>
+#include <copyinout.h>
+#include <syscall.h>
+
+/*
+ * Entries moved per copyin/copyout. Runs never wrap around the end
+ * of a ring, so each chunk is one contiguous block of user memory.
+ */
+#define SYSRING_CHUNK  8
+
+/* Byte offset of FIELD within the ring header R. */
+#define SYSRING_FIELD(r, field) \
+	((size_t)((char *)&(r)->field - (char *)(r)))
+
+/*
+ * Run one request.
+ */
+static
+void
+sysring_run(const struct sysring_sqe *sqe, struct sysring_cqe *cqe)
+{
+	int32_t ret = 0;
+	off_t pos = 0;
+	int err;
+
+	switch (sqe->sqe_op) {
+	    case SYSRING_OP_NOP:
+		err = 0;
+		break;
+	    case SYSRING_OP_READ:
+		err = sys_read(sqe->sqe_fd, sqe->sqe_buf, sqe->sqe_len, &ret);
+		pos = ret;
+		break;
+	    case SYSRING_OP_WRITE:
+		err = sys_write(sqe->sqe_fd, sqe->sqe_buf, sqe->sqe_len, &ret);
+		pos = ret;
+		break;
+	    case SYSRING_OP_LSEEK:
+		err = sys_lseek(sqe->sqe_fd, sqe->sqe_off, sqe->sqe_flags,
+				&pos);
+		break;
+	    case SYSRING_OP_OPEN:
+		err = sys_open(sqe->sqe_buf, sqe->sqe_flags, sqe->sqe_len,
+			       &ret);
+		pos = ret;
+		break;
+	    case SYSRING_OP_CLOSE:
+		err = sys_close(sqe->sqe_fd);
+		break;
+	    default:
+		err = EINVAL;
+		break;
+	}
+
+	cqe->cqe_data = sqe->sqe_data;
+	cqe->cqe_error = err;
+	cqe->cqe_result = err ? -1 : pos;
+}
+
+/*
+ * sysring_enter: run up to TO_SUBMIT pending requests from RING.
+ * Returns the number run. Errors of individual requests go in their
+ * completions; only a bad ring fails the call itself.
+ */
+int
+sys_sysring_enter(userptr_t uring, unsigned to_submit, int *retval)
+{
+	struct sysring ring;
+	struct sysring_sqe sqes[SYSRING_CHUNK];
+	struct sysring_cqe cqes[SYSRING_CHUNK];
+	unsigned mask, pending, cqfree, n, sqidx, cqidx, i, done;
+	int result, err;
+
+	result = copyin(uring, &ring, sizeof(ring));
+	if (result) {
+		return result;
+	}
+	if (ring.sr_entries == 0 || ring.sr_entries > SYSRING_MAXENTRIES ||
+	    (ring.sr_entries & (ring.sr_entries - 1)) != 0) {
+		return EINVAL;
+	}
+	mask = ring.sr_entries - 1;
+
+	pending = ring.sr_sqtail - ring.sr_sqhead;
+	cqfree = ring.sr_entries - (ring.sr_cqtail - ring.sr_cqhead);
+	if (pending > ring.sr_entries || cqfree > ring.sr_entries) {
+		/* counters are garbage */
+		return EINVAL;
+	}
+	if (to_submit > pending) {
+		to_submit = pending;
+	}
+	if (to_submit > cqfree) {
+		to_submit = cqfree;
+	}
+
+	result = 0;
+	done = 0;
+	while (done < to_submit) {
+		/* chunk: bounded by both rings' wraparound */
+		sqidx = ring.sr_sqhead & mask;
+		cqidx = ring.sr_cqtail & mask;
+		n = to_submit - done;
+		if (n > SYSRING_CHUNK) {
+			n = SYSRING_CHUNK;
+		}
+		if (n > ring.sr_entries - sqidx) {
+			n = ring.sr_entries - sqidx;
+		}
+		if (n > ring.sr_entries - cqidx) {
+			n = ring.sr_entries - cqidx;
+		}
+
+		result = copyin(ring.sr_sqes + sqidx * sizeof(sqes[0]),
+				sqes, n * sizeof(sqes[0]));
+		if (result) {
+			break;
+		}
+		for (i=0; i<n; i++) {
+			sysring_run(&sqes[i], &cqes[i]);
+		}
+		result = copyout(cqes, ring.sr_cqes + cqidx * sizeof(cqes[0]),
+				 n * sizeof(cqes[0]));
+		if (result) {
+			/* the requests ran; count them as consumed */
+			ring.sr_sqhead += n;
+			done += n;
+			break;
+		}
+
+		ring.sr_sqhead += n;
+		ring.sr_cqtail += n;
+		done += n;
+	}
+
+	/* Publish progress; leave the process's own counters alone. */
+	if (done > 0) {
+		err = copyout(&ring.sr_sqhead,
+			      uring + SYSRING_FIELD(&ring, sr_sqhead),
+			      sizeof(ring.sr_sqhead));
+		if (err == 0) {
+			err = copyout(&ring.sr_cqtail,
+				      uring + SYSRING_FIELD(&ring, sr_cqtail),
+				      sizeof(ring.sr_cqtail));
+		}
+		if (result == 0) {
+			result = err;
+		}
+	}
+	if (result) {
+		return result;
+	}
+
+	*retval = done;
+	return 0;
+}
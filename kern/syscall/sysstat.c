@@ -0,0 +1,380 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * System call statistics (see sysstat.h) and the sysstat: device.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <kern/syscall.h>
+#include <lib.h>
+#include <cpu.h>
+#include <spl.h>
+#include <current.h>
+#include <uio.h>
+#include <vfs.h>
+#include <device.h>
+#include <sysstat.h>
+
+/* Per-CPU sets, indexed by c_number. */
+static struct sysstat *sysstat_cpus[SYSSTAT_MAXCPUS];
+
+/* Names for the report. */
+static const char *const sysstat_names[SYSSTAT_NCALLS] = {
+	[SYS_fork] = "fork",
+	[SYS_vfork] = "vfork",
+	[SYS_execv] = "execv",
+	[SYS__exit] = "_exit",
+	[SYS_waitpid] = "waitpid",
+	[SYS_getpid] = "getpid",
+	[SYS_getppid] = "getppid",
+	[SYS_sbrk] = "sbrk",
+	[SYS_mmap] = "mmap",
+	[SYS_munmap] = "munmap",
+	[SYS_mprotect] = "mprotect",
+	[SYS_umask] = "umask",
+	[SYS_issetugid] = "issetugid",
+	[SYS_getresuid] = "getresuid",
+	[SYS_setresuid] = "setresuid",
+	[SYS_getresgid] = "getresgid",
+	[SYS_setresgid] = "setresgid",
+	[SYS_getgroups] = "getgroups",
+	[SYS_setgroups] = "setgroups",
+	[SYS___getlogin] = "__getlogin",
+	[SYS___setlogin] = "__setlogin",
+	[SYS_kill] = "kill",
+	[SYS_sigaction] = "sigaction",
+	[SYS_sigpending] = "sigpending",
+	[SYS_sigprocmask] = "sigprocmask",
+	[SYS_sigsuspend] = "sigsuspend",
+	[SYS_sigreturn] = "sigreturn",
+	[SYS_open] = "open",
+	[SYS_pipe] = "pipe",
+	[SYS_dup] = "dup",
+	[SYS_close] = "close",
+	[SYS_read] = "read",
+	[SYS_pread] = "pread",
+	[SYS_readv] = "readv",
+	[SYS_getdirentry] = "getdirentry",
+	[SYS_write] = "write",
+	[SYS_pwrite] = "pwrite",
+	[SYS_writev] = "writev",
+	[SYS_lseek] = "lseek",
+	[SYS_flock] = "flock",
+	[SYS_ftruncate] = "ftruncate",
+	[SYS_fsync] = "fsync",
+	[SYS_fcntl] = "fcntl",
+	[SYS_ioctl] = "ioctl",
+	[SYS_select] = "select",
+	[SYS_poll] = "poll",
+	[SYS_link] = "link",
+	[SYS_remove] = "remove",
+	[SYS_mkdir] = "mkdir",
+	[SYS_rmdir] = "rmdir",
+	[SYS_mkfifo] = "mkfifo",
+	[SYS_rename] = "rename",
+	[SYS_access] = "access",
+	[SYS_chdir] = "chdir",
+	[SYS_fchdir] = "fchdir",
+	[SYS___getcwd] = "__getcwd",
+	[SYS_symlink] = "symlink",
+	[SYS_readlink] = "readlink",
+	[SYS_mount] = "mount",
+	[SYS_unmount] = "unmount",
+	[SYS_stat] = "stat",
+	[SYS_fstat] = "fstat",
+	[SYS_lstat] = "lstat",
+	[SYS_utimes] = "utimes",
+	[SYS_futimes] = "futimes",
+	[SYS_lutimes] = "lutimes",
+	[SYS_chmod] = "chmod",
+	[SYS_chown] = "chown",
+	[SYS_fchmod] = "fchmod",
+	[SYS_fchown] = "fchown",
+	[SYS_lchmod] = "lchmod",
+	[SYS_lchown] = "lchown",
+	[SYS_socket] = "socket",
+	[SYS_bind] = "bind",
+	[SYS_connect] = "connect",
+	[SYS_listen] = "listen",
+	[SYS_accept] = "accept",
+	[SYS_shutdown] = "shutdown",
+	[SYS_getsockname] = "getsockname",
+	[SYS_getpeername] = "getpeername",
+	[SYS_getsockopt] = "getsockopt",
+	[SYS_setsockopt] = "setsockopt",
+	[SYS___time] = "__time",
+	[SYS___settime] = "__settime",
+	[SYS_nanosleep] = "nanosleep",
+	[SYS_sync] = "sync",
+	[SYS_reboot] = "reboot",
+	[SYS_spawn] = "spawn",
+	[SYS___thread_create] = "__thread_create",
+	[SYS_thread_exit] = "thread_exit",
+	[SYS_thread_join] = "thread_join",
+	[SYS_sysring_enter] = "sysring_enter",
+	[SYS_aio_read] = "aio_read",
+	[SYS_aio_write] = "aio_write",
+	[SYS_aio_wait] = "aio_wait",
+	[SYS_sendfile] = "sendfile",
+};
+
+void
+sysstat_cpu_init(unsigned cpunum)
+{
+	struct sysstat *ss;
+
+	KASSERT(cpunum < SYSSTAT_MAXCPUS);
+	ss = kmalloc(sizeof(*ss));
+	if (ss == NULL) {
+		panic("sysstat: Out of memory\n");
+	}
+	bzero(ss, sizeof(*ss));
+	sysstat_cpus[cpunum] = ss;
+}
+
+static
+unsigned
+sysstat_bucket(uint64_t cycles)
+{
+	unsigned b = 0;
+
+	while (cycles > 1 && b < SYSSTAT_NBUCKETS - 1) {
+		cycles >>= 1;
+		b++;
+	}
+	return b;
+}
+
+/*
+ * Interrupts go off so a preemption can't move us to another CPU
+ * halfway through updating this one's set.
+ */
+void
+sysstat_record(unsigned callno, uint64_t cycles)
+{
+	struct sysstat *ss;
+	unsigned b;
+	int spl;
+
+	if (callno >= SYSSTAT_NCALLS) {
+		return;
+	}
+	b = sysstat_bucket(cycles);
+
+	spl = splhigh();
+	ss = sysstat_cpus[curcpu->c_number];
+	if (ss != NULL) {
+		ss->ss_count[callno]++;
+		ss->ss_cycles[callno] += cycles;
+		ss->ss_hist[callno][b]++;
+	}
+	splx(spl);
+}
+
+void
+sysstat_reset(void)
+{
+	unsigned i;
+	int spl;
+
+	for (i=0; i<SYSSTAT_MAXCPUS; i++) {
+		if (sysstat_cpus[i] != NULL) {
+			/* only our own CPU is held off; good enough */
+			spl = splhigh();
+			bzero(sysstat_cpus[i], sizeof(struct sysstat));
+			splx(spl);
+		}
+	}
+}
+
+/*
+ * Format the report. Histogram buckets are printed as their lower
+ * bound in cycles.
+ */
+size_t
+sysstat_report(char *buf, size_t len)
+{
+	uint32_t count, hist[SYSSTAT_NBUCKETS];
+	uint64_t cycles;
+	unsigned call, cpu, b;
+	size_t pos = 0;
+
+#define EMIT(...) \
+	do { \
+		if (pos < len) { \
+			pos += snprintf(buf + pos, len - pos, __VA_ARGS__); \
+		} \
+	} while (0)
+
+	KASSERT(len > 0);
+	buf[0] = '\0';
+	EMIT("%-16s %10s %12s\n", "syscall", "calls", "avg cycles");
+
+	for (call=0; call<SYSSTAT_NCALLS; call++) {
+		count = 0;
+		cycles = 0;
+		for (b=0; b<SYSSTAT_NBUCKETS; b++) {
+			hist[b] = 0;
+		}
+		for (cpu=0; cpu<SYSSTAT_MAXCPUS; cpu++) {
+			if (sysstat_cpus[cpu] == NULL) {
+				continue;
+			}
+			count += sysstat_cpus[cpu]->ss_count[call];
+			cycles += sysstat_cpus[cpu]->ss_cycles[call];
+			for (b=0; b<SYSSTAT_NBUCKETS; b++) {
+				hist[b] += sysstat_cpus[cpu]->ss_hist[call][b];
+			}
+		}
+		if (count == 0) {
+			continue;
+		}
+
+		if (sysstat_names[call] != NULL) {
+			EMIT("%-16s", sysstat_names[call]);
+		}
+		else {
+			EMIT("#%-15u", call);
+		}
+		EMIT(" %10u %12llu\n ", count,
+		     (unsigned long long)(cycles / count));
+		for (b=0; b<SYSSTAT_NBUCKETS; b++) {
+			if (hist[b] > 0) {
+				EMIT(" %lu:%u", 1UL << b, hist[b]);
+			}
+		}
+		EMIT("\n");
+	}
+#undef EMIT
+
+	return pos < len ? pos : len - 1;
+}
+
+////////////////////////////////////////////////////////////
+//
+// sysstat: device
+
+/* For open() */
+static
+int
+sysstatopen(struct device *dev, int openflags)
+{
+	(void)dev;
+
+	if ((openflags & O_ACCMODE) != O_RDONLY) {
+		return EINVAL;
+	}
+	return 0;
+}
+
+/*
+ * For d_io(): each read formats a fresh report and hands back the
+ * part of it at the read's offset.
+ */
+static
+int
+sysstatio(struct device *dev, struct uio *uio)
+{
+	char *buf;
+	size_t len;
+	int result;
+
+	(void)dev;
+
+	if (uio->uio_rw != UIO_READ) {
+		return EINVAL;
+	}
+
+	buf = kmalloc(SYSSTAT_REPORTMAX);
+	if (buf == NULL) {
+		return ENOMEM;
+	}
+	len = sysstat_report(buf, SYSSTAT_REPORTMAX);
+	if (uio->uio_offset < 0 || uio->uio_offset >= (off_t)len) {
+		/* EOF */
+		result = 0;
+	}
+	else {
+		result = uiomove(buf + uio->uio_offset,
+				 len - uio->uio_offset, uio);
+	}
+	kfree(buf);
+	return result;
+}
+
+/* For ioctl() */
+static
+int
+sysstatioctl(struct device *dev, int op, userptr_t data)
+{
+	(void)dev;
+	(void)op;
+	(void)data;
+
+	return EINVAL;
+}
+
+static const struct device_ops sysstat_devops = {
+	.devop_eachopen = sysstatopen,
+	.devop_io = sysstatio,
+	.devop_ioctl = sysstatioctl,
+};
+
+/*
+ * Function to create and attach sysstat:
+ */
+void
+devsysstat_create(void)
+{
+	int result;
+	struct device *dev;
+
+	dev = kmalloc(sizeof(*dev));
+	if (dev==NULL) {
+		panic("Could not add sysstat device: out of memory\n");
+	}
+
+	dev->d_ops = &sysstat_devops;
+
+	dev->d_blocks = 0;
+	dev->d_blocksize = 1;
+
+	dev->d_devnumber = 0; /* assigned by vfs_adddev */
+
+	dev->d_data = NULL;
+
+	result = vfs_adddev("sysstat", dev, 0);
+	if (result) {
+		panic("Could not add sysstat device: %s\n", strerror(result));
+	}
+}
@@ -28,8 +28,10 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
 #include <clock.h>
 #include <copyinout.h>
+#include <timeout.h>
 #include <syscall.h>
 
 /*
@@ -56,3 +58,33 @@ sys___time(userptr_t user_seconds_ptr, userptr_t user_nanoseconds_ptr)
 
 	return 0;
 }
+
+/*
+ * Sleep for the time in *REQ, rounded up to clock ticks. The current
+ * tick is already partly over, so sleep one more to be sure of
+ * sleeping at least as long as asked. Nothing can interrupt the
+ * sleep, so *REM (which would get the time left) is never written.
+ */
+int
+sys_nanosleep(userptr_t req_ptr, userptr_t rem_ptr)
+{
+	struct timespec ts;
+	unsigned ticks;
+	int result;
+
+	(void)rem_ptr;
+
+	result = copyin(req_ptr, &ts, sizeof(ts));
+	if (result) {
+		return result;
+	}
+	if (ts.tv_sec < 0 || ts.tv_nsec < 0 || ts.tv_nsec >= 1000000000) {
+		return EINVAL;
+	}
+
+	ticks = timespec_to_ticks(&ts);
+	if (ticks > 0) {
+		ticksleep(ticks + 1);
+	}
+	return 0;
+}
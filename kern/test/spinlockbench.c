@@ -0,0 +1,208 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * Spinlock benchmark: plain versus queued spinlocks.
+ *
+ * For 1, 2, ... up to a given number of threads, each thread takes
+ * and releases one shared spinlock SPB_ITERS times, holding it for
+ * SPB_HOLD cycles and then waiting SPB_THINK cycles before the next
+ * try. We report throughput (acquisitions per million cycles) and
+ * the worst time any single acquire took. There is no way to pin a
+ * thread to a CPU, so the threads are given a moment to be spread
+ * over the CPUs before they start; with at least as many threads as
+ * CPUs every CPU is in the fight.
+ *
+ * The plain lock should have the better throughput at low thread
+ * counts and the queued lock the much better worst case at high ones.
+ */
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <cpu.h>
+#include <clock.h>
+#include <spinlock.h>
+#include <thread.h>
+#include <synch.h>
+#include <test.h>
+
+#define SPB_ITERS	 5000
+#define SPB_HOLD	 100	/* cycles */
+#define SPB_THINK	 200	/* cycles */
+#define SPB_MAXTHREADS	 32
+#define SPB_DEFTHREADS	 8
+
+static struct spinlock spb_lock;
+static volatile bool spb_go;
+static volatile unsigned long spb_count;	/* protected by spb_lock */
+static struct semaphore *spb_done;
+
+/* per thread results */
+static uint64_t spb_elapsed[SPB_MAXTHREADS];
+static uint64_t spb_maxwait[SPB_MAXTHREADS];
+
+static
+void
+spb_thread(void *junk, unsigned long num)
+{
+	uint64_t start, before, wait, maxwait;
+	unsigned i;
+
+	(void)junk;
+
+	while (!spb_go) {
+		thread_yield();
+	}
+
+	maxwait = 0;
+	start = cpu_cycles();
+	for (i=0; i<SPB_ITERS; i++) {
+		before = cpu_cycles();
+		spinlock_acquire(&spb_lock);
+		wait = cpu_cycles() - before;
+		spb_count++;
+		spinlock_delay(SPB_HOLD);
+		spinlock_release(&spb_lock);
+
+		if (wait > maxwait) {
+			maxwait = wait;
+		}
+		spinlock_delay(SPB_THINK);
+	}
+	spb_elapsed[num] = cpu_cycles() - start;
+	spb_maxwait[num] = maxwait;
+
+	V(spb_done);
+}
+
+/*
+ * One run with NTHREADS threads.
+ */
+static
+void
+spb_run(bool queued, unsigned nthreads)
+{
+	uint64_t elapsed, maxwait, rate;
+	unsigned i;
+	int result;
+
+	if (queued) {
+		spinlock_init_queued(&spb_lock);
+	}
+	else {
+		spinlock_init(&spb_lock);
+	}
+	spb_go = false;
+	spb_count = 0;
+
+	for (i=0; i<nthreads; i++) {
+		result = thread_fork("spinbench", NULL, spb_thread, NULL, i);
+		if (result) {
+			panic("spinbench: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+
+	/* let the threads get migrated out to the other CPUs */
+	clocksleep(1);
+	spb_go = true;
+
+	for (i=0; i<nthreads; i++) {
+		P(spb_done);
+	}
+
+	elapsed = 0;
+	maxwait = 0;
+	for (i=0; i<nthreads; i++) {
+		if (spb_elapsed[i] > elapsed) {
+			elapsed = spb_elapsed[i];
+		}
+		if (spb_maxwait[i] > maxwait) {
+			maxwait = spb_maxwait[i];
+		}
+	}
+	rate = elapsed == 0 ? 0 :
+		(uint64_t)nthreads * SPB_ITERS * 1000000 / elapsed;
+
+	kprintf("%-6s %7u %16llu %16llu%s\n", queued ? "queued" : "plain",
+		nthreads, (unsigned long long)rate,
+		(unsigned long long)maxwait,
+		spb_count == (unsigned long)nthreads * SPB_ITERS ?
+		"" : "  COUNT WRONG");
+
+	spinlock_cleanup(&spb_lock);
+}
+
+/*
+ * Usage: sp1 [maxthreads]
+ */
+int
+spinlockbench(int nargs, char **args)
+{
+	unsigned maxthreads, n;
+
+	if (nargs == 1) {
+		maxthreads = SPB_DEFTHREADS;
+	}
+	else if (nargs == 2) {
+		maxthreads = atoi(args[1]);
+	}
+	else {
+		kprintf("Usage: sp1 [maxthreads]\n");
+		return EINVAL;
+	}
+	if (maxthreads < 1 || maxthreads > SPB_MAXTHREADS) {
+		kprintf("sp1: between 1 and %u threads\n", SPB_MAXTHREADS);
+		return EINVAL;
+	}
+
+	if (spb_done == NULL) {
+		spb_done = sem_create("spinbench", 0);
+		if (spb_done == NULL) {
+			panic("spinbench: sem_create failed\n");
+		}
+	}
+
+	kprintf("Starting spinlock benchmark...\n");
+	kprintf("%-6s %7s %16s %16s\n", "lock", "threads",
+		"acquires/Mcycle", "worst wait");
+	for (n=1; n<=maxthreads; n*=2) {
+		spb_run(false, n);
+		spb_run(true, n);
+	}
+	if (maxthreads & (maxthreads - 1)) {
+		/* not a power of 2; do it too */
+		spb_run(false, maxthreads);
+		spb_run(true, maxthreads);
+	}
+	kprintf("Spinlock benchmark done.\n");
+
+	return 0;
+}
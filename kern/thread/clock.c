@@ -34,13 +34,17 @@
 #include <clock.h>
 #include <thread.h>
 #include <current.h>
+#include <mainbus.h>
+#include <vdso.h>
+#include <timeout.h>
 
 /*
  * Time handling.
  *
- * This is pretty primitive. A real kernel will typically have some
- * kind of support for scheduling callbacks to happen at specific
- * points in the future, usually with more resolution than one second.
+ * This is pretty primitive. Callbacks at specific points in the
+ * future, with tick resolution, are the timeout wheel's business (see
+ * timeout.c); hardclock on CPU 0 drives it. What's left here is the
+ * one-second lbolt, for clocksleep, and tickless idle.
  *
  * A real kernel also has to maintain the time of day; in OS/161 we
  * skimp on that because we have a known-good hardware clock.
@@ -50,8 +54,7 @@
  * Timing constants. These should be tuned along with any work done on
  * the scheduler.
  */
-#define SCHEDULE_HARDCLOCKS	4	/* Reschedule every 4 hardclocks. */
-#define MIGRATE_HARDCLOCKS	16	/* Migrate every 16 hardclocks. */
+#define SCHEDULE_HARDCLOCKS	25	/* Age priorities every 25 hardclocks. */
 
 /*
  * Once a second, everything waiting on lbolt is awakened by CPU 0.
@@ -59,6 +62,13 @@
 static struct wchan *lbolt;
 static struct spinlock lbolt_lock;
 
+/*
+ * Threads in ticksleep wait here. Nobody wakes it; each sleeper's
+ * own timeout does.
+ */
+static struct wchan *ticksleep_wchan;
+static struct spinlock ticksleep_lock;
+
 /*
  * Setup.
  */
@@ -70,6 +80,11 @@ hardclock_bootstrap(void)
 	if (lbolt == NULL) {
 		panic("Couldn't create lbolt\n");
 	}
+	spinlock_init(&ticksleep_lock);
+	ticksleep_wchan = wchan_create("ticksleep");
+	if (ticksleep_wchan == NULL) {
+		panic("Couldn't create ticksleep\n");
+	}
 }
 
 /*
@@ -96,14 +111,23 @@ hardclock(void)
 	 * Collect statistics here as desired.
 	 */
 
+	/* the machine-dependent code has rearmed the periodic tick */
+	if (curcpu->c_tickless) {
+		curcpu->c_tickless = false;
+		if (curcpu->c_number == 0) {
+			timeout_busy();
+		}
+	}
+
 	curcpu->c_hardclocks++;
-	if ((curcpu->c_hardclocks % MIGRATE_HARDCLOCKS) == 0) {
-		thread_consider_migration();
+	vdso_update();
+	if (curcpu->c_number == 0) {
+		timeout_tick();
 	}
 	if ((curcpu->c_hardclocks % SCHEDULE_HARDCLOCKS) == 0) {
 		schedule();
 	}
-	thread_yield();
+	thread_tick();
 }
 
 /*
@@ -119,3 +143,71 @@ clocksleep(int num_secs)
 	}
 	spinlock_release(&lbolt_lock);
 }
+
+/*
+ * Suspend execution for n hardclock ticks.
+ */
+void
+ticksleep(unsigned ticks)
+{
+	uint64_t deadline, now;
+
+	deadline = timeout_now() + ticks;
+	spinlock_acquire(&ticksleep_lock);
+	while ((now = timeout_now()) < deadline) {
+		wchan_sleep_timeout(ticksleep_wchan, &ticksleep_lock,
+				    deadline - now);
+	}
+	spinlock_release(&ticksleep_lock);
+}
+
+/*
+ * Tickless idle.
+ *
+ * An idle CPU has no use for hardclock: there is nothing to
+ * schedule, and taking the interrupt HZ times a second just burns
+ * cycles (and, on the simulator, wall clock time). So before idling,
+ * a CPU pushes its next clock interrupt out, and when it wakes up for
+ * some other reason (an interprocessor interrupt for new work, or a
+ * device) it brings the periodic tick back.
+ *
+ * Nothing depends on counting hardclocks: the timeout wheel and the
+ * vdso time go by mainbus_ticks(), and any CPU's hardclock (or
+ * hardclock_busy) refreshes the vdso time. So other CPUs can sleep as
+ * long as the hardware allows, and CPU 0, which runs the timeouts,
+ * sleeps until the next one is due.
+ */
+void
+hardclock_idle(void)
+{
+	unsigned ticks;
+
+	KASSERT(curthread->t_curspl > 0);
+
+	if (curcpu->c_tickless) {
+		return;
+	}
+	if (curcpu->c_number == 0) {
+		ticks = timeout_idle(TIMEOUT_MAXTICKS);
+	}
+	else {
+		ticks = TIMEOUT_MAXTICKS;
+	}
+	curcpu->c_tickless = true;
+	mainbus_settick(ticks);
+}
+
+void
+hardclock_busy(void)
+{
+	KASSERT(curthread->t_curspl > 0);
+
+	if (curcpu->c_tickless) {
+		curcpu->c_tickless = false;
+		if (curcpu->c_number == 0) {
+			timeout_busy();
+		}
+		mainbus_settick(1);
+		vdso_update();
+	}
+}
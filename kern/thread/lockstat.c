@@ -0,0 +1,344 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * Lock statistics (see lockstat.h).
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <cpu.h>
+#include <spl.h>
+#include <current.h>
+#include <lockstat.h>
+
+struct lockstat_ent {
+	char le_name[LOCKSTAT_NAMELEN];	/* empty if keyed by site */
+	vaddr_t le_site;
+	unsigned le_kind;
+	bool le_used;
+	uint32_t le_acquires;
+	uint32_t le_contended;
+	uint64_t le_wait;		/* total cycles waited */
+	uint64_t le_maxhold;		/* longest hold, in cycles */
+};
+
+struct lockstat_table {
+	struct lockstat_ent lt_ents[LOCKSTAT_NENTRIES];
+	uint32_t lt_dropped;		/* events with no room in the table */
+};
+
+/* Per-CPU tables, indexed by c_number. */
+static struct lockstat_table *lockstat_cpus[LOCKSTAT_MAXCPUS];
+
+static const char *const lockstat_kinds[] = {
+	[LOCKSTAT_SPIN] = "spin",
+	[LOCKSTAT_SLEEP] = "lock",
+	[LOCKSTAT_WCHAN] = "wchan",
+};
+
+void
+lockstat_cpu_init(unsigned cpunum)
+{
+	struct lockstat_table *lt;
+
+	KASSERT(cpunum < LOCKSTAT_MAXCPUS);
+	lt = kmalloc(sizeof(*lt));
+	if (lt == NULL) {
+		panic("lockstat: Out of memory\n");
+	}
+	bzero(lt, sizeof(*lt));
+	lockstat_cpus[cpunum] = lt;
+}
+
+/*
+ * Does entry LE belong to the lock described by KIND/NAME/SITE? Only
+ * the first LOCKSTAT_NAMELEN-1 characters of NAME count.
+ */
+static
+bool
+lockstat_match(const struct lockstat_ent *le, unsigned kind,
+	       const char *name, vaddr_t site)
+{
+	unsigned i;
+
+	if (le->le_kind != kind) {
+		return false;
+	}
+	if (name == NULL) {
+		return le->le_name[0] == '\0' && le->le_site == site;
+	}
+	for (i=0; i < LOCKSTAT_NAMELEN - 1; i++) {
+		if (le->le_name[i] != name[i]) {
+			return false;
+		}
+		if (name[i] == '\0') {
+			break;
+		}
+	}
+	return true;
+}
+
+/*
+ * Find (or make) the entry for a lock in table LT. Returns NULL if
+ * the table is full.
+ */
+static
+struct lockstat_ent *
+lockstat_lookup(struct lockstat_table *lt, unsigned kind,
+		const char *name, vaddr_t site)
+{
+	struct lockstat_ent *le;
+	uint32_t hash;
+	unsigned i, n;
+
+	hash = kind;
+	if (name != NULL) {
+		for (i=0; i < LOCKSTAT_NAMELEN - 1 && name[i] != '\0'; i++) {
+			hash = hash * 33 + (unsigned char)name[i];
+		}
+	}
+	else {
+		hash = hash * 33 + (site >> 2);
+	}
+
+	for (n=0; n<LOCKSTAT_NENTRIES; n++) {
+		le = &lt->lt_ents[(hash + n) & (LOCKSTAT_NENTRIES - 1)];
+		if (!le->le_used) {
+			le->le_used = true;
+			le->le_kind = kind;
+			if (name != NULL) {
+				for (i=0; i < LOCKSTAT_NAMELEN - 1 &&
+					    name[i] != '\0'; i++) {
+					le->le_name[i] = name[i];
+				}
+				le->le_name[i] = '\0';
+				le->le_site = 0;
+			}
+			else {
+				le->le_name[0] = '\0';
+				le->le_site = site;
+			}
+			return le;
+		}
+		if (lockstat_match(le, kind, name, site)) {
+			return le;
+		}
+	}
+	lt->lt_dropped++;
+	return NULL;
+}
+
+/*
+ * Get the current CPU's entry for a lock, with interrupts off so we
+ * stay on this CPU while updating it. Returns NULL (with interrupts
+ * still off) if there is nowhere to record.
+ */
+static
+struct lockstat_ent *
+lockstat_get(unsigned kind, const char *name, vaddr_t site)
+{
+	struct lockstat_table *lt;
+
+	if (!CURCPU_EXISTS()) {
+		return NULL;
+	}
+	lt = lockstat_cpus[curcpu->c_number];
+	if (lt == NULL) {
+		return NULL;
+	}
+	return lockstat_lookup(lt, kind, name, site);
+}
+
+void
+lockstat_acquire(unsigned kind, const char *name, vaddr_t site,
+		 bool contended, uint64_t wait)
+{
+	struct lockstat_ent *le;
+	int spl;
+
+	spl = splhigh();
+	le = lockstat_get(kind, name, site);
+	if (le != NULL) {
+		le->le_acquires++;
+		if (contended) {
+			le->le_contended++;
+			le->le_wait += wait;
+		}
+	}
+	splx(spl);
+}
+
+void
+lockstat_hold(unsigned kind, const char *name, vaddr_t site, uint64_t hold)
+{
+	struct lockstat_ent *le;
+	int spl;
+
+	spl = splhigh();
+	le = lockstat_get(kind, name, site);
+	if (le != NULL && hold > le->le_maxhold) {
+		le->le_maxhold = hold;
+	}
+	splx(spl);
+}
+
+void
+lockstat_reset(void)
+{
+	unsigned i;
+	int spl;
+
+	for (i=0; i<LOCKSTAT_MAXCPUS; i++) {
+		if (lockstat_cpus[i] != NULL) {
+			/* only our own CPU is held off; good enough */
+			spl = splhigh();
+			bzero(lockstat_cpus[i], sizeof(struct lockstat_table));
+			splx(spl);
+		}
+	}
+}
+
+/*
+ * Add the entries of all CPUs into SUM (LOCKSTAT_NENTRIES entries per
+ * CPU, so a merged table can't overflow). Returns the number of
+ * merged entries; *DROPPED gets the total of events not recorded.
+ */
+static
+unsigned
+lockstat_merge(struct lockstat_ent *sum, unsigned max, uint32_t *dropped)
+{
+	const struct lockstat_ent *le;
+	const char *name;
+	unsigned cpu, i, j, num;
+
+	num = 0;
+	*dropped = 0;
+	for (cpu=0; cpu<LOCKSTAT_MAXCPUS; cpu++) {
+		if (lockstat_cpus[cpu] == NULL) {
+			continue;
+		}
+		*dropped += lockstat_cpus[cpu]->lt_dropped;
+		for (i=0; i<LOCKSTAT_NENTRIES; i++) {
+			le = &lockstat_cpus[cpu]->lt_ents[i];
+			if (!le->le_used || le->le_acquires == 0) {
+				continue;
+			}
+			name = le->le_name[0] != '\0' ? le->le_name : NULL;
+			for (j=0; j<num; j++) {
+				if (lockstat_match(&sum[j], le->le_kind,
+						   name, le->le_site)) {
+					break;
+				}
+			}
+			if (j == num) {
+				if (num == max) {
+					(*dropped)++;
+					continue;
+				}
+				sum[num] = *le;
+				num++;
+				continue;
+			}
+			sum[j].le_acquires += le->le_acquires;
+			sum[j].le_contended += le->le_contended;
+			sum[j].le_wait += le->le_wait;
+			if (le->le_maxhold > sum[j].le_maxhold) {
+				sum[j].le_maxhold = le->le_maxhold;
+			}
+		}
+	}
+	return num;
+}
+
+/*
+ * Format the report: the TOP entries with the most total waiting,
+ * worst first.
+ */
+size_t
+lockstat_report(char *buf, size_t len, unsigned top)
+{
+	struct lockstat_ent *sum, tmp;
+	unsigned num, i, j, best;
+	uint32_t dropped;
+	size_t pos = 0;
+
+#define EMIT(...) \
+	do { \
+		if (pos < len) { \
+			pos += snprintf(buf + pos, len - pos, __VA_ARGS__); \
+		} \
+	} while (0)
+
+	KASSERT(len > 0);
+	buf[0] = '\0';
+
+	sum = kmalloc(LOCKSTAT_NENTRIES * sizeof(*sum));
+	if (sum == NULL) {
+		EMIT("lockstat: Out of memory\n");
+		return pos < len ? pos : len - 1;
+	}
+	num = lockstat_merge(sum, LOCKSTAT_NENTRIES, &dropped);
+
+	EMIT("%-24s %-5s %10s %10s %14s %10s\n", "lock", "kind",
+	     "acquires", "contended", "wait cycles", "max hold");
+
+	/* Selection sort, but only as far as we're going to print. */
+	for (i=0; i<num && i<top; i++) {
+		best = i;
+		for (j=i+1; j<num; j++) {
+			if (sum[j].le_wait > sum[best].le_wait) {
+				best = j;
+			}
+		}
+		tmp = sum[i];
+		sum[i] = sum[best];
+		sum[best] = tmp;
+
+		if (sum[i].le_name[0] != '\0') {
+			EMIT("%-24s", sum[i].le_name);
+		}
+		else {
+			EMIT("@0x%-21lx", (unsigned long)sum[i].le_site);
+		}
+		EMIT(" %-5s %10u %10u %14llu %10llu\n",
+		     lockstat_kinds[sum[i].le_kind],
+		     sum[i].le_acquires, sum[i].le_contended,
+		     (unsigned long long)sum[i].le_wait,
+		     (unsigned long long)sum[i].le_maxhold);
+	}
+	if (dropped > 0) {
+		EMIT("(%u events not recorded: tables full)\n", dropped);
+	}
+#undef EMIT
+
+	kfree(sum);
+	return pos < len ? pos : len - 1;
+}
@@ -0,0 +1,280 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * Read-copy-update. See rcu.h.
+ *
+ * There is at most one grace period in progress. Callbacks handed to
+ * call_rcu wait on rcu_next until one starts; those on rcu_wait
+ * belong to the current one, and move to rcu_done when it ends. A
+ * grace period starts with rcu_gp bumped and rcu_pending set to the
+ * number of CPUs that are not idle; each of those reports once,
+ * through rcu_quiescent or rcu_idle_enter, and the last one to
+ * report ends it.
+ *
+ * rcu_quiescent is called on every context switch, so its common
+ * case (nothing in progress, or this CPU already reported) is
+ * decided without taking the lock.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <current.h>
+#include <cpu.h>
+#include <thread.h>
+#include <rcu.h>
+
+#define RCU_MAXCPUS  32
+
+struct rcu_cpu {
+	bool rc_online;		/* rcu_cpu_init has been called */
+	bool rc_idle;		/* in the idle loop */
+	unsigned rc_gp;		/* last grace period reported for */
+};
+
+/* A list of callbacks, in order. */
+struct rcu_list {
+	struct rcu_head *rl_head;
+	struct rcu_head **rl_tail;
+};
+
+static struct spinlock rcu_lock = SPINLOCK_NAMED_INITIALIZER("rcu_lock");
+static struct rcu_cpu rcu_cpus[RCU_MAXCPUS];
+static volatile unsigned rcu_gp;	/* current/last grace period */
+static volatile bool rcu_gp_active;
+static unsigned rcu_pending;		/* CPUs yet to report */
+static struct rcu_list rcu_next = { NULL, &rcu_next.rl_head };
+static struct rcu_list rcu_wait = { NULL, &rcu_wait.rl_head };
+static struct rcu_list rcu_done = { NULL, &rcu_done.rl_head };
+
+////////////////////////////////////////////////////////////
+// Lists
+
+static
+void
+rcu_list_append(struct rcu_list *to, struct rcu_list *from)
+{
+	if (from->rl_head == NULL) {
+		return;
+	}
+	*to->rl_tail = from->rl_head;
+	to->rl_tail = from->rl_tail;
+	from->rl_head = NULL;
+	from->rl_tail = &from->rl_head;
+}
+
+////////////////////////////////////////////////////////////
+// Grace periods
+
+/*
+ * Start a grace period for the callbacks on rcu_next. Call with
+ * rcu_lock held and no grace period in progress.
+ */
+static
+void
+rcu_gp_start(void)
+{
+	unsigned i;
+
+	KASSERT(spinlock_do_i_hold(&rcu_lock));
+	KASSERT(!rcu_gp_active);
+	KASSERT(rcu_wait.rl_head == NULL);
+
+	rcu_list_append(&rcu_wait, &rcu_next);
+	rcu_gp++;
+	rcu_pending = 0;
+	for (i=0; i<RCU_MAXCPUS; i++) {
+		if (!rcu_cpus[i].rc_online) {
+			continue;
+		}
+		if (rcu_cpus[i].rc_idle) {
+			/* no readers there; nothing to wait for */
+			rcu_cpus[i].rc_gp = rcu_gp;
+		}
+		else {
+			rcu_pending++;
+		}
+	}
+	rcu_gp_active = true;
+	if (rcu_pending == 0) {
+		/* only possible with every CPU idle */
+		rcu_gp_active = false;
+		rcu_list_append(&rcu_done, &rcu_wait);
+	}
+}
+
+/*
+ * Record a quiescent state for CPU number CPUNUM. Call with rcu_lock
+ * held.
+ */
+static
+void
+rcu_report(unsigned cpunum)
+{
+	struct rcu_cpu *rc = &rcu_cpus[cpunum];
+
+	KASSERT(spinlock_do_i_hold(&rcu_lock));
+
+	if (!rcu_gp_active || rc->rc_gp == rcu_gp) {
+		return;
+	}
+	rc->rc_gp = rcu_gp;
+	KASSERT(rcu_pending > 0);
+	rcu_pending--;
+	if (rcu_pending == 0) {
+		rcu_gp_active = false;
+		rcu_list_append(&rcu_done, &rcu_wait);
+		if (rcu_next.rl_head != NULL) {
+			rcu_gp_start();
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////
+// Readers and writers
+
+void
+rcu_read_lock(void)
+{
+	KASSERT(!curthread->t_in_interrupt);
+	curthread->t_rcu_nest++;
+}
+
+void
+rcu_read_unlock(void)
+{
+	KASSERT(curthread->t_rcu_nest > 0);
+	curthread->t_rcu_nest--;
+}
+
+bool
+rcu_read_held(void)
+{
+	return curthread->t_rcu_nest > 0;
+}
+
+void
+call_rcu(struct rcu_head *rh, void (*func)(void *), void *arg)
+{
+	rh->rh_next = NULL;
+	rh->rh_func = func;
+	rh->rh_arg = arg;
+
+	spinlock_acquire(&rcu_lock);
+	*rcu_next.rl_tail = rh;
+	rcu_next.rl_tail = &rh->rh_next;
+	if (!rcu_gp_active) {
+		rcu_gp_start();
+	}
+	spinlock_release(&rcu_lock);
+}
+
+////////////////////////////////////////////////////////////
+// Thread system hooks
+
+void
+rcu_cpu_init(unsigned cpunum)
+{
+	if (cpunum >= RCU_MAXCPUS) {
+		panic("rcu: cpu %u out of range\n", cpunum);
+	}
+
+	spinlock_acquire(&rcu_lock);
+	/* not counted in any grace period already running */
+	rcu_cpus[cpunum].rc_gp = rcu_gp;
+	rcu_cpus[cpunum].rc_idle = false;
+	rcu_cpus[cpunum].rc_online = true;
+	spinlock_release(&rcu_lock);
+}
+
+void
+rcu_quiescent(void)
+{
+	unsigned cpunum = curcpu->c_number;
+
+	KASSERT(curthread->t_rcu_nest == 0);
+
+	if (!rcu_gp_active || rcu_cpus[cpunum].rc_gp == rcu_gp) {
+		return;
+	}
+	spinlock_acquire(&rcu_lock);
+	rcu_report(cpunum);
+	spinlock_release(&rcu_lock);
+}
+
+void
+rcu_idle_enter(void)
+{
+	unsigned cpunum = curcpu->c_number;
+
+	spinlock_acquire(&rcu_lock);
+	rcu_cpus[cpunum].rc_idle = true;
+	rcu_report(cpunum);
+	spinlock_release(&rcu_lock);
+}
+
+void
+rcu_idle_exit(void)
+{
+	unsigned cpunum = curcpu->c_number;
+
+	/*
+	 * Taking the lock orders this against rcu_gp_start: a grace
+	 * period that started while we were idle doesn't wait for us,
+	 * and that's fine, since any reader we run from here on
+	 * started after everything it covers was unlinked.
+	 */
+	spinlock_acquire(&rcu_lock);
+	rcu_cpus[cpunum].rc_idle = false;
+	spinlock_release(&rcu_lock);
+}
+
+void
+rcu_docallbacks(void)
+{
+	struct rcu_list done;
+	struct rcu_head *rh, *next;
+
+	if (rcu_done.rl_head == NULL) {
+		return;
+	}
+
+	done.rl_head = NULL;
+	done.rl_tail = &done.rl_head;
+	spinlock_acquire(&rcu_lock);
+	rcu_list_append(&done, &rcu_done);
+	spinlock_release(&rcu_lock);
+
+	for (rh = done.rl_head; rh != NULL; rh = next) {
+		next = rh->rh_next;
+		rh->rh_func(rh->rh_arg);
+	}
+}
@@ -0,0 +1,385 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * Scheduler latency statistics (see schedstat.h).
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <cpu.h>
+#include <spl.h>
+#include <current.h>
+#include <schedstat.h>
+
+struct schedstat_hist {
+	uint32_t sh_count;		/* total samples */
+	uint32_t sh_buckets[SCHEDSTAT_NBUCKETS];
+};
+
+struct schedstat_ent {
+	char se_name[SCHEDSTAT_NAMELEN];
+	bool se_used;
+	struct schedstat_hist se_hist;
+};
+
+struct schedstat_table {
+	struct schedstat_hist st_runwait;
+	struct schedstat_ent st_ents[SCHEDSTAT_NENTRIES];
+	uint32_t st_dropped;		/* sleeps with no room in the table */
+};
+
+/* Per-CPU tables, indexed by c_number. */
+static struct schedstat_table *schedstat_cpus[SCHEDSTAT_MAXCPUS];
+
+void
+schedstat_cpu_init(unsigned cpunum)
+{
+	struct schedstat_table *st;
+
+	KASSERT(cpunum < SCHEDSTAT_MAXCPUS);
+	st = kmalloc(sizeof(*st));
+	if (st == NULL) {
+		panic("schedstat: Out of memory\n");
+	}
+	bzero(st, sizeof(*st));
+	schedstat_cpus[cpunum] = st;
+}
+
+/*
+ * Add one sample of CYCLES to histogram SH.
+ */
+static
+void
+schedstat_add(struct schedstat_hist *sh, uint64_t cycles)
+{
+	unsigned b;
+
+	b = 0;
+	while (cycles > 1 && b < SCHEDSTAT_NBUCKETS - 1) {
+		cycles >>= 1;
+		b++;
+	}
+	sh->sh_count++;
+	sh->sh_buckets[b]++;
+}
+
+/*
+ * Does entry SE belong to wait channel name NAME? Only the first
+ * SCHEDSTAT_NAMELEN-1 characters count.
+ */
+static
+bool
+schedstat_match(const struct schedstat_ent *se, const char *name)
+{
+	unsigned i;
+
+	for (i=0; i < SCHEDSTAT_NAMELEN - 1; i++) {
+		if (se->se_name[i] != name[i]) {
+			return false;
+		}
+		if (name[i] == '\0') {
+			break;
+		}
+	}
+	return true;
+}
+
+/*
+ * Find (or make) the entry for NAME in table ST. Returns NULL if the
+ * table is full.
+ */
+static
+struct schedstat_ent *
+schedstat_lookup(struct schedstat_table *st, const char *name)
+{
+	struct schedstat_ent *se;
+	uint32_t hash;
+	unsigned i, n;
+
+	hash = 0;
+	for (i=0; i < SCHEDSTAT_NAMELEN - 1 && name[i] != '\0'; i++) {
+		hash = hash * 33 + (unsigned char)name[i];
+	}
+
+	for (n=0; n<SCHEDSTAT_NENTRIES; n++) {
+		se = &st->st_ents[(hash + n) & (SCHEDSTAT_NENTRIES - 1)];
+		if (!se->se_used) {
+			se->se_used = true;
+			for (i=0; i < SCHEDSTAT_NAMELEN - 1 &&
+				    name[i] != '\0'; i++) {
+				se->se_name[i] = name[i];
+			}
+			se->se_name[i] = '\0';
+			return se;
+		}
+		if (schedstat_match(se, name)) {
+			return se;
+		}
+	}
+	st->st_dropped++;
+	return NULL;
+}
+
+/*
+ * Get the current CPU's tables. Call with interrupts off, so we stay
+ * on this CPU while updating them.
+ */
+static
+struct schedstat_table *
+schedstat_get(void)
+{
+	if (!CURCPU_EXISTS()) {
+		return NULL;
+	}
+	return schedstat_cpus[curcpu->c_number];
+}
+
+void
+schedstat_runwait(uint64_t wait)
+{
+	struct schedstat_table *st;
+	int spl;
+
+	spl = splhigh();
+	st = schedstat_get();
+	if (st != NULL) {
+		schedstat_add(&st->st_runwait, wait);
+	}
+	splx(spl);
+}
+
+void
+schedstat_sleep(const char *name, uint64_t offcpu)
+{
+	struct schedstat_table *st;
+	struct schedstat_ent *se;
+	int spl;
+
+	spl = splhigh();
+	st = schedstat_get();
+	if (st != NULL) {
+		se = schedstat_lookup(st, name);
+		if (se != NULL) {
+			schedstat_add(&se->se_hist, offcpu);
+		}
+	}
+	splx(spl);
+}
+
+void
+schedstat_reset(void)
+{
+	unsigned i;
+	int spl;
+
+	for (i=0; i<SCHEDSTAT_MAXCPUS; i++) {
+		if (schedstat_cpus[i] != NULL) {
+			/* only our own CPU is held off; good enough */
+			spl = splhigh();
+			bzero(schedstat_cpus[i], sizeof(struct schedstat_table));
+			splx(spl);
+		}
+	}
+}
+
+/*
+ * Add the wait channel entries of all CPUs into SUM, which has room
+ * for MAX. Returns the number of merged entries; *DROPPED gets the
+ * total of sleeps not recorded.
+ */
+static
+unsigned
+schedstat_merge(struct schedstat_ent *sum, unsigned max, uint32_t *dropped)
+{
+	const struct schedstat_ent *se;
+	unsigned cpu, i, j, b, num;
+
+	num = 0;
+	*dropped = 0;
+	for (cpu=0; cpu<SCHEDSTAT_MAXCPUS; cpu++) {
+		if (schedstat_cpus[cpu] == NULL) {
+			continue;
+		}
+		*dropped += schedstat_cpus[cpu]->st_dropped;
+		for (i=0; i<SCHEDSTAT_NENTRIES; i++) {
+			se = &schedstat_cpus[cpu]->st_ents[i];
+			if (!se->se_used || se->se_hist.sh_count == 0) {
+				continue;
+			}
+			for (j=0; j<num; j++) {
+				if (schedstat_match(&sum[j], se->se_name)) {
+					break;
+				}
+			}
+			if (j == num) {
+				if (num == max) {
+					*dropped += se->se_hist.sh_count;
+					continue;
+				}
+				sum[num] = *se;
+				num++;
+				continue;
+			}
+			sum[j].se_hist.sh_count += se->se_hist.sh_count;
+			for (b=0; b<SCHEDSTAT_NBUCKETS; b++) {
+				sum[j].se_hist.sh_buckets[b] +=
+					se->se_hist.sh_buckets[b];
+			}
+		}
+	}
+	return num;
+}
+
+#define SCHEDSTAT_BARWIDTH 40
+
+/*
+ * Format histogram SH, titled TITLE, into BUF at *POS.
+ */
+static
+void
+schedstat_printhist(char *buf, size_t len, size_t *pos, const char *title,
+		    const struct schedstat_hist *sh)
+{
+	unsigned b, first, last, i, bar;
+	uint32_t max, lo;
+
+#define EMIT(...) \
+	do { \
+		if (*pos < len) { \
+			*pos += snprintf(buf + *pos, len - *pos, __VA_ARGS__); \
+		} \
+	} while (0)
+
+	EMIT("%s: %u samples\n", title, sh->sh_count);
+	if (sh->sh_count == 0) {
+		return;
+	}
+
+	first = SCHEDSTAT_NBUCKETS;
+	last = 0;
+	max = 0;
+	for (b=0; b<SCHEDSTAT_NBUCKETS; b++) {
+		if (sh->sh_buckets[b] == 0) {
+			continue;
+		}
+		if (first == SCHEDSTAT_NBUCKETS) {
+			first = b;
+		}
+		last = b;
+		if (sh->sh_buckets[b] > max) {
+			max = sh->sh_buckets[b];
+		}
+	}
+
+	for (b=first; b<=last; b++) {
+		lo = b == 0 ? 0 : 1U << b;
+		bar = (unsigned)((uint64_t)sh->sh_buckets[b] *
+				 SCHEDSTAT_BARWIDTH / max);
+		if (b == SCHEDSTAT_NBUCKETS - 1) {
+			EMIT("  %10u .. %-10s %10u |", lo, "",
+			     sh->sh_buckets[b]);
+		}
+		else {
+			EMIT("  %10u .. %-10u %10u |", lo, (2U << b) - 1,
+			     sh->sh_buckets[b]);
+		}
+		for (i=0; i<bar; i++) {
+			EMIT("*");
+		}
+		EMIT("\n");
+	}
+#undef EMIT
+}
+
+/*
+ * Format the report: each CPU's run-queue wait, then the off-CPU
+ * time of each wait channel name, busiest first.
+ */
+size_t
+schedstat_report(char *buf, size_t len)
+{
+	struct schedstat_ent *sum, tmp;
+	unsigned cpu, num, i, j, best;
+	uint32_t dropped;
+	char title[SCHEDSTAT_NAMELEN + 32];
+	size_t pos = 0;
+
+#define EMIT(...) \
+	do { \
+		if (pos < len) { \
+			pos += snprintf(buf + pos, len - pos, __VA_ARGS__); \
+		} \
+	} while (0)
+
+	KASSERT(len > 0);
+	buf[0] = '\0';
+
+	EMIT("Run-queue wait (cycles):\n");
+	for (cpu=0; cpu<SCHEDSTAT_MAXCPUS; cpu++) {
+		if (schedstat_cpus[cpu] == NULL) {
+			continue;
+		}
+		snprintf(title, sizeof(title), "cpu%u", cpu);
+		schedstat_printhist(buf, len, &pos, title,
+				    &schedstat_cpus[cpu]->st_runwait);
+	}
+
+	sum = kmalloc(SCHEDSTAT_NENTRIES * sizeof(*sum));
+	if (sum == NULL) {
+		EMIT("schedstat: Out of memory\n");
+		return pos < len ? pos : len - 1;
+	}
+	num = schedstat_merge(sum, SCHEDSTAT_NENTRIES, &dropped);
+
+	EMIT("\nOff-CPU time by wait channel (cycles):\n");
+	for (i=0; i<num; i++) {
+		best = i;
+		for (j=i+1; j<num; j++) {
+			if (sum[j].se_hist.sh_count >
+			    sum[best].se_hist.sh_count) {
+				best = j;
+			}
+		}
+		tmp = sum[i];
+		sum[i] = sum[best];
+		sum[best] = tmp;
+
+		schedstat_printhist(buf, len, &pos, sum[i].se_name,
+				    &sum[i].se_hist);
+	}
+	if (dropped > 0) {
+		EMIT("(%u sleeps not recorded: tables full)\n", dropped);
+	}
+#undef EMIT
+
+	kfree(sum);
+	return pos < len ? pos : len - 1;
+}
@@ -38,11 +38,22 @@
 #include <spinlock.h>
 #include <membar.h>
 #include <current.h>	/* for curcpu */
+#include <lockstat.h>
 
 /*
  * Spinlocks.
  */
 
+/*
+ * Backoff, in cycles. A plain spinlock that loses a test-and-set
+ * race waits BACKOFF_MIN, then twice that, and so on up to
+ * BACKOFF_MAX. A queued spinlock waits TICKET_DELAY for each CPU
+ * ahead of it in line.
+ */
+#define SPINLOCK_BACKOFF_MIN	16
+#define SPINLOCK_BACKOFF_MAX	1024
+#define SPINLOCK_TICKET_DELAY	64
+
 
 /*
  * Initialize spinlock.
@@ -52,6 +63,22 @@ spinlock_init(struct spinlock *splk)
 {
 	spinlock_data_set(&splk->splk_lock, 0);
 	splk->splk_holder = NULL;
+	splk->splk_queued = false;
+#if OPT_LOCKSTAT
+	splk->splk_name = NULL;
+	splk->splk_site = 0;
+	splk->splk_stamp = 0;
+#endif
+}
+
+/*
+ * Initialize a queued spinlock.
+ */
+void
+spinlock_init_queued(struct spinlock *splk)
+{
+	spinlock_init(splk);
+	splk->splk_queued = true;
 }
 
 /*
@@ -60,8 +87,108 @@ spinlock_init(struct spinlock *splk)
 void
 spinlock_cleanup(struct spinlock *splk)
 {
+	spinlock_data_t val;
+
 	KASSERT(splk->splk_holder == NULL);
-	KASSERT(spinlock_data_get(&splk->splk_lock) == 0);
+	val = spinlock_data_get(&splk->splk_lock);
+	if (splk->splk_queued) {
+		/* nobody holding a ticket */
+		KASSERT((val >> SPINLOCK_TICKET_SHIFT) ==
+			(val & SPINLOCK_TICKET_MASK));
+	}
+	else {
+		KASSERT(val == 0);
+	}
+}
+
+/*
+ * Spin for about CYCLES cycles without touching memory shared with
+ * other CPUs. The count is monotonic, so a clock tick in the middle
+ * doesn't cut this short.
+ */
+void
+spinlock_delay(uint32_t cycles)
+{
+	uint64_t start;
+
+	start = cpu_cycles();
+	while (cpu_cycles() - start < cycles) {
+		/* nothing */
+	}
+}
+
+/*
+ * Wait for and take a plain spinlock. Returns true if it had to
+ * wait.
+ */
+static
+bool
+spinlock_get_plain(struct spinlock *splk)
+{
+	uint32_t backoff = SPINLOCK_BACKOFF_MIN;
+	bool contended = false;
+
+	while (1) {
+		/*
+		 * Do test-test-and-set, that is, read first before
+		 * doing test-and-set, to reduce bus contention.
+		 *
+		 * Test-and-set is a machine-level atomic operation
+		 * that writes 1 into the lock word and returns the
+		 * previous value. If that value was 0, the lock was
+		 * previously unheld and we now own it. If it was 1,
+		 * we don't.
+		 *
+		 * If the test-and-set fails after the read said the
+		 * lock was free, someone else got in between us;
+		 * back off rather than pile straight back onto the
+		 * lock word with everyone else who lost.
+		 */
+		if (spinlock_data_get(&splk->splk_lock) != 0) {
+			contended = true;
+			continue;
+		}
+		if (spinlock_data_testandset(&splk->splk_lock) != 0) {
+			contended = true;
+			spinlock_delay(backoff);
+			if (backoff < SPINLOCK_BACKOFF_MAX) {
+				backoff *= 2;
+			}
+			continue;
+		}
+		return contended;
+	}
+}
+
+/*
+ * Take a ticket for a queued spinlock and wait for our turn. Returns
+ * true if it had to wait.
+ */
+static
+bool
+spinlock_get_queued(struct spinlock *splk)
+{
+	spinlock_data_t val;
+	unsigned ticket, ahead;
+	bool contended = false;
+
+	/* Take the next ticket. */
+	do {
+		val = spinlock_data_get(&splk->splk_lock);
+	} while (!spinlock_data_compareandswap(&splk->splk_lock, val,
+				val + (1U << SPINLOCK_TICKET_SHIFT)));
+	ticket = val >> SPINLOCK_TICKET_SHIFT;
+
+	/* Wait until it's served. */
+	while (1) {
+		val = spinlock_data_get(&splk->splk_lock);
+		ahead = (ticket - val) & SPINLOCK_TICKET_MASK;
+		if (ahead == 0) {
+			return contended;
+		}
+		contended = true;
+		spinlock_delay(ahead * SPINLOCK_TICKET_DELAY);
+	}
 }
 
 /*
@@ -75,6 +202,10 @@ void
 spinlock_acquire(struct spinlock *splk)
 {
 	struct cpu *mycpu;
+	bool contended;
+#if OPT_LOCKSTAT
+	uint64_t start;
+#endif
 
 	splraise(IPL_NONE, IPL_HIGH);
 
@@ -90,28 +221,49 @@ spinlock_acquire(struct spinlock *splk)
 		mycpu = NULL;
 	}
 
-	while (1) {
-		/*
-		 * Do test-test-and-set, that is, read first before
-		 * doing test-and-set, to reduce bus contention.
-		 *
-		 * Test-and-set is a machine-level atomic operation
-		 * that writes 1 into the lock word and returns the
-		 * previous value. If that value was 0, the lock was
-		 * previously unheld and we now own it. If it was 1,
-		 * we don't.
-		 */
-		if (spinlock_data_get(&splk->splk_lock) != 0) {
-			continue;
-		}
-		if (spinlock_data_testandset(&splk->splk_lock) != 0) {
-			continue;
-		}
-		break;
+#if OPT_LOCKSTAT
+	start = cpu_cycles();
+#endif
+	if (splk->splk_queued) {
+		contended = spinlock_get_queued(splk);
+	}
+	else {
+		contended = spinlock_get_plain(splk);
 	}
 
 	membar_store_any();
 	splk->splk_holder = mycpu;
+
+#if OPT_LOCKSTAT
+	if (mycpu != NULL) {
+		splk->splk_site = (vaddr_t)__builtin_return_address(0);
+		splk->splk_stamp = cpu_cycles();
+		lockstat_acquire(LOCKSTAT_SPIN, splk->splk_name,
+				 splk->splk_site, contended,
+				 splk->splk_stamp - start);
+	}
+#else
+	(void)contended;
+#endif
+}
+
+/*
+ * Serve the next ticket of a queued spinlock. Other CPUs may be
+ * taking tickets (changing the high half) at the same time, so this
+ * needs compare-and-swap rather than a plain store.
+ */
+static
+void
+spinlock_release_queued(struct spinlock *splk)
+{
+	spinlock_data_t val, serving;
+
+	do {
+		val = spinlock_data_get(&splk->splk_lock);
+		serving = (val + 1) & SPINLOCK_TICKET_MASK;
+	} while (!spinlock_data_compareandswap(&splk->splk_lock, val,
+				(val & ~(spinlock_data_t)SPINLOCK_TICKET_MASK)
+				| serving));
 }
 
 /*
@@ -125,11 +277,20 @@ spinlock_release(struct spinlock *splk)
 		KASSERT(splk->splk_holder == curcpu->c_self);
 		KASSERT(curcpu->c_spinlocks > 0);
 		curcpu->c_spinlocks--;
+#if OPT_LOCKSTAT
+		lockstat_hold(LOCKSTAT_SPIN, splk->splk_name, splk->splk_site,
+			      cpu_cycles() - splk->splk_stamp);
+#endif
 	}
 
 	splk->splk_holder = NULL;
 	membar_any_store();
-	spinlock_data_set(&splk->splk_lock, 0);
+	if (splk->splk_queued) {
+		spinlock_release_queued(splk);
+	}
+	else {
+		spinlock_data_set(&splk->splk_lock, 0);
+	}
 	spllower(IPL_HIGH, IPL_NONE);
 }
 
@@ -146,3 +307,17 @@ spinlock_do_i_hold(struct spinlock *splk)
 	/* Assume we can read splk_holder atomically enough for this to work */
 	return (splk->splk_holder == curcpu->c_self);
 }
+
+/*
+ * Name the lock for lockstat.
+ */
+void
+spinlock_setname(struct spinlock *splk, const char *name)
+{
+#if OPT_LOCKSTAT
+	splk->splk_name = name;
+#else
+	(void)splk;
+	(void)name;
+#endif
+}
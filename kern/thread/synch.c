@@ -33,11 +33,16 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
 #include <lib.h>
 #include <spinlock.h>
 #include <wchan.h>
 #include <thread.h>
 #include <current.h>
+#include <membar.h>
+#include <cpu.h>
+#include <lockstat.h>
+#include <timeout.h>
 #include <synch.h>
 
 ////////////////////////////////////////////////////////////
@@ -68,6 +73,7 @@ sem_create(const char *name, unsigned initial_count)
 	}
 
 	spinlock_init(&sem->sem_lock);
+	spinlock_setname(&sem->sem_lock, sem->sem_name);
         sem->sem_count = initial_count;
 
         return sem;
@@ -154,7 +160,22 @@ lock_create(const char *name)
                 return NULL;
         }
 
-        // add stuff here as needed
+	lock->lk_wchan = wchan_create(lock->lk_name);
+	if (lock->lk_wchan == NULL) {
+		kfree(lock->lk_name);
+		kfree(lock);
+		return NULL;
+	}
+
+	spinlock_data_set(&lock->lk_busy, 0);
+	lock->lk_holder = NULL;
+	lock->lk_holdcpu = NULL;
+	lock->lk_nwaiters = 0;
+#if OPT_LOCKSTAT
+	lock->lk_stamp = 0;
+#endif
+	spinlock_init(&lock->lk_spinlock);
+	spinlock_setname(&lock->lk_spinlock, lock->lk_name);
 
         return lock;
 }
@@ -163,37 +184,229 @@ void
 lock_destroy(struct lock *lock)
 {
         KASSERT(lock != NULL);
+	KASSERT(lock->lk_holder == NULL);
+	KASSERT(lock->lk_nwaiters == 0);
 
-        // add stuff here as needed
-
+	/* wchan_cleanup will assert if anyone's waiting on it */
+	spinlock_cleanup(&lock->lk_spinlock);
+	wchan_destroy(lock->lk_wchan);
         kfree(lock->lk_name);
         kfree(lock);
 }
 
+/*
+ * Number of times an acquirer polls the lock while the holder is
+ * running elsewhere before giving up and going to sleep. This should
+ * be about the cost of a sleep and wakeup, in polls.
+ */
+#define LOCK_MAXSPIN  1000
+
+/*
+ * Try once to take the lock.
+ */
+static
+inline
+bool
+lock_tryget(struct lock *lock)
+{
+	if (spinlock_data_testandset(&lock->lk_busy) != 0) {
+		return false;
+	}
+	lock->lk_holder = curthread;
+	lock->lk_holdcpu = curcpu->c_self;
+	return true;
+}
+
+#if OPT_LOCKSTAT
+/*
+ * Account an acquisition that started at cycle count START.
+ */
+static
+void
+lock_stat_acquired(struct lock *lock, bool contended, uint64_t start)
+{
+	lock->lk_stamp = cpu_cycles();
+	lockstat_acquire(LOCKSTAT_SLEEP, lock->lk_name, 0, contended,
+			 lock->lk_stamp - start);
+}
+#endif
+
+/*
+ * Slow path: sleep until we get the lock. Called with lk_spinlock
+ * held and the caller already counted in lk_nwaiters; returns with
+ * the lock held and neither of those.
+ */
+static
+void
+lock_sleepget(struct lock *lock)
+{
+	KASSERT(spinlock_do_i_hold(&lock->lk_spinlock));
+
+	membar_any_any();
+	while (!lock_tryget(lock)) {
+		wchan_sleep(lock->lk_wchan, &lock->lk_spinlock);
+	}
+	KASSERT(lock->lk_nwaiters > 0);
+	lock->lk_nwaiters--;
+	spinlock_release(&lock->lk_spinlock);
+}
+
+/*
+ * Spin while the holder is on a CPU. A holder that hasn't filled in
+ * lk_holder yet counts as running. Returns true if we got the lock.
+ */
+static
+bool
+lock_spinget(struct lock *lock)
+{
+	struct thread *holder;
+	struct cpu *holdcpu;
+	unsigned spins;
+
+	for (spins = 0; spins < LOCK_MAXSPIN; spins++) {
+		holder = lock->lk_holder;
+		holdcpu = lock->lk_holdcpu;
+		if (holder != NULL && holdcpu != NULL &&
+		    (holdcpu == curcpu->c_self ||
+		     holdcpu->c_curthread != holder)) {
+			break;
+		}
+		if (spinlock_data_get(&lock->lk_busy) == 0 &&
+		    lock_tryget(lock)) {
+			return true;
+		}
+	}
+	return false;
+}
+
 void
 lock_acquire(struct lock *lock)
 {
-        // Write this
+#if OPT_LOCKSTAT
+	uint64_t start = cpu_cycles();
+#endif
+
+	KASSERT(lock != NULL);
+	KASSERT(curthread->t_in_interrupt == false);
+	KASSERT(!lock_do_i_hold(lock));
+
+	/* Fast path: free. */
+	if (lock_tryget(lock)) {
+#if OPT_LOCKSTAT
+		lock_stat_acquired(lock, false, start);
+#endif
+		return;
+	}
+
+	if (lock_spinget(lock)) {
+#if OPT_LOCKSTAT
+		lock_stat_acquired(lock, true, start);
+#endif
+		return;
+	}
+
+	/*
+	 * Sleep. lk_nwaiters goes up before we look at lk_busy again,
+	 * and lock_release clears lk_busy before it looks at
+	 * lk_nwaiters, so one of us sees the other: either we get
+	 * the lock here or the release comes to wake us, which it
+	 * can't do until we're on the wchan.
+	 */
+	spinlock_acquire(&lock->lk_spinlock);
+	lock->lk_nwaiters++;
+	lock_sleepget(lock);
+#if OPT_LOCKSTAT
+	lock_stat_acquired(lock, true, start);
+#endif
+}
+
+/*
+ * As lock_acquire, but sleep for at most TICKS ticks in all. A waiter
+ * that times out has one more try for the lock before giving up,
+ * since the release that might have woken it may have found it
+ * already off the wchan.
+ */
+int
+lock_acquire_timeout(struct lock *lock, unsigned ticks)
+{
+	uint64_t deadline, now;
+#if OPT_LOCKSTAT
+	uint64_t start = cpu_cycles();
+#endif
+
+	KASSERT(lock != NULL);
+	KASSERT(curthread->t_in_interrupt == false);
+	KASSERT(!lock_do_i_hold(lock));
+
+	if (lock_tryget(lock)) {
+#if OPT_LOCKSTAT
+		lock_stat_acquired(lock, false, start);
+#endif
+		return 0;
+	}
+	if (lock_spinget(lock)) {
+#if OPT_LOCKSTAT
+		lock_stat_acquired(lock, true, start);
+#endif
+		return 0;
+	}
 
-        (void)lock;  // suppress warning until code gets written
+	deadline = timeout_now() + ticks;
+
+	/* As in lock_acquire, count ourselves before looking again. */
+	spinlock_acquire(&lock->lk_spinlock);
+	lock->lk_nwaiters++;
+	membar_any_any();
+	while (!lock_tryget(lock)) {
+		now = timeout_now();
+		if (now >= deadline ||
+		    wchan_sleep_timeout(lock->lk_wchan, &lock->lk_spinlock,
+					deadline - now) == ETIMEDOUT) {
+			if (lock_tryget(lock)) {
+				break;
+			}
+			KASSERT(lock->lk_nwaiters > 0);
+			lock->lk_nwaiters--;
+			spinlock_release(&lock->lk_spinlock);
+			return ETIMEDOUT;
+		}
+	}
+	KASSERT(lock->lk_nwaiters > 0);
+	lock->lk_nwaiters--;
+	spinlock_release(&lock->lk_spinlock);
+#if OPT_LOCKSTAT
+	lock_stat_acquired(lock, true, start);
+#endif
+	return 0;
 }
 
 void
 lock_release(struct lock *lock)
 {
-        // Write this
-
-        (void)lock;  // suppress warning until code gets written
+	KASSERT(lock != NULL);
+	KASSERT(lock_do_i_hold(lock));
+
+#if OPT_LOCKSTAT
+	lockstat_hold(LOCKSTAT_SLEEP, lock->lk_name, 0,
+		      cpu_cycles() - lock->lk_stamp);
+#endif
+	lock->lk_holder = NULL;
+	lock->lk_holdcpu = NULL;
+	membar_any_store();
+	spinlock_data_set(&lock->lk_busy, 0);
+	membar_any_any();
+
+	if (lock->lk_nwaiters > 0) {
+		spinlock_acquire(&lock->lk_spinlock);
+		wchan_wakeone(lock->lk_wchan, &lock->lk_spinlock);
+		spinlock_release(&lock->lk_spinlock);
+	}
 }
 
 bool
 lock_do_i_hold(struct lock *lock)
 {
-        // Write this
-
-        (void)lock;  // suppress warning until code gets written
-
-        return true; // dummy until code gets written
+	return lock->lk_holder == curthread;
 }
 
 ////////////////////////////////////////////////////////////
@@ -217,7 +430,14 @@ cv_create(const char *name)
                 return NULL;
         }
 
-        // add stuff here as needed
+	cv->cv_wchan = wchan_create(cv->cv_name);
+	if (cv->cv_wchan == NULL) {
+		kfree(cv->cv_name);
+		kfree(cv);
+		return NULL;
+	}
+	spinlock_init(&cv->cv_spinlock);
+	spinlock_setname(&cv->cv_spinlock, cv->cv_name);
 
         return cv;
 }
@@ -227,8 +447,9 @@ cv_destroy(struct cv *cv)
 {
         KASSERT(cv != NULL);
 
-        // add stuff here as needed
-
+	/* wchan_cleanup will assert if anyone's waiting on it */
+	spinlock_cleanup(&cv->cv_spinlock);
+	wchan_destroy(cv->cv_wchan);
         kfree(cv->cv_name);
         kfree(cv);
 }
@@ -236,23 +457,246 @@ cv_destroy(struct cv *cv)
 void
 cv_wait(struct cv *cv, struct lock *lock)
 {
-        // Write this
-        (void)cv;    // suppress warning until code gets written
-        (void)lock;  // suppress warning until code gets written
+	KASSERT(cv != NULL);
+	KASSERT(lock_do_i_hold(lock));
+
+	/*
+	 * Get on the CV before letting go of the lock, so a signal
+	 * (which needs the lock) can't come in between. We only
+	 * wake up once cv_signal/cv_broadcast has moved us to the
+	 * lock's wchan and lock_release has woken us from there; by
+	 * then we are counted in lk_nwaiters, so finish taking the
+	 * lock the way a sleeping lock_acquire does.
+	 */
+	spinlock_acquire(&cv->cv_spinlock);
+	lock_release(lock);
+	wchan_sleep(cv->cv_wchan, &cv->cv_spinlock);
+	spinlock_release(&cv->cv_spinlock);
+
+	spinlock_acquire(&lock->lk_spinlock);
+	lock_sleepget(lock);
+#if OPT_LOCKSTAT
+	/* the time asleep is charged to the CV's wchan, not the lock */
+	lock_stat_acquired(lock, false, 0);
+#endif
+}
+
+/*
+ * As cv_wait, but stop waiting for a signal after TICKS ticks. The
+ * lock is retaken either way. A waiter that times out was never
+ * moved to the lock's wchan, so it counts itself in lk_nwaiters
+ * like a fresh acquirer; one that was moved has been signalled,
+ * however long it then waits for the lock.
+ */
+int
+cv_wait_timeout(struct cv *cv, struct lock *lock, unsigned ticks)
+{
+	int result;
+
+	KASSERT(cv != NULL);
+	KASSERT(lock_do_i_hold(lock));
+
+	spinlock_acquire(&cv->cv_spinlock);
+	lock_release(lock);
+	result = wchan_sleep_timeout(cv->cv_wchan, &cv->cv_spinlock, ticks);
+	spinlock_release(&cv->cv_spinlock);
+
+	spinlock_acquire(&lock->lk_spinlock);
+	if (result) {
+		lock->lk_nwaiters++;
+	}
+	lock_sleepget(lock);
+#if OPT_LOCKSTAT
+	lock_stat_acquired(lock, false, 0);
+#endif
+	return result;
+}
+
+/*
+ * Common code for signal and broadcast: move one or all waiters to
+ * LOCK's wait channel.
+ */
+static
+void
+cv_morph(struct cv *cv, struct lock *lock, bool all)
+{
+	unsigned n;
+
+	KASSERT(cv != NULL);
+	KASSERT(lock_do_i_hold(lock));
+
+	spinlock_acquire(&cv->cv_spinlock);
+	spinlock_acquire(&lock->lk_spinlock);
+	if (all) {
+		n = wchan_moveall(cv->cv_wchan, &cv->cv_spinlock,
+				  lock->lk_wchan, &lock->lk_spinlock);
+	}
+	else {
+		n = wchan_moveone(cv->cv_wchan, &cv->cv_spinlock,
+				  lock->lk_wchan, &lock->lk_spinlock);
+	}
+	lock->lk_nwaiters += n;
+	spinlock_release(&lock->lk_spinlock);
+	spinlock_release(&cv->cv_spinlock);
 }
 
 void
 cv_signal(struct cv *cv, struct lock *lock)
 {
-        // Write this
-	(void)cv;    // suppress warning until code gets written
-	(void)lock;  // suppress warning until code gets written
+	cv_morph(cv, lock, false);
 }
 
 void
 cv_broadcast(struct cv *cv, struct lock *lock)
 {
-	// Write this
-	(void)cv;    // suppress warning until code gets written
-	(void)lock;  // suppress warning until code gets written
+	cv_morph(cv, lock, true);
+}
+
+////////////////////////////////////////////////////////////
+//
+// Reader-writer lock
+
+struct rwlock *
+rwlock_create(const char *name)
+{
+	struct rwlock *rw;
+
+	rw = kmalloc(sizeof(*rw));
+	if (rw == NULL) {
+		return NULL;
+	}
+
+	rw->rw_name = kstrdup(name);
+	if (rw->rw_name == NULL) {
+		goto fail_rw;
+	}
+	rw->rw_rwchan = wchan_create(rw->rw_name);
+	if (rw->rw_rwchan == NULL) {
+		goto fail_name;
+	}
+	rw->rw_wwchan = wchan_create(rw->rw_name);
+	if (rw->rw_wwchan == NULL) {
+		goto fail_rwchan;
+	}
+
+	spinlock_init(&rw->rw_spinlock);
+	spinlock_setname(&rw->rw_spinlock, rw->rw_name);
+	rw->rw_readers = 0;
+	rw->rw_writer = NULL;
+	rw->rw_rwaiting = 0;
+	rw->rw_wwaiting = 0;
+	rw->rw_batch = 0;
+
+	return rw;
+
+ fail_rwchan:
+	wchan_destroy(rw->rw_rwchan);
+ fail_name:
+	kfree(rw->rw_name);
+ fail_rw:
+	kfree(rw);
+	return NULL;
+}
+
+void
+rwlock_destroy(struct rwlock *rw)
+{
+	KASSERT(rw != NULL);
+	KASSERT(rw->rw_readers == 0);
+	KASSERT(rw->rw_writer == NULL);
+
+	/* wchan_cleanup will assert if anyone's waiting on it */
+	spinlock_cleanup(&rw->rw_spinlock);
+	wchan_destroy(rw->rw_wwchan);
+	wchan_destroy(rw->rw_rwchan);
+	kfree(rw->rw_name);
+	kfree(rw);
+}
+
+void
+rwlock_acquire_read(struct rwlock *rw)
+{
+	KASSERT(rw != NULL);
+	KASSERT(curthread->t_in_interrupt == false);
+
+	spinlock_acquire(&rw->rw_spinlock);
+	KASSERT(rw->rw_writer != curthread);
+	/* wait out the writer, and let waiting writers go first */
+	while (rw->rw_writer != NULL ||
+	       (rw->rw_wwaiting > 0 && rw->rw_batch == 0)) {
+		rw->rw_rwaiting++;
+		wchan_sleep(rw->rw_rwchan, &rw->rw_spinlock);
+		rw->rw_rwaiting--;
+	}
+	if (rw->rw_batch > 0) {
+		rw->rw_batch--;
+	}
+	rw->rw_readers++;
+	spinlock_release(&rw->rw_spinlock);
+}
+
+void
+rwlock_release_read(struct rwlock *rw)
+{
+	KASSERT(rw != NULL);
+
+	spinlock_acquire(&rw->rw_spinlock);
+	KASSERT(rw->rw_readers > 0);
+	rw->rw_readers--;
+	if (rw->rw_readers == 0 && rw->rw_batch == 0 && rw->rw_wwaiting > 0) {
+		wchan_wakeone(rw->rw_wwchan, &rw->rw_spinlock);
+	}
+	spinlock_release(&rw->rw_spinlock);
+}
+
+void
+rwlock_acquire_write(struct rwlock *rw)
+{
+	KASSERT(rw != NULL);
+	KASSERT(curthread->t_in_interrupt == false);
+
+	spinlock_acquire(&rw->rw_spinlock);
+	KASSERT(rw->rw_writer != curthread);
+	rw->rw_wwaiting++;
+	while (rw->rw_writer != NULL || rw->rw_readers > 0 ||
+	       rw->rw_batch > 0) {
+		wchan_sleep(rw->rw_wwchan, &rw->rw_spinlock);
+	}
+	rw->rw_wwaiting--;
+	rw->rw_writer = curthread;
+	spinlock_release(&rw->rw_spinlock);
+}
+
+void
+rwlock_release_write(struct rwlock *rw)
+{
+	KASSERT(rw != NULL);
+
+	spinlock_acquire(&rw->rw_spinlock);
+	KASSERT(rw->rw_writer == curthread);
+	rw->rw_writer = NULL;
+	if (rw->rw_rwaiting > 0) {
+		/*
+		 * Readers are waiting. If a writer is too, only let in
+		 * a bounded batch of the readers before it; otherwise
+		 * they can all go.
+		 */
+		if (rw->rw_wwaiting > 0) {
+			rw->rw_batch = rw->rw_rwaiting;
+			if (rw->rw_batch > RWLOCK_MAXBATCH) {
+				rw->rw_batch = RWLOCK_MAXBATCH;
+			}
+		}
+		wchan_wakeall(rw->rw_rwchan, &rw->rw_spinlock);
+	}
+	else if (rw->rw_wwaiting > 0) {
+		wchan_wakeone(rw->rw_wwchan, &rw->rw_spinlock);
+	}
+	spinlock_release(&rw->rw_spinlock);
+}
+
+bool
+rwlock_do_i_hold_write(struct rwlock *rw)
+{
+	return rw->rw_writer == curthread;
 }
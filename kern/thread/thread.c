@@ -48,8 +48,15 @@
 #include <current.h>
 #include <synch.h>
 #include <addrspace.h>
+#include <clock.h>
 #include <mainbus.h>
 #include <vnode.h>
+#include <sysstat.h>
+#include <lockstat.h>
+#include <schedstat.h>
+#include <timeout.h>
+#include <slab.h>
+#include <rcu.h>
 
 
 /* Magic number used as a guard value on kernel thread stacks. */
@@ -108,6 +115,123 @@ thread_checkstack(struct thread *thread)
 	}
 }
 
+/*
+ * Kernel stacks of exited threads are kept in a small per-cpu pool
+ * and handed to the next thread forked on that cpu, which saves a
+ * trip to the page allocator on each thread lifetime. A stack goes
+ * into the pool only with its magic numbers intact, so a pooled stack
+ * needs no thread_checkstack_init; only new stacks get one.
+ *
+ * The pool lock is there for thread_stackpool_reclaim. Normally only
+ * the cpu itself touches its pool, and if we migrate between reading
+ * curcpu and taking the lock, the lock still keeps things right.
+ */
+static
+int
+thread_stack_get(struct thread *thread)
+{
+	struct cpu *c = curcpu->c_self;
+
+	spinlock_acquire(&c->c_stackpool_lock);
+	if (c->c_numstacks > 0) {
+		thread->t_stack = c->c_stackpool[--c->c_numstacks];
+		spinlock_release(&c->c_stackpool_lock);
+		thread_checkstack(thread);
+		return 0;
+	}
+	spinlock_release(&c->c_stackpool_lock);
+
+	thread->t_stack = kmalloc(STACK_SIZE);
+	if (thread->t_stack == NULL) {
+		return ENOMEM;
+	}
+	thread_checkstack_init(thread);
+	return 0;
+}
+
+/*
+ * Give back a thread's stack: to the pool if there is room, else to
+ * kfree.
+ */
+static
+void
+thread_stack_put(struct thread *thread)
+{
+	struct cpu *c = curcpu->c_self;
+	void *stack = thread->t_stack;
+
+	thread_checkstack(thread);
+	thread->t_stack = NULL;
+
+	spinlock_acquire(&c->c_stackpool_lock);
+	if (c->c_numstacks < STACKPOOL_MAX) {
+		c->c_stackpool[c->c_numstacks++] = stack;
+		stack = NULL;
+	}
+	spinlock_release(&c->c_stackpool_lock);
+
+	if (stack != NULL) {
+		kfree(stack);
+	}
+}
+
+/*
+ * Empty every cpu's stack pool.
+ */
+unsigned
+thread_stackpool_reclaim(void)
+{
+	void *stacks[STACKPOOL_MAX];
+	struct cpu *c;
+	unsigned i, j, n, total;
+
+	total = 0;
+	for (i=0; i < cpuarray_num(&allcpus); i++) {
+		c = cpuarray_get(&allcpus, i);
+
+		spinlock_acquire(&c->c_stackpool_lock);
+		n = c->c_numstacks;
+		for (j=0; j<n; j++) {
+			stacks[j] = c->c_stackpool[j];
+		}
+		c->c_numstacks = 0;
+		spinlock_release(&c->c_stackpool_lock);
+
+		for (j=0; j<n; j++) {
+			kfree(stacks[j]);
+		}
+		total += n;
+	}
+	return total;
+}
+
+/*
+ * Thread structures come from a cache, with their list node and
+ * machine-dependent part left set up between uses.
+ */
+static struct kmem_cache *thread_cache;
+
+static
+int
+thread_ctor(void *obj)
+{
+	struct thread *thread = obj;
+
+	thread_machdep_init(&thread->t_machdep);
+	threadlistnode_init(&thread->t_listnode, thread);
+	return 0;
+}
+
+static
+void
+thread_dtor(void *obj)
+{
+	struct thread *thread = obj;
+
+	threadlistnode_cleanup(&thread->t_listnode);
+	thread_machdep_cleanup(&thread->t_machdep);
+}
+
 /*
  * Create a thread. This is used both to create a first thread
  * for each CPU and to create subsequent forked threads.
@@ -120,32 +244,38 @@ thread_create(const char *name)
 
 	DEBUGASSERT(name != NULL);
 
-	thread = kmalloc(sizeof(*thread));
+	thread = kmem_cache_alloc(thread_cache);
 	if (thread == NULL) {
 		return NULL;
 	}
 
 	thread->t_name = kstrdup(name);
 	if (thread->t_name == NULL) {
-		kfree(thread);
+		kmem_cache_free(thread_cache, thread);
 		return NULL;
 	}
 	thread->t_wchan_name = "NEW";
+	thread->t_wchan = NULL;
 	thread->t_state = S_READY;
 
-	/* Thread subsystem fields */
-	thread_machdep_init(&thread->t_machdep);
-	threadlistnode_init(&thread->t_listnode, thread);
+	/* Thread subsystem fields (t_machdep, t_listnode: thread_ctor) */
 	thread->t_stack = NULL;
 	thread->t_context = NULL;
 	thread->t_cpu = NULL;
 	thread->t_proc = NULL;
+	thread->t_level = 0;
+	thread->t_ticks = 0;
+	thread->t_lastrun = 0;
 
 	/* Interrupt state fields */
 	thread->t_in_interrupt = false;
 	thread->t_curspl = IPL_HIGH;
 	thread->t_iplhigh_count = 1; /* corresponding to t_curspl */
 
+	/* Public fields */
+	thread->t_vfsshared = 0;
+	thread->t_rcu_nest = 0;
+
 	/* If you add to struct thread, be sure to initialize here */
 
 	return thread;
@@ -164,6 +294,7 @@ cpu_create(unsigned hardware_number)
 {
 	struct cpu *c;
 	int result;
+	unsigned i;
 	char namebuf[16];
 
 	c = kmalloc(sizeof(*c));
@@ -177,20 +308,38 @@ cpu_create(unsigned hardware_number)
 	c->c_curthread = NULL;
 	threadlist_init(&c->c_zombies);
 	c->c_hardclocks = 0;
+	c->c_tickless = false;
 	c->c_spinlocks = 0;
 
 	c->c_isidle = false;
-	threadlist_init(&c->c_runqueue);
+	for (i=0; i<SCHED_NLEVELS; i++) {
+		threadlist_init(&c->c_runqueue[i]);
+	}
 	spinlock_init(&c->c_runqueue_lock);
+	spinlock_setname(&c->c_runqueue_lock, "c_runqueue_lock");
+
+	c->c_numstacks = 0;
+	spinlock_init(&c->c_stackpool_lock);
+	spinlock_setname(&c->c_stackpool_lock, "c_stackpool_lock");
 
 	c->c_ipi_pending = 0;
 	c->c_numshootdown = 0;
 	spinlock_init(&c->c_ipi_lock);
+	spinlock_setname(&c->c_ipi_lock, "c_ipi_lock");
 
 	result = cpuarray_add(&allcpus, c, &c->c_number);
 	if (result != 0) {
 		panic("cpu_create: array_add: %s\n", strerror(result));
 	}
+	sysstat_cpu_init(c->c_number);
+	kmalloc_cpu_init(c->c_number);
+	rcu_cpu_init(c->c_number);
+#if OPT_LOCKSTAT
+	lockstat_cpu_init(c->c_number);
+#endif
+#if OPT_SCHEDSTAT
+	schedstat_cpu_init(c->c_number);
+#endif
 
 	snprintf(namebuf, sizeof(namebuf), "<boot #%d>", c->c_number);
 	c->c_curthread = thread_create(namebuf);
@@ -272,16 +421,17 @@ thread_destroy(struct thread *thread)
 	/* Thread subsystem fields */
 	KASSERT(thread->t_proc == NULL);
 	if (thread->t_stack != NULL) {
-		kfree(thread->t_stack);
+		thread_stack_put(thread);
 	}
-	threadlistnode_cleanup(&thread->t_listnode);
-	thread_machdep_cleanup(&thread->t_machdep);
+	/* t_listnode and t_machdep go back as thread_ctor left them */
+	KASSERT(thread->t_listnode.tln_prev == NULL);
+	KASSERT(thread->t_listnode.tln_next == NULL);
 
 	/* sheer paranoia */
 	thread->t_wchan_name = "DESTROYED";
 
 	kfree(thread->t_name);
-	kfree(thread);
+	kmem_cache_free(thread_cache, thread);
 }
 
 /*
@@ -311,6 +461,9 @@ exorcise(void)
 void
 thread_panic(void)
 {
+	struct threadlist *rq;
+	unsigned i;
+
 	/*
 	 * Kill off other CPUs.
 	 *
@@ -325,9 +478,12 @@ thread_panic(void)
 	 * to.  Instead, blat the list structure by hand, and take the
 	 * risk that it might not be quite atomic.
 	 */
-	curcpu->c_runqueue.tl_count = 0;
-	curcpu->c_runqueue.tl_head.tln_next = &curcpu->c_runqueue.tl_tail;
-	curcpu->c_runqueue.tl_tail.tln_prev = &curcpu->c_runqueue.tl_head;
+	for (i=0; i<SCHED_NLEVELS; i++) {
+		rq = &curcpu->c_runqueue[i];
+		rq->tl_count = 0;
+		rq->tl_head.tln_next = &rq->tl_tail;
+		rq->tl_tail.tln_prev = &rq->tl_head;
+	}
 
 	/*
 	 * Ideally, we want to make sure sleeping threads don't wake
@@ -370,6 +526,12 @@ thread_bootstrap(void)
 {
 	cpuarray_init(&allcpus);
 
+	thread_cache = kmem_cache_create("thread", sizeof(struct thread), 0,
+					 thread_ctor, thread_dtor);
+	if (thread_cache == NULL) {
+		panic("thread_bootstrap: Out of memory\n");
+	}
+
 	/*
 	 * Create the cpu structure for the bootup CPU, the one we're
 	 * currently running on. Assume the hardware number is 0; that
@@ -408,6 +570,7 @@ cpu_hatch(unsigned software_number)
 	KASSERT(curthread != NULL);
 	KASSERT(curcpu->c_number == software_number);
 
+	mainbus_cpu_hatch();
 	spl0();
 	cpu_identify(buf, sizeof(buf));
 
@@ -439,6 +602,160 @@ thread_start_cpus(void)
 	cpu_startup_sem = NULL;
 }
 
+/*
+ * Run queue helpers. There is one queue per MLFQ level; the CPU runs
+ * the head of the highest priority nonempty one. Call with the CPU's
+ * run queue lock held.
+ */
+static
+unsigned
+runqueue_count(struct cpu *c)
+{
+	unsigned i, count;
+
+	count = 0;
+	for (i=0; i<SCHED_NLEVELS; i++) {
+		count += c->c_runqueue[i].tl_count;
+	}
+	return count;
+}
+
+static
+struct thread *
+runqueue_remhead(struct cpu *c)
+{
+	struct thread *t;
+	unsigned i;
+
+	for (i=0; i<SCHED_NLEVELS; i++) {
+		t = threadlist_remhead(&c->c_runqueue[i]);
+		if (t != NULL) {
+			return t;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Work stealing.
+ *
+ * A CPU that runs out of threads calls this before idling, and again
+ * each time an interrupt wakes it from idle, to take a thread from
+ * the peer with the most threads waiting. It takes from the tail of
+ * the lowest priority queue, so it gets hogs rather than interactive
+ * threads, and the ones that would otherwise wait longest.
+ *
+ * Moving a thread costs it its cache, so threads that ran on the
+ * peer within the last SCHED_AFFINITY_TICKS hardclocks are passed
+ * over if anything else will do. If nothing else will, one is taken
+ * only if the peer still has another waiting, i.e. if leaving it
+ * would keep the peer's queue long while we sit idle.
+ *
+ * Called with interrupts off and no run queue lock held. Returns a
+ * thread that is on no run queue and now belongs to this CPU, or
+ * NULL.
+ */
+#define SCHED_AFFINITY_TICKS	2
+
+static
+struct thread *
+thread_steal_from(struct cpu *victim, bool coldonly)
+{
+	struct thread *t;
+	unsigned level;
+
+	KASSERT(spinlock_do_i_hold(&victim->c_runqueue_lock));
+
+	for (level=SCHED_NLEVELS; level-- > 0; ) {
+		THREADLIST_FORALL_REV(t, victim->c_runqueue[level]) {
+			/*
+			 * The peer's curthread can be on its run
+			 * queue if it went to sleep, the peer idled
+			 * with it still curthread, and it was woken
+			 * before the peer got going again. Moving it
+			 * would be a disaster; leave it.
+			 */
+			if (t == victim->c_curthread) {
+				continue;
+			}
+			if (coldonly && victim->c_hardclocks - t->t_lastrun
+			    < SCHED_AFFINITY_TICKS) {
+				continue;
+			}
+			threadlist_remove(&victim->c_runqueue[level], t);
+			return t;
+		}
+	}
+	return NULL;
+}
+
+static
+struct thread *
+thread_steal(void)
+{
+	struct cpu *c, *victim;
+	struct thread *t;
+	unsigned i, numcpus, count, best;
+
+	/* Find the busiest peer. Unlocked counts are good enough. */
+	victim = NULL;
+	best = 0;
+	numcpus = cpuarray_num(&allcpus);
+	for (i=0; i<numcpus; i++) {
+		c = cpuarray_get(&allcpus, i);
+		if (c == curcpu->c_self) {
+			continue;
+		}
+		count = runqueue_count(c);
+		if (count > best) {
+			best = count;
+			victim = c;
+		}
+	}
+	if (victim == NULL) {
+		return NULL;
+	}
+
+	spinlock_acquire(&victim->c_runqueue_lock);
+	t = thread_steal_from(victim, true);
+	if (t == NULL && runqueue_count(victim) > 1) {
+		t = thread_steal_from(victim, false);
+	}
+	if (t != NULL) {
+		t->t_cpu = curcpu->c_self;
+		DEBUG(DB_THREADS, "Stole thread %s: cpu %u -> %u",
+		      t->t_name, victim->c_number, curcpu->c_number);
+	}
+	spinlock_release(&victim->c_runqueue_lock);
+	return t;
+}
+
+/*
+ * Wake one tickless idle CPU other than curcpu and BUSY, so it can
+ * steal. An idle CPU that is still ticking will look for work at its
+ * next hardclock anyway; one that has stopped its tick (see
+ * hardclock_idle) might not look again for a long time.
+ */
+static
+void
+thread_kick_idle(struct cpu *busy)
+{
+	struct cpu *c;
+	unsigned i, numcpus;
+
+	numcpus = cpuarray_num(&allcpus);
+	for (i=0; i<numcpus; i++) {
+		c = cpuarray_get(&allcpus, i);
+		if (c == busy || c == curcpu->c_self) {
+			continue;
+		}
+		if (c->c_isidle && c->c_tickless) {
+			ipi_send(c, IPI_UNIDLE);
+			return;
+		}
+	}
+}
+
 /*
  * Make a thread runnable.
  *
@@ -463,7 +780,10 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
 
 	/* Target thread is now ready to run; put it on the run queue. */
 	target->t_state = S_READY;
-	threadlist_addtail(&targetcpu->c_runqueue, target);
+#if OPT_SCHEDSTAT
+	target->t_readytime = cpu_cycles();
+#endif
+	threadlist_addtail(&targetcpu->c_runqueue[target->t_level], target);
 
 	if (targetcpu->c_isidle && targetcpu != curcpu->c_self) {
 		/*
@@ -472,6 +792,10 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
 		 */
 		ipi_send(targetcpu, IPI_UNIDLE);
 	}
+	else if (!targetcpu->c_isidle && !already_have_lock) {
+		/* It will have to wait; let an idle CPU come take it. */
+		thread_kick_idle(targetcpu);
+	}
 
 	if (!already_have_lock) {
 		spinlock_release(&targetcpu->c_runqueue_lock);
@@ -502,13 +826,12 @@ thread_fork(const char *name,
 		return ENOMEM;
 	}
 
-	/* Allocate a stack */
-	newthread->t_stack = kmalloc(STACK_SIZE);
-	if (newthread->t_stack == NULL) {
+	/* Get a stack */
+	result = thread_stack_get(newthread);
+	if (result) {
 		thread_destroy(newthread);
-		return ENOMEM;
+		return result;
 	}
-	thread_checkstack_init(newthread);
 
 	/*
 	 * Now we clone various fields from the parent thread.
@@ -581,11 +904,14 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 	/* Check the stack guard band. */
 	thread_checkstack(cur);
 
+	/* Not in a read section, so this cpu is past any RCU readers. */
+	rcu_quiescent();
+
 	/* Lock the run queue. */
 	spinlock_acquire(&curcpu->c_runqueue_lock);
 
 	/* Micro-optimization: if nothing to do, just return */
-	if (newstate == S_READY && threadlist_isempty(&curcpu->c_runqueue)) {
+	if (newstate == S_READY && runqueue_count(curcpu->c_self) == 0) {
 		spinlock_release(&curcpu->c_runqueue_lock);
 		splx(spl);
 		return;
@@ -600,6 +926,7 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 		break;
 	    case S_SLEEP:
 		cur->t_wchan_name = wc->wc_name;
+		cur->t_wchan = wc;
 		/*
 		 * Add the thread to the list in the wait channel, and
 		 * unlock same. To avoid a race with someone else
@@ -617,9 +944,11 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 		break;
 	}
 	cur->t_state = newstate;
+	cur->t_lastrun = curcpu->c_hardclocks;
 
 	/*
-	 * Get the next thread. While there isn't one, call cpu_idle().
+	 * Get the next thread. While there isn't one, try to steal one
+	 * from another CPU, and failing that call cpu_idle().
 	 * curcpu->c_isidle must be true when cpu_idle is
 	 * called. Unlock the runqueue while idling too, to make sure
 	 * things can be added to it.
@@ -638,14 +967,24 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 	/* The current cpu is now idle. */
 	curcpu->c_isidle = true;
 	do {
-		next = threadlist_remhead(&curcpu->c_runqueue);
+		next = runqueue_remhead(curcpu->c_self);
 		if (next == NULL) {
 			spinlock_release(&curcpu->c_runqueue_lock);
-			cpu_idle();
+			next = thread_steal();
+			if (next == NULL) {
+				hardclock_idle();
+				rcu_idle_enter();
+				cpu_idle();
+				rcu_idle_exit();
+			}
 			spinlock_acquire(&curcpu->c_runqueue_lock);
 		}
 	} while (next == NULL);
 	curcpu->c_isidle = false;
+	hardclock_busy();
+#if OPT_SCHEDSTAT
+	schedstat_runwait(cpu_cycles() - next->t_readytime);
+#endif
 
 	/*
 	 * Note that curcpu->c_curthread may be the same variable as
@@ -720,6 +1059,9 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 	/* Clean up dead threads. */
 	exorcise();
 
+	/* Free things RCU readers are done with. */
+	rcu_docallbacks();
+
 	/* Turn interrupts back on. */
 	splx(spl);
 }
@@ -753,6 +1095,9 @@ thread_startup(void (*entrypoint)(void *data1, unsigned long data2),
 	/* Clean up dead threads. */
 	exorcise();
 
+	/* Free things RCU readers are done with. */
+	rcu_docallbacks();
+
 	/* Enable interrupts. */
 	spl0();
 
@@ -780,10 +1125,12 @@ thread_exit(void)
 	cur = curthread;
 
 	/*
-	 * Detach from our process. You might need to move this action
-	 * around, depending on how your wait/exit works.
+	 * Detach from our process, unless sys__exit already did so
+	 * before handing the process over to its parent.
 	 */
-	proc_remthread(cur);
+	if (cur->t_proc != NULL) {
+		proc_remthread(cur);
+	}
 
 	/* Make sure we *are* detached (move this only if you're sure!) */
 	KASSERT(cur->t_proc == NULL);
@@ -811,141 +1158,107 @@ thread_yield(void)
 /*
  * Scheduler.
  *
- * This is called periodically from hardclock(). It should reshuffle
- * the current CPU's run queue by job priority.
+ * This is a multi-level feedback queue. Each CPU has SCHED_NLEVELS
+ * run queues, and always runs the head of the highest priority
+ * (lowest numbered) nonempty one. A thread at level L gets a quantum
+ * of SCHED_QUANTUM(L) hardclocks, so the lower levels run longer but
+ * less often:
+ *
+ *   - a thread that uses up its quantum drops a level (thread_tick);
+ *   - a thread that wakes up from sleeping rises a level
+ *     (thread_wakeboost), so threads that mostly wait for input,
+ *     like the shell, stay at the top;
+ *   - every SCHEDULE_HARDCLOCKS, everything waiting in the run
+ *     queues rises a level (schedule), so nothing at the bottom
+ *     starves;
+ *   - a thread preempted by a higher priority one keeps its place
+ *     in its quantum.
  */
+#define SCHED_QUANTUM(level)	(1U << (level))
 
+/*
+ * Priority aging, called periodically from hardclock().
+ */
 void
 schedule(void)
 {
-	/*
-	 * You can write this. If we do nothing, threads will run in
-	 * round-robin fashion.
-	 */
+	struct thread *t;
+	unsigned i;
+
+	spinlock_acquire(&curcpu->c_runqueue_lock);
+	for (i=1; i<SCHED_NLEVELS; i++) {
+		while ((t = threadlist_remhead(&curcpu->c_runqueue[i]))
+		       != NULL) {
+			t->t_level = i - 1;
+			threadlist_addtail(&curcpu->c_runqueue[i - 1], t);
+		}
+	}
+	if (!curcpu->c_isidle && curthread->t_level > 0) {
+		curthread->t_level--;
+	}
+	spinlock_release(&curcpu->c_runqueue_lock);
 }
 
 /*
- * Thread migration.
- *
- * This is also called periodically from hardclock(). If the current
- * CPU is busy and other CPUs are idle, or less busy, it should move
- * threads across to those other other CPUs.
- *
- * Migrating threads isn't free because of cache affinity; a thread's
- * working cache set will end up having to be moved to the other CPU,
- * which is fairly slow. The tradeoff between this performance loss
- * and the performance loss due to underutilization of some CPUs is
- * something that needs to be tuned and probably is workload-specific.
- *
- * For here and now, because we know we're running on System/161 and
- * System/161 does not (yet) model such cache effects, we'll be very
- * aggressive.
+ * Quantum accounting, called on every hardclock().
  */
 void
-thread_consider_migration(void)
+thread_tick(void)
 {
-	unsigned my_count, total_count, one_share, to_send;
-	unsigned i, numcpus;
-	struct cpu *c;
-	struct threadlist victims;
-	struct thread *t;
+	struct thread *cur;
+	bool preempt;
+	unsigned i;
 
-	my_count = total_count = 0;
-	numcpus = cpuarray_num(&allcpus);
-	for (i=0; i<numcpus; i++) {
-		c = cpuarray_get(&allcpus, i);
-		spinlock_acquire(&c->c_runqueue_lock);
-		total_count += c->c_runqueue.tl_count;
-		if (c == curcpu->c_self) {
-			my_count = c->c_runqueue.tl_count;
-		}
-		spinlock_release(&c->c_runqueue_lock);
+	cur = curthread;
+	if (curcpu->c_isidle) {
+		return;
 	}
 
-	one_share = DIVROUNDUP(total_count, numcpus);
-	if (my_count < one_share) {
+	cur->t_ticks++;
+	if (cur->t_rcu_nest > 0) {
+		/* Can't switch in an RCU read section; the next tick will. */
+		return;
+	}
+	if (cur->t_ticks >= SCHED_QUANTUM(cur->t_level)) {
+		/* Used up its quantum; demote it and move on. */
+		cur->t_ticks = 0;
+		if (cur->t_level < SCHED_NLEVELS - 1) {
+			cur->t_level++;
+		}
+		thread_yield();
 		return;
 	}
 
-	to_send = my_count - one_share;
-	threadlist_init(&victims);
+	/* Otherwise only give way to something of higher priority. */
+	preempt = false;
 	spinlock_acquire(&curcpu->c_runqueue_lock);
-	for (i=0; i<to_send; i++) {
-		t = threadlist_remtail(&curcpu->c_runqueue);
-		threadlist_addhead(&victims, t);
+	for (i=0; i<cur->t_level; i++) {
+		if (!threadlist_isempty(&curcpu->c_runqueue[i])) {
+			preempt = true;
+			break;
+		}
 	}
 	spinlock_release(&curcpu->c_runqueue_lock);
-
-	for (i=0; i < numcpus && to_send > 0; i++) {
-		c = cpuarray_get(&allcpus, i);
-		if (c == curcpu->c_self) {
-			continue;
-		}
-		spinlock_acquire(&c->c_runqueue_lock);
-		while (c->c_runqueue.tl_count < one_share && to_send > 0) {
-			t = threadlist_remhead(&victims);
-			/*
-			 * Ordinarily, curthread will not appear on
-			 * the run queue. However, it can under the
-			 * following circumstances:
-			 *   - it went to sleep;
-			 *   - the processor became idle, so it
-			 *     remained curthread;
-			 *   - it was reawakened, so it was put on the
-			 *     run queue;
-			 *   - and the processor hasn't fully unidled
-			 *     yet, so all these things are still true.
-			 *
-			 * If the timer interrupt happens at (almost)
-			 * exactly the proper moment, we can come here
-			 * while things are in this state and see
-			 * curthread. However, *migrating* curthread
-			 * can cause bad things to happen (Exercise:
-			 * Why? And what?) so shuffle it to the end of
-			 * the list and decrement to_send in order to
-			 * skip it. Then it goes back on our own run
-			 * queue below.
-			 */
-			if (t == curthread) {
-				threadlist_addtail(&victims, t);
-				to_send--;
-				continue;
-			}
-
-			t->t_cpu = c;
-			threadlist_addtail(&c->c_runqueue, t);
-			DEBUG(DB_THREADS,
-			      "Migrated thread %s: cpu %u -> %u",
-			      t->t_name, curcpu->c_number, c->c_number);
-			to_send--;
-			if (c->c_isidle) {
-				/*
-				 * Other processor is idle; send
-				 * interrupt to make sure it unidles.
-				 */
-				ipi_send(c, IPI_UNIDLE);
-			}
-		}
-		spinlock_release(&c->c_runqueue_lock);
+	if (preempt) {
+		thread_yield();
 	}
+}
 
-	/*
-	 * Because the code above isn't atomic, the thread counts may have
-	 * changed while we were working and we may end up with leftovers.
-	 * Don't panic; just put them back on our own run queue.
-	 */
-	if (!threadlist_isempty(&victims)) {
-		spinlock_acquire(&curcpu->c_runqueue_lock);
-		while ((t = threadlist_remhead(&victims)) != NULL) {
-			threadlist_addtail(&curcpu->c_runqueue, t);
-		}
-		spinlock_release(&curcpu->c_runqueue_lock);
+/*
+ * Priority boost for a thread being woken up. Called with the thread
+ * off its wait channel but not yet on a run queue.
+ */
+static
+void
+thread_wakeboost(struct thread *t)
+{
+	if (t->t_level > 0) {
+		t->t_level--;
 	}
-
-	KASSERT(threadlist_isempty(&victims));
-	threadlist_cleanup(&victims);
+	t->t_ticks = 0;
 }
 
+
 ////////////////////////////////////////////////////////////
 
 /*
@@ -987,15 +1300,17 @@ wchan_destroy(struct wchan *wc)
 }
 
 /*
- * Yield the cpu to another process, and go to sleep, on the specified
- * wait channel WC, whose associated spinlock is LK. Calling wakeup on
- * the channel will make the thread runnable again. The spinlock must
- * be locked. The call to thread_switch unlocks it; we relock it
- * before returning.
+ * Common part of wchan_sleep and wchan_sleep_timeout: go to sleep on
+ * WC, releasing LK, and return (without LK) when woken.
  */
+static
 void
-wchan_sleep(struct wchan *wc, struct spinlock *lk)
+wchan_dosleep(struct wchan *wc, struct spinlock *lk)
 {
+#if OPT_LOCKSTAT || OPT_SCHEDSTAT
+	uint64_t start, slept;
+#endif
+
 	/* may not sleep in an interrupt handler */
 	KASSERT(!curthread->t_in_interrupt);
 
@@ -1005,8 +1320,90 @@ wchan_sleep(struct wchan *wc, struct spinlock *lk)
 	/* must not hold other spinlocks */
 	KASSERT(curcpu->c_spinlocks == 1);
 
+#if OPT_LOCKSTAT || OPT_SCHEDSTAT
+	start = cpu_cycles();
 	thread_switch(S_SLEEP, wc, lk);
+	slept = cpu_cycles() - start;
+#if OPT_LOCKSTAT
+	lockstat_acquire(LOCKSTAT_WCHAN, wc->wc_name, 0, true, slept);
+	lockstat_hold(LOCKSTAT_WCHAN, wc->wc_name, 0, slept);
+#endif
+#if OPT_SCHEDSTAT
+	schedstat_sleep(wc->wc_name, slept);
+#endif
+#else
+	thread_switch(S_SLEEP, wc, lk);
+#endif
+}
+
+/*
+ * Yield the cpu to another process, and go to sleep, on the specified
+ * wait channel WC, whose associated spinlock is LK. Calling wakeup on
+ * the channel will make the thread runnable again. The spinlock must
+ * be locked. The call to thread_switch unlocks it; we relock it
+ * before returning.
+ */
+void
+wchan_sleep(struct wchan *wc, struct spinlock *lk)
+{
+	wchan_dosleep(wc, lk);
+	spinlock_acquire(lk);
+}
+
+/*
+ * Timed sleep. The timeout, when it fires, takes the thread off WC
+ * the same way a wakeup would, but only if it is still on WC: a
+ * thread that has been woken, or moved to another channel with
+ * wchan_moveone/moveall, counts as woken.
+ */
+struct wchan_timeout {
+	struct thread *wt_thread;
+	struct wchan *wt_wchan;
+	struct spinlock *wt_lock;
+	bool wt_timedout;
+};
+
+static
+void
+wchan_timeout_fire(void *arg)
+{
+	struct wchan_timeout *wt = arg;
+	struct thread *target = wt->wt_thread;
+
+	spinlock_acquire(wt->wt_lock);
+	if (target->t_wchan == wt->wt_wchan) {
+		threadlist_remove(&wt->wt_wchan->wc_threads, target);
+		target->t_wchan = NULL;
+		wt->wt_timedout = true;
+		thread_wakeboost(target);
+		thread_make_runnable(target, false);
+	}
+	spinlock_release(wt->wt_lock);
+}
+
+int
+wchan_sleep_timeout(struct wchan *wc, struct spinlock *lk, unsigned ticks)
+{
+	struct wchan_timeout wt;
+	struct timeout to;
+
+	if (ticks == 0) {
+		return ETIMEDOUT;
+	}
+
+	wt.wt_thread = curthread;
+	wt.wt_wchan = wc;
+	wt.wt_lock = lk;
+	wt.wt_timedout = false;
+	timeout_init(&to, wchan_timeout_fire, &wt);
+	timeout_set(&to, ticks);
+
+	wchan_dosleep(wc, lk);
+
+	/* The timeout needs LK, so cancel it before taking LK back. */
+	timeout_cancel(&to);
 	spinlock_acquire(lk);
+	return wt.wt_timedout ? ETIMEDOUT : 0;
 }
 
 /*
@@ -1026,6 +1423,7 @@ wchan_wakeone(struct wchan *wc, struct spinlock *lk)
 		/* Nobody was sleeping. */
 		return;
 	}
+	target->t_wchan = NULL;
 
 	/*
 	 * Note that thread_make_runnable acquires a runqueue lock
@@ -1035,6 +1433,7 @@ wchan_wakeone(struct wchan *wc, struct spinlock *lk)
 	 * in thread_switch.
 	 */
 
+	thread_wakeboost(target);
 	thread_make_runnable(target, false);
 }
 
@@ -1056,6 +1455,7 @@ wchan_wakeall(struct wchan *wc, struct spinlock *lk)
 	 * private list.
 	 */
 	while ((target = threadlist_remhead(&wc->wc_threads)) != NULL) {
+		target->t_wchan = NULL;
 		threadlist_addtail(&list, target);
 	}
 
@@ -1065,12 +1465,49 @@ wchan_wakeall(struct wchan *wc, struct spinlock *lk)
 	 * make each thread runnable.
 	 */
 	while ((target = threadlist_remhead(&list)) != NULL) {
+		thread_wakeboost(target);
 		thread_make_runnable(target, false);
 	}
 
 	threadlist_cleanup(&list);
 }
 
+/*
+ * Move threads sleeping on one wait channel to another. Sleeping
+ * threads are only ever on a wchan list, so this is just list surgery
+ * under both channels' locks.
+ */
+unsigned
+wchan_moveone(struct wchan *from, struct spinlock *fromlk,
+	      struct wchan *to, struct spinlock *tolk)
+{
+	struct thread *target;
+
+	KASSERT(spinlock_do_i_hold(fromlk));
+	KASSERT(spinlock_do_i_hold(tolk));
+
+	target = threadlist_remhead(&from->wc_threads);
+	if (target == NULL) {
+		return 0;
+	}
+	target->t_wchan_name = to->wc_name;
+	target->t_wchan = to;
+	threadlist_addtail(&to->wc_threads, target);
+	return 1;
+}
+
+unsigned
+wchan_moveall(struct wchan *from, struct spinlock *fromlk,
+	      struct wchan *to, struct spinlock *tolk)
+{
+	unsigned n = 0;
+
+	while (wchan_moveone(from, fromlk, to, tolk) > 0) {
+		n++;
+	}
+	return n;
+}
+
 /*
  * Return nonzero if there are no threads sleeping on the channel.
  * This is meant to be used only for diagnostic purposes.
@@ -1157,6 +1594,23 @@ ipi_tlbshootdown(struct cpu *target, const struct tlbshootdown *mapping)
 	spinlock_release(&target->c_ipi_lock);
 }
 
+/*
+ * Send a TLB shootdown IPI to all CPUs.
+ */
+void
+ipi_tlbshootdown_broadcast(const struct tlbshootdown *mapping)
+{
+	unsigned i;
+	struct cpu *c;
+
+	for (i=0; i < cpuarray_num(&allcpus); i++) {
+		c = cpuarray_get(&allcpus, i);
+		if (c != curcpu->c_self) {
+			ipi_tlbshootdown(c, mapping);
+		}
+	}
+}
+
 /*
  * Handle an incoming interprocessor interrupt.
  */
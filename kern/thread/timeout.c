@@ -0,0 +1,343 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * Timeouts on a hierarchical timer wheel. See timeout.h.
+ *
+ * Level L of the wheel has TIMEOUT_SLOTS slots, each covering
+ * TIMEOUT_SLOTS^L ticks. A timeout due DELTA ticks from now goes on
+ * the lowest level whose span covers DELTA, in the slot its expiry
+ * tick falls in. Level 0 slots therefore hold only timeouts due on
+ * exactly one tick; each time the low bits of the tick count roll
+ * over, the slot of the next level up that has just come round is
+ * emptied and its timeouts put back in, now at a lower level. (That
+ * is the cascade; each timeout goes through it at most once per
+ * level.)
+ *
+ * The wheel's tick count, timeout_ticks, is brought up to
+ * mainbus_ticks() by CPU 0's hardclock. While CPU 0 idles without
+ * its tick (see timeout_idle) the wheel falls behind, so new
+ * timeouts are counted from mainbus_ticks(), and the hardclock that
+ * ends the idle stretch runs the missed ticks all at once.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <clock.h>
+#include <spinlock.h>
+#include <cpu.h>
+#include <current.h>
+#include <thread.h>
+#include <mainbus.h>
+#include <timeout.h>
+
+static struct spinlock timeout_lock =
+	SPINLOCK_NAMED_INITIALIZER("timeout_lock");
+static struct timeout *timeout_wheel[TIMEOUT_LEVELS][TIMEOUT_SLOTS];
+static uint64_t timeout_ticks;
+
+/* The timeout whose function timeout_tick is calling, if any. */
+static struct timeout *volatile timeout_running;
+
+/* CPU 0 while it idles without its tick, and the tick it wakes on. */
+static struct cpu *timeout_idlecpu;
+static uint64_t timeout_idleuntil;
+
+void
+timeout_init(struct timeout *to, void (*func)(void *), void *arg)
+{
+	to->to_next = NULL;
+	to->to_pprev = NULL;
+	to->to_expire = 0;
+	to->to_func = func;
+	to->to_arg = arg;
+}
+
+/*
+ * Put TO in its slot. Call with timeout_lock held.
+ */
+static
+void
+timeout_insert(struct timeout *to)
+{
+	struct timeout **slot;
+	uint64_t delta;
+	unsigned level, shift;
+
+	KASSERT(to->to_expire >= timeout_ticks);
+	delta = to->to_expire - timeout_ticks;
+
+	level = 0;
+	while (level < TIMEOUT_LEVELS - 1 &&
+	       delta >= (1ULL << (TIMEOUT_SLOTBITS * (level + 1)))) {
+		level++;
+	}
+	shift = TIMEOUT_SLOTBITS * level;
+	slot = &timeout_wheel[level][(to->to_expire >> shift)
+				     & (TIMEOUT_SLOTS - 1)];
+
+	to->to_next = *slot;
+	if (to->to_next != NULL) {
+		to->to_next->to_pprev = &to->to_next;
+	}
+	to->to_pprev = slot;
+	*slot = to;
+}
+
+/*
+ * The current tick: the wheel's, or later if it's behind. Call with
+ * timeout_lock held.
+ */
+static
+uint64_t
+timeout_curtick(void)
+{
+	uint64_t now;
+
+	now = mainbus_ticks();
+	return now > timeout_ticks ? now : timeout_ticks;
+}
+
+/*
+ * Take TO off the wheel. Call with timeout_lock held.
+ */
+static
+void
+timeout_unlink(struct timeout *to)
+{
+	*to->to_pprev = to->to_next;
+	if (to->to_next != NULL) {
+		to->to_next->to_pprev = to->to_pprev;
+	}
+	to->to_next = NULL;
+	to->to_pprev = NULL;
+}
+
+void
+timeout_set(struct timeout *to, unsigned ticks)
+{
+	struct cpu *kick = NULL;
+
+	if (ticks == 0) {
+		ticks = 1;
+	}
+	else if (ticks > TIMEOUT_MAXTICKS) {
+		ticks = TIMEOUT_MAXTICKS;
+	}
+
+	spinlock_acquire(&timeout_lock);
+	if (to->to_pprev != NULL) {
+		timeout_unlink(to);
+	}
+	to->to_expire = timeout_curtick() + ticks;
+	if (to->to_expire - timeout_ticks > TIMEOUT_MAXTICKS) {
+		to->to_expire = timeout_ticks + TIMEOUT_MAXTICKS;
+	}
+	timeout_insert(to);
+
+	/* If CPU 0 is asleep past this one, wake it to look again. */
+	if (timeout_idlecpu != NULL && to->to_expire < timeout_idleuntil) {
+		kick = timeout_idlecpu;
+		timeout_idlecpu = NULL;
+	}
+	spinlock_release(&timeout_lock);
+
+	if (kick != NULL) {
+		ipi_send(kick, IPI_UNIDLE);
+	}
+}
+
+bool
+timeout_cancel(struct timeout *to)
+{
+	bool pending;
+
+	spinlock_acquire(&timeout_lock);
+	pending = to->to_pprev != NULL;
+	if (pending) {
+		timeout_unlink(to);
+	}
+	else {
+		/*
+		 * It may be firing right now on CPU 0. Unless that's
+		 * us (a function cancelling its own timeout), wait
+		 * for it to finish so the caller can free TO.
+		 */
+		while (timeout_running == to && !curthread->t_in_interrupt) {
+			spinlock_release(&timeout_lock);
+			spinlock_acquire(&timeout_lock);
+		}
+	}
+	spinlock_release(&timeout_lock);
+	return pending;
+}
+
+bool
+timeout_pending(struct timeout *to)
+{
+	bool pending;
+
+	spinlock_acquire(&timeout_lock);
+	pending = to->to_pprev != NULL;
+	spinlock_release(&timeout_lock);
+	return pending;
+}
+
+uint64_t
+timeout_now(void)
+{
+	uint64_t now;
+
+	spinlock_acquire(&timeout_lock);
+	now = timeout_curtick();
+	spinlock_release(&timeout_lock);
+	return now;
+}
+
+unsigned
+timespec_to_ticks(const struct timespec *ts)
+{
+	const uint32_t nsecs_per_tick = 1000000000 / HZ;
+
+	if (ts->tv_sec < 0 || (ts->tv_sec == 0 && ts->tv_nsec <= 0)) {
+		return 0;
+	}
+	if (ts->tv_sec >= TIMEOUT_MAXTICKS / HZ) {
+		return TIMEOUT_MAXTICKS;
+	}
+	return ts->tv_sec * HZ +
+		(ts->tv_nsec + nsecs_per_tick - 1) / nsecs_per_tick;
+}
+
+/*
+ * Empty slot SLOT of level LEVEL back into the wheel. Call with
+ * timeout_lock held.
+ */
+static
+void
+timeout_cascade(unsigned level, unsigned slot)
+{
+	struct timeout *to, *next;
+
+	to = timeout_wheel[level][slot];
+	timeout_wheel[level][slot] = NULL;
+	for (; to != NULL; to = next) {
+		next = to->to_next;
+		timeout_insert(to);
+	}
+}
+
+void
+timeout_tick(void)
+{
+	struct timeout **slot, *to;
+	uint64_t now, target;
+	unsigned level, shift;
+
+	target = mainbus_ticks();
+	spinlock_acquire(&timeout_lock);
+	while (timeout_ticks < target) {
+		now = ++timeout_ticks;
+
+		for (level = 1; level < TIMEOUT_LEVELS; level++) {
+			shift = TIMEOUT_SLOTBITS * level;
+			if ((now & ((1ULL << shift) - 1)) != 0) {
+				break;
+			}
+			timeout_cascade(level,
+					(now >> shift) & (TIMEOUT_SLOTS - 1));
+		}
+
+		/*
+		 * Fire everything due now. The lock is dropped around
+		 * each call, so the function can rearm or cancel
+		 * timeouts; any it arms are due on a later tick and
+		 * won't land in this slot.
+		 */
+		slot = &timeout_wheel[0][now & (TIMEOUT_SLOTS - 1)];
+		while ((to = *slot) != NULL) {
+			KASSERT(to->to_expire == now);
+			timeout_unlink(to);
+			timeout_running = to;
+			spinlock_release(&timeout_lock);
+
+			to->to_func(to->to_arg);
+
+			spinlock_acquire(&timeout_lock);
+			timeout_running = NULL;
+		}
+	}
+	spinlock_release(&timeout_lock);
+}
+
+/*
+ * Find the earliest expiry by walking every slot; this only happens
+ * when CPU 0 goes idle, and there are never many timeouts pending.
+ */
+unsigned
+timeout_idle(unsigned max)
+{
+	struct timeout *to;
+	uint64_t now, first;
+	unsigned level, slot;
+
+	KASSERT(curcpu->c_number == 0);
+
+	spinlock_acquire(&timeout_lock);
+	now = timeout_curtick();
+	first = now + max;
+	for (level = 0; level < TIMEOUT_LEVELS; level++) {
+		for (slot = 0; slot < TIMEOUT_SLOTS; slot++) {
+			to = timeout_wheel[level][slot];
+			for (; to != NULL; to = to->to_next) {
+				if (to->to_expire < first) {
+					first = to->to_expire;
+				}
+			}
+		}
+	}
+	if (first <= now) {
+		/* overdue; the wheel is behind */
+		first = now + 1;
+	}
+	timeout_idlecpu = curcpu->c_self;
+	timeout_idleuntil = first;
+	spinlock_release(&timeout_lock);
+
+	return first - now;
+}
+
+void
+timeout_busy(void)
+{
+	spinlock_acquire(&timeout_lock);
+	timeout_idlecpu = NULL;
+	spinlock_release(&timeout_lock);
+}
@@ -39,10 +39,15 @@
 #include <lib.h>
 #include <array.h>
 #include <synch.h>
+#include <thread.h>
+#include <current.h>
 #include <vfs.h>
 #include <fs.h>
 #include <vnode.h>
 #include <device.h>
+#include <membar.h>
+#include <rcu.h>
+#include <sysstat.h>
 
 /*
  * Structure for a single named device.
@@ -90,9 +95,26 @@ DEFARRAY(knowndev, static __UNUSED inline);
 
 static struct knowndevarray *knowndevs;
 
+/*
+ * A copy of the knowndevs array for vfs_getdev, which reads it with
+ * no lock. It is replaced, not changed, when a device is added, and
+ * the old copy freed once readers are done with it. The knowndev
+ * structures themselves are never freed, and the fields vfs_getdev
+ * looks at never change.
+ */
+struct knowndevtab {
+	struct rcu_head kt_rcu;
+	unsigned kt_num;
+	struct knowndev *kt_devs[];
+};
+
+static struct knowndevtab *volatile knowndevtab;
+
 /* The big lock for all FS ops. Remove for filesystem assignment. */
-static struct lock *vfs_biglock;
+static struct rwlock *vfs_biglock;
+static struct thread *volatile vfs_biglock_owner;
 static unsigned vfs_biglock_depth;
+static unsigned vfs_biglock_savedshared;
 
 
 /*
@@ -106,13 +128,16 @@ vfs_bootstrap(void)
 		panic("vfs: Could not create knowndevs array\n");
 	}
 
-	vfs_biglock = lock_create("vfs_biglock");
+	vfs_biglock = rwlock_create("vfs_biglock");
 	if (vfs_biglock==NULL) {
 		panic("vfs: Could not create vfs big lock\n");
 	}
+	vfs_biglock_owner = NULL;
 	vfs_biglock_depth = 0;
+	vfs_biglock_savedshared = 0;
 
 	devnull_create();
+	devsysstat_create();
 	semfs_bootstrap();
 }
 
@@ -122,31 +147,85 @@ vfs_bootstrap(void)
  * undesirable hack that's frequently necessary when a lock covers too
  * much material. Your solution scheme for FS and VFS locking should
  * not require recursive locks.
+ *
+ * The exclusive holder and its depth are global (there is only one);
+ * shared depth is kept per thread in t_vfsshared so that only the
+ * outermost shared hold touches the rwlock. A shared acquire by the
+ * exclusive holder just nests inside its exclusive hold.
  */
 void
 vfs_biglock_acquire(void)
 {
-	if (!lock_do_i_hold(vfs_biglock)) {
-		lock_acquire(vfs_biglock);
+	unsigned shared;
+
+	if (vfs_biglock_owner == curthread) {
+		vfs_biglock_depth++;
+		return;
+	}
+
+	/* no upgrading in place: let go of a shared hold first */
+	shared = curthread->t_vfsshared;
+	if (shared > 0) {
+		curthread->t_vfsshared = 0;
+		rwlock_release_read(vfs_biglock);
 	}
-	vfs_biglock_depth++;
+	rwlock_acquire_write(vfs_biglock);
+	vfs_biglock_owner = curthread;
+	vfs_biglock_depth = 1;
+	vfs_biglock_savedshared = shared;
 }
 
 void
 vfs_biglock_release(void)
 {
-	KASSERT(lock_do_i_hold(vfs_biglock));
+	unsigned shared;
+
+	KASSERT(vfs_biglock_owner == curthread);
 	KASSERT(vfs_biglock_depth > 0);
 	vfs_biglock_depth--;
-	if (vfs_biglock_depth == 0) {
-		lock_release(vfs_biglock);
+	if (vfs_biglock_depth > 0) {
+		return;
+	}
+
+	shared = vfs_biglock_savedshared;
+	vfs_biglock_savedshared = 0;
+	vfs_biglock_owner = NULL;
+	rwlock_release_write(vfs_biglock);
+	if (shared > 0) {
+		rwlock_acquire_read(vfs_biglock);
+		curthread->t_vfsshared = shared;
+	}
+}
+
+void
+vfs_biglock_acquire_shared(void)
+{
+	if (vfs_biglock_owner == curthread) {
+		vfs_biglock_depth++;
+		return;
+	}
+	if (curthread->t_vfsshared++ == 0) {
+		rwlock_acquire_read(vfs_biglock);
+	}
+}
+
+void
+vfs_biglock_release_shared(void)
+{
+	if (vfs_biglock_owner == curthread) {
+		vfs_biglock_release();
+		return;
+	}
+	KASSERT(curthread->t_vfsshared > 0);
+	if (--curthread->t_vfsshared == 0) {
+		rwlock_release_read(vfs_biglock);
 	}
 }
 
 bool
 vfs_biglock_do_i_hold(void)
 {
-	return lock_do_i_hold(vfs_biglock);
+	return vfs_biglock_owner == curthread || curthread->t_vfsshared > 0;
 }
 
 /*
@@ -253,6 +332,43 @@ vfs_getroot(const char *devname, struct vnode **ret)
 	return ENODEV;
 }
 
+/*
+ * Lockless lookup of a device by name, for the common case of opening
+ * a device like con: or null: directly. Only handles the names that
+ * always refer to the device itself, whatever gets mounted: the
+ * name of a device that can't have a filesystem, and the raw name of
+ * one that can.
+ */
+int
+vfs_getdev(const char *devname, struct vnode **ret)
+{
+	struct knowndevtab *kt;
+	struct knowndev *kd;
+	unsigned i;
+	int result;
+
+	result = ENODEV;
+	rcu_read_lock();
+	kt = knowndevtab;
+	for (i=0; kt != NULL && i<kt->kt_num; i++) {
+		kd = kt->kt_devs[i];
+		if (kd->kd_device == NULL) {
+			/* hardwired filesystem */
+			continue;
+		}
+		if ((kd->kd_rawname == NULL && !strcmp(kd->kd_name, devname)) ||
+		    (kd->kd_rawname != NULL &&
+		     !strcmp(kd->kd_rawname, devname))) {
+			VOP_INCREF(kd->kd_vnode);
+			*ret = kd->kd_vnode;
+			result = 0;
+			break;
+		}
+	}
+	rcu_read_unlock();
+	return result;
+}
+
 /*
  * Given a filesystem, hand back the name of the device it's mounted on.
  */
@@ -284,6 +400,48 @@ vfs_getdevname(struct fs *fs)
 	return NULL;
 }
 
+/*
+ * Free a replaced knowndevtab.
+ */
+static
+void
+knowndevtab_free(void *obj)
+{
+	kfree(obj);
+}
+
+/*
+ * Make a new copy of knowndevs for vfs_getdev and publish it. Call
+ * with the big lock held.
+ */
+static
+int
+knowndevtab_update(void)
+{
+	struct knowndevtab *kt, *old;
+	unsigned i, num;
+
+	KASSERT(vfs_biglock_do_i_hold());
+
+	num = knowndevarray_num(knowndevs);
+	kt = kmalloc(sizeof(*kt) + num * sizeof(kt->kt_devs[0]));
+	if (kt == NULL) {
+		return ENOMEM;
+	}
+	kt->kt_num = num;
+	for (i=0; i<num; i++) {
+		kt->kt_devs[i] = knowndevarray_get(knowndevs, i);
+	}
+
+	old = knowndevtab;
+	membar_store_store();
+	knowndevtab = kt;
+	if (old != NULL) {
+		call_rcu(&old->kt_rcu, knowndevtab_free, old);
+	}
+	return 0;
+}
+
 /*
  * Assemble the name for a raw device from the name for the regular device.
  */
@@ -427,6 +585,11 @@ vfs_doadd(const char *dname, int mountable, struct device *dev, struct fs *fs)
 	if (result) {
 		goto fail;
 	}
+	result = knowndevtab_update();
+	if (result) {
+		knowndevarray_remove(knowndevs, index);
+		goto fail;
+	}
 
 	if (dev != NULL) {
 		/* use index+1 as the device number, so 0 is reserved */
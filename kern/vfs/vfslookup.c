@@ -227,6 +227,34 @@ getdevice(char *path, char **subpath, struct vnode **startvn)
 	return 0;
 }
 
+/*
+ * Fast path for a path that is just a device name, like "con:":
+ * try vfs_getdev, which doesn't need the big lock. Returns ENODEV
+ * if PATH isn't of that form or isn't handled there. PATH is left
+ * as it was.
+ */
+static
+int
+getdevice_nolock(char *path, struct vnode **ret)
+{
+	size_t len;
+	int result;
+
+	len = strlen(path);
+	if (len < 2 || path[len-1] != ':' || strchr(path, '/') != NULL) {
+		return ENODEV;
+	}
+	path[len-1] = 0;
+	if (strchr(path, ':') != NULL) {
+		result = ENODEV;
+	}
+	else {
+		result = vfs_getdev(path, ret);
+	}
+	path[len-1] = ':';
+	return result;
+}
+
 /*
  * Name-to-vnode translation.
  * (In BSD, both of these are subsumed by namei().)
@@ -239,11 +267,11 @@ vfs_lookparent(char *path, struct vnode **retval,
 	struct vnode *startvn;
 	int result;
 
-	vfs_biglock_acquire();
+	vfs_biglock_acquire_shared();
 
 	result = getdevice(path, &path, &startvn);
 	if (result) {
-		vfs_biglock_release();
+		vfs_biglock_release_shared();
 		return result;
 	}
 
@@ -261,7 +289,7 @@ vfs_lookparent(char *path, struct vnode **retval,
 
 	VOP_DECREF(startvn);
 
-	vfs_biglock_release();
+	vfs_biglock_release_shared();
 	return result;
 }
 
@@ -271,23 +299,27 @@ vfs_lookup(char *path, struct vnode **retval)
 	struct vnode *startvn;
 	int result;
 
-	vfs_biglock_acquire();
+	if (getdevice_nolock(path, retval) == 0) {
+		return 0;
+	}
+
+	vfs_biglock_acquire_shared();
 
 	result = getdevice(path, &path, &startvn);
 	if (result) {
-		vfs_biglock_release();
+		vfs_biglock_release_shared();
 		return result;
 	}
 
 	if (strlen(path)==0) {
 		*retval = startvn;
-		vfs_biglock_release();
+		vfs_biglock_release_shared();
 		return 0;
 	}
 
 	result = VOP_LOOKUP(startvn, path, retval);
 
 	VOP_DECREF(startvn);
-	vfs_biglock_release();
+	vfs_biglock_release_shared();
 	return result;
 }
@@ -0,0 +1,611 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * Anonymous pipes. See pipe.h.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <kern/poll.h>
+#include <limits.h>
+#include <stat.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <uio.h>
+#include <vm.h>
+#include <vnode.h>
+#include <poll.h>
+#include <pipe.h>
+
+struct pipe {
+	struct vnode pp_rvnode;		/* read end */
+	struct vnode pp_wvnode;		/* write end */
+
+	struct spinlock pp_lock;	/* protects everything below */
+	struct wchan *pp_rwchan;	/* readers waiting for data */
+	struct wchan *pp_wwchan;	/* writers waiting for room */
+	struct pollqueue pp_pollq;	/* pollers on either end */
+	bool pp_readers;		/* read end still open */
+	bool pp_writers;		/* write end still open */
+
+	/* the ring */
+	char *pp_buf;
+	unsigned pp_head;		/* first byte not yet read */
+	unsigned pp_count;		/* bytes in the ring */
+
+	/* handed-off pages, oldest first */
+	vaddr_t pp_pages[PIPE_MAXPAGES];
+	unsigned pp_phead;		/* index of the oldest */
+	unsigned pp_npages;		/* pages in transit */
+	unsigned pp_poff;		/* bytes already read of the oldest */
+
+	/*
+	 * One reader and one writer at a time, each for a whole call:
+	 * this keeps writes from interleaving, and lets the copy to or
+	 * from user memory run without pp_lock. Others wait on the same
+	 * wchans as for data and room.
+	 */
+	bool pp_rbusy;
+	bool pp_wbusy;
+};
+
+/*
+ * Destructor; called once both ends are gone.
+ */
+static
+void
+pipe_destroy(struct pipe *pp)
+{
+	while (pp->pp_npages > 0) {
+		free_kpages(pp->pp_pages[pp->pp_phead]);
+		pp->pp_phead = (pp->pp_phead + 1) % PIPE_MAXPAGES;
+		pp->pp_npages--;
+	}
+	pollqueue_cleanup(&pp->pp_pollq);
+	kfree(pp->pp_buf);
+	wchan_destroy(pp->pp_wwchan);
+	wchan_destroy(pp->pp_rwchan);
+	spinlock_cleanup(&pp->pp_lock);
+	kfree(pp);
+}
+
+/*
+ * Reclaim - called when the last reference to one end goes away.
+ * Wake up whoever was waiting on the other end so they can see it.
+ */
+static
+int
+pipe_reclaim(struct vnode *vn)
+{
+	struct pipe *pp = vn->vn_data;
+	bool gone;
+
+	spinlock_acquire(&pp->pp_lock);
+	if (vn == &pp->pp_rvnode) {
+		pp->pp_readers = false;
+		wchan_wakeall(pp->pp_wwchan, &pp->pp_lock);
+	}
+	else {
+		KASSERT(vn == &pp->pp_wvnode);
+		pp->pp_writers = false;
+		wchan_wakeall(pp->pp_rwchan, &pp->pp_lock);
+	}
+	pollqueue_wakeup(&pp->pp_pollq);
+	gone = !pp->pp_readers && !pp->pp_writers;
+	spinlock_release(&pp->pp_lock);
+
+	vnode_cleanup(vn);
+	if (gone) {
+		pipe_destroy(pp);
+	}
+	return 0;
+}
+
+/*
+ * Wake everyone who might care that data or room appeared.
+ * Called with pp_lock held.
+ */
+static
+void
+pipe_changed(struct pipe *pp, struct wchan *wc)
+{
+	wchan_wakeall(wc, &pp->pp_lock);
+	pollqueue_wakeup(&pp->pp_pollq);
+}
+
+/*
+ * Read. Blocks until there is something to read, then takes as much
+ * as is there (up to the request) without blocking again. Pages
+ * handed off by the writer always predate anything in the ring.
+ *
+ * Nonblocking reads fail with EAGAIN instead of waiting for data, or
+ * for another reader to finish.
+ */
+static
+int
+pipe_read(struct vnode *vn, struct uio *uio)
+{
+	struct pipe *pp = vn->vn_data;
+	vaddr_t page, freepage;
+	size_t len, got;
+	int result = 0;
+
+	spinlock_acquire(&pp->pp_lock);
+	while (pp->pp_rbusy) {
+		if (uio->uio_nonblock) {
+			spinlock_release(&pp->pp_lock);
+			return EAGAIN;
+		}
+		wchan_sleep(pp->pp_rwchan, &pp->pp_lock);
+	}
+	pp->pp_rbusy = true;
+
+	got = 0;
+	while (uio->uio_resid > 0) {
+		while (pp->pp_count == 0 && pp->pp_npages == 0) {
+			if (got > 0 || !pp->pp_writers) {
+				goto done;
+			}
+			if (uio->uio_nonblock) {
+				result = EAGAIN;
+				goto done;
+			}
+			wchan_sleep(pp->pp_rwchan, &pp->pp_lock);
+		}
+
+		if (pp->pp_npages > 0) {
+			page = pp->pp_pages[pp->pp_phead];
+			len = PAGE_SIZE - pp->pp_poff;
+			if (len > uio->uio_resid) {
+				len = uio->uio_resid;
+			}
+			spinlock_release(&pp->pp_lock);
+
+			result = uiomove((char *)page + pp->pp_poff, len, uio);
+
+			spinlock_acquire(&pp->pp_lock);
+			if (result) {
+				goto done;
+			}
+			freepage = 0;
+			pp->pp_poff += len;
+			if (pp->pp_poff == PAGE_SIZE) {
+				freepage = page;
+				pp->pp_phead = (pp->pp_phead + 1) % PIPE_MAXPAGES;
+				pp->pp_npages--;
+				pp->pp_poff = 0;
+				pipe_changed(pp, pp->pp_wwchan);
+			}
+			if (freepage != 0) {
+				spinlock_release(&pp->pp_lock);
+				free_kpages(freepage);
+				spinlock_acquire(&pp->pp_lock);
+			}
+		}
+		else {
+			len = pp->pp_count;
+			if (len > PIPE_BUFSIZE - pp->pp_head) {
+				len = PIPE_BUFSIZE - pp->pp_head;
+			}
+			if (len > uio->uio_resid) {
+				len = uio->uio_resid;
+			}
+			spinlock_release(&pp->pp_lock);
+
+			result = uiomove(pp->pp_buf + pp->pp_head, len, uio);
+
+			spinlock_acquire(&pp->pp_lock);
+			if (result) {
+				goto done;
+			}
+			pp->pp_head = (pp->pp_head + len) % PIPE_BUFSIZE;
+			pp->pp_count -= len;
+			pipe_changed(pp, pp->pp_wwchan);
+		}
+		got += len;
+	}
+ done:
+	pp->pp_rbusy = false;
+	wchan_wakeall(pp->pp_rwchan, &pp->pp_lock);
+	spinlock_release(&pp->pp_lock);
+	return result;
+}
+
+/*
+ * Check if the rest of UIO can be handed off a page at a time.
+ */
+static
+bool
+pipe_canhandoff(struct uio *uio)
+{
+	if (uio->uio_segflg == UIO_SYSSPACE || uio->uio_resid <= PIPE_BUFSIZE) {
+		return false;
+	}
+	return ((vaddr_t)uio->uio_iov->iov_ubase % PAGE_SIZE) == 0 &&
+		uio->uio_iov->iov_len >= PAGE_SIZE;
+}
+
+/*
+ * Write. Doesn't return until everything is written, or the read end
+ * goes away.
+ *
+ * A nonblocking write takes what room there is and returns short;
+ * if there is none (or, for a write of up to PIPE_BUF bytes, not
+ * enough for all of it) it fails with EAGAIN.
+ */
+static
+int
+pipe_write(struct vnode *vn, struct uio *uio)
+{
+	struct pipe *pp = vn->vn_data;
+	vaddr_t page;
+	size_t len, tail, need, startresid;
+	bool handoff;
+	int result = 0;
+
+	/* a write of up to PIPE_BUF bytes waits for room for all of it */
+	startresid = uio->uio_resid;
+	need = startresid <= PIPE_BUF ? startresid : 1;
+
+	spinlock_acquire(&pp->pp_lock);
+	while (pp->pp_wbusy) {
+		if (uio->uio_nonblock) {
+			spinlock_release(&pp->pp_lock);
+			return EAGAIN;
+		}
+		wchan_sleep(pp->pp_wwchan, &pp->pp_lock);
+	}
+	pp->pp_wbusy = true;
+
+	while (uio->uio_resid > 0) {
+		handoff = pipe_canhandoff(uio);
+
+		while (1) {
+			if (!pp->pp_readers) {
+				result = EPIPE;
+				goto done;
+			}
+			if (handoff) {
+				/* keep order: the ring must drain first */
+				if (pp->pp_count == 0 &&
+				    pp->pp_npages < PIPE_MAXPAGES) {
+					break;
+				}
+			}
+			else {
+				if (pp->pp_npages == 0 &&
+				    PIPE_BUFSIZE - pp->pp_count >= need) {
+					break;
+				}
+			}
+			if (uio->uio_nonblock) {
+				if (uio->uio_resid == startresid) {
+					result = EAGAIN;
+				}
+				goto done;
+			}
+			wchan_sleep(pp->pp_wwchan, &pp->pp_lock);
+		}
+
+		if (handoff) {
+			spinlock_release(&pp->pp_lock);
+
+			page = alloc_kpages(1);
+			if (page == 0) {
+				result = ENOMEM;
+			}
+			else {
+				result = uiomove((void *)page, PAGE_SIZE, uio);
+				if (result) {
+					free_kpages(page);
+				}
+			}
+
+			spinlock_acquire(&pp->pp_lock);
+			if (result) {
+				goto done;
+			}
+			pp->pp_pages[(pp->pp_phead + pp->pp_npages) %
+				     PIPE_MAXPAGES] = page;
+			pp->pp_npages++;
+		}
+		else {
+			tail = (pp->pp_head + pp->pp_count) % PIPE_BUFSIZE;
+			len = PIPE_BUFSIZE - pp->pp_count;
+			if (len > PIPE_BUFSIZE - tail) {
+				len = PIPE_BUFSIZE - tail;
+			}
+			if (len > uio->uio_resid) {
+				len = uio->uio_resid;
+			}
+			spinlock_release(&pp->pp_lock);
+
+			/* the reader doesn't touch free space; no lock needed */
+			result = uiomove(pp->pp_buf + tail, len, uio);
+
+			spinlock_acquire(&pp->pp_lock);
+			if (result) {
+				goto done;
+			}
+			pp->pp_count += len;
+		}
+		pipe_changed(pp, pp->pp_rwchan);
+		need = 1;
+	}
+ done:
+	pp->pp_wbusy = false;
+	wchan_wakeall(pp->pp_wwchan, &pp->pp_lock);
+	spinlock_release(&pp->pp_lock);
+	return result;
+}
+
+/*
+ * Poll. The read end is readable when there is data or no writer
+ * (EOF); the write end is writable when there is room for at least
+ * PIPE_BUF bytes, and reports POLLHUP once the reader is gone.
+ */
+static
+int
+pipe_poll(struct vnode *vn, int events, int *revents, struct pollentry *pe)
+{
+	struct pipe *pp = vn->vn_data;
+	int rev = 0;
+
+	spinlock_acquire(&pp->pp_lock);
+	pollqueue_add(&pp->pp_pollq, pe);
+	if (vn == &pp->pp_rvnode) {
+		if (pp->pp_count > 0 || pp->pp_npages > 0) {
+			rev |= events & POLLIN;
+		}
+		else if (!pp->pp_writers) {
+			rev |= (events & POLLIN) | POLLHUP;
+		}
+	}
+	else {
+		if (!pp->pp_readers) {
+			rev |= POLLHUP;
+		}
+		else if (pp->pp_npages == 0 &&
+			 PIPE_BUFSIZE - pp->pp_count >= PIPE_BUF) {
+			rev |= events & POLLOUT;
+		}
+	}
+	spinlock_release(&pp->pp_lock);
+
+	*revents = rev;
+	return 0;
+}
+
+static
+int
+pipe_eachopen(struct vnode *vn, int openflags)
+{
+	(void)vn;
+	(void)openflags;
+
+	/* pipes are never opened by name */
+	return EINVAL;
+}
+
+static
+int
+pipe_ioctl(struct vnode *vn, int op, userptr_t data)
+{
+	(void)vn;
+	(void)op;
+	(void)data;
+	return EINVAL;
+}
+
+static
+int
+pipe_stat(struct vnode *vn, struct stat *buf)
+{
+	struct pipe *pp = vn->vn_data;
+
+	bzero(buf, sizeof(*buf));
+
+	spinlock_acquire(&pp->pp_lock);
+	buf->st_size = pp->pp_count + pp->pp_npages * PAGE_SIZE - pp->pp_poff;
+	spinlock_release(&pp->pp_lock);
+
+	buf->st_mode = S_IFIFO | 0600;
+	buf->st_nlink = 1;
+	buf->st_blksize = PIPE_BUFSIZE;
+
+	return 0;
+}
+
+static
+int
+pipe_gettype(struct vnode *vn, mode_t *ret)
+{
+	(void)vn;
+	*ret = S_IFIFO;
+	return 0;
+}
+
+static
+bool
+pipe_isseekable(struct vnode *vn)
+{
+	(void)vn;
+	return false;
+}
+
+static
+int
+pipe_fsync(struct vnode *vn)
+{
+	(void)vn;
+	return EINVAL;
+}
+
+static
+int
+pipe_truncate(struct vnode *vn, off_t len)
+{
+	(void)vn;
+	(void)len;
+	return EINVAL;
+}
+
+/*
+ * Vnode ops tables for the two ends.
+ */
+static const struct vnode_ops pipe_readops = {
+	.vop_magic = VOP_MAGIC,
+
+	.vop_eachopen = pipe_eachopen,
+	.vop_reclaim = pipe_reclaim,
+
+	.vop_read = pipe_read,
+	.vop_readlink = vopfail_uio_inval,
+	.vop_getdirentry = vopfail_uio_notdir,
+	.vop_write = vopfail_uio_inval,
+	.vop_ioctl = pipe_ioctl,
+	.vop_stat = pipe_stat,
+	.vop_gettype = pipe_gettype,
+	.vop_isseekable = pipe_isseekable,
+	.vop_fsync = pipe_fsync,
+	.vop_mmap = vopfail_mmap_perm,
+	.vop_truncate = pipe_truncate,
+	.vop_namefile = vopfail_uio_notdir,
+	.vop_poll = pipe_poll,
+
+	.vop_creat = vopfail_creat_notdir,
+	.vop_symlink = vopfail_symlink_notdir,
+	.vop_mkdir = vopfail_mkdir_notdir,
+	.vop_link = vopfail_link_notdir,
+	.vop_remove = vopfail_string_notdir,
+	.vop_rmdir = vopfail_string_notdir,
+	.vop_rename = vopfail_rename_notdir,
+	.vop_lookup = vopfail_lookup_notdir,
+	.vop_lookparent = vopfail_lookparent_notdir,
+};
+
+static const struct vnode_ops pipe_writeops = {
+	.vop_magic = VOP_MAGIC,
+
+	.vop_eachopen = pipe_eachopen,
+	.vop_reclaim = pipe_reclaim,
+
+	.vop_read = vopfail_uio_inval,
+	.vop_readlink = vopfail_uio_inval,
+	.vop_getdirentry = vopfail_uio_notdir,
+	.vop_write = pipe_write,
+	.vop_ioctl = pipe_ioctl,
+	.vop_stat = pipe_stat,
+	.vop_gettype = pipe_gettype,
+	.vop_isseekable = pipe_isseekable,
+	.vop_fsync = pipe_fsync,
+	.vop_mmap = vopfail_mmap_perm,
+	.vop_truncate = pipe_truncate,
+	.vop_namefile = vopfail_uio_notdir,
+	.vop_poll = pipe_poll,
+
+	.vop_creat = vopfail_creat_notdir,
+	.vop_symlink = vopfail_symlink_notdir,
+	.vop_mkdir = vopfail_mkdir_notdir,
+	.vop_link = vopfail_link_notdir,
+	.vop_remove = vopfail_string_notdir,
+	.vop_rmdir = vopfail_string_notdir,
+	.vop_rename = vopfail_rename_notdir,
+	.vop_lookup = vopfail_lookup_notdir,
+	.vop_lookparent = vopfail_lookparent_notdir,
+};
+
+/*
+ * Constructor.
+ */
+int
+pipe_create(struct vnode **readend, struct vnode **writeend)
+{
+	struct pipe *pp;
+	int result;
+
+	pp = kmalloc(sizeof(*pp));
+	if (pp == NULL) {
+		return ENOMEM;
+	}
+	pp->pp_buf = kmalloc(PIPE_BUFSIZE);
+	if (pp->pp_buf == NULL) {
+		goto fail_pp;
+	}
+	pp->pp_rwchan = wchan_create("pipe reader");
+	if (pp->pp_rwchan == NULL) {
+		goto fail_buf;
+	}
+	pp->pp_wwchan = wchan_create("pipe writer");
+	if (pp->pp_wwchan == NULL) {
+		goto fail_rwchan;
+	}
+
+	spinlock_init(&pp->pp_lock);
+	pollqueue_init(&pp->pp_pollq);
+	pp->pp_readers = true;
+	pp->pp_writers = true;
+	pp->pp_head = 0;
+	pp->pp_count = 0;
+	pp->pp_phead = 0;
+	pp->pp_npages = 0;
+	pp->pp_poff = 0;
+	pp->pp_rbusy = false;
+	pp->pp_wbusy = false;
+
+	result = vnode_init(&pp->pp_rvnode, &pipe_readops, NULL, pp);
+	if (result) {
+		goto fail_lock;
+	}
+	result = vnode_init(&pp->pp_wvnode, &pipe_writeops, NULL, pp);
+	if (result) {
+		vnode_cleanup(&pp->pp_rvnode);
+		goto fail_lock;
+	}
+
+	*readend = &pp->pp_rvnode;
+	*writeend = &pp->pp_wvnode;
+	return 0;
+
+ fail_lock:
+	pollqueue_cleanup(&pp->pp_pollq);
+	spinlock_cleanup(&pp->pp_lock);
+	wchan_destroy(pp->pp_wwchan);
+ fail_rwchan:
+	wchan_destroy(pp->pp_rwchan);
+ fail_buf:
+	kfree(pp->pp_buf);
+ fail_pp:
+	kfree(pp);
+	return ENOMEM;
+}
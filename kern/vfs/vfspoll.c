@@ -0,0 +1,185 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * Poll wait queues. See poll.h.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <timeout.h>
+#include <poll.h>
+
+////////////////////////////////////////////////////////////
+// queues
+
+void
+pollqueue_init(struct pollqueue *pq)
+{
+	spinlock_init(&pq->pq_lock);
+	pq->pq_head.pe_next = &pq->pq_head;
+	pq->pq_head.pe_prev = &pq->pq_head;
+	pq->pq_head.pe_queue = pq;
+	pq->pq_head.pe_waiter = NULL;
+}
+
+void
+pollqueue_cleanup(struct pollqueue *pq)
+{
+	KASSERT(pq->pq_head.pe_next == &pq->pq_head);
+	spinlock_cleanup(&pq->pq_lock);
+}
+
+void
+pollqueue_add(struct pollqueue *pq, struct pollentry *pe)
+{
+	if (pe == NULL) {
+		return;
+	}
+	KASSERT(pe->pe_queue == NULL);
+
+	spinlock_acquire(&pq->pq_lock);
+	pe->pe_next = pq->pq_head.pe_next;
+	pe->pe_prev = &pq->pq_head;
+	pe->pe_next->pe_prev = pe;
+	pq->pq_head.pe_next = pe;
+	pe->pe_queue = pq;
+	spinlock_release(&pq->pq_lock);
+}
+
+static
+void
+pollwaiter_fire(struct pollwaiter *pw)
+{
+	spinlock_acquire(&pw->pw_lock);
+	pw->pw_fired = true;
+	wchan_wakeall(pw->pw_wchan, &pw->pw_lock);
+	spinlock_release(&pw->pw_lock);
+}
+
+void
+pollqueue_wakeup(struct pollqueue *pq)
+{
+	struct pollentry *pe;
+
+	spinlock_acquire(&pq->pq_lock);
+	for (pe = pq->pq_head.pe_next; pe != &pq->pq_head; pe = pe->pe_next) {
+		pollwaiter_fire(pe->pe_waiter);
+	}
+	spinlock_release(&pq->pq_lock);
+}
+
+////////////////////////////////////////////////////////////
+// waiters
+
+/*
+ * Timeout function: the deadline has passed.
+ */
+static
+void
+pollwaiter_timedout(void *arg)
+{
+	struct pollwaiter *pw = arg;
+
+	spinlock_acquire(&pw->pw_lock);
+	pw->pw_timedout = true;
+	wchan_wakeall(pw->pw_wchan, &pw->pw_lock);
+	spinlock_release(&pw->pw_lock);
+}
+
+int
+pollwaiter_init(struct pollwaiter *pw)
+{
+	pw->pw_wchan = wchan_create("poll");
+	if (pw->pw_wchan == NULL) {
+		return ENOMEM;
+	}
+	spinlock_init(&pw->pw_lock);
+	pw->pw_fired = false;
+	pw->pw_timedout = false;
+	timeout_init(&pw->pw_timeout, pollwaiter_timedout, pw);
+	return 0;
+}
+
+void
+pollwaiter_cleanup(struct pollwaiter *pw)
+{
+	timeout_cancel(&pw->pw_timeout);
+	spinlock_cleanup(&pw->pw_lock);
+	wchan_destroy(pw->pw_wchan);
+}
+
+void
+pollentry_init(struct pollentry *pe, struct pollwaiter *pw)
+{
+	pe->pe_next = pe->pe_prev = NULL;
+	pe->pe_queue = NULL;
+	pe->pe_waiter = pw;
+}
+
+void
+pollentry_remove(struct pollentry *pe)
+{
+	struct pollqueue *pq = pe->pe_queue;
+
+	if (pq == NULL) {
+		return;
+	}
+	spinlock_acquire(&pq->pq_lock);
+	pe->pe_prev->pe_next = pe->pe_next;
+	pe->pe_next->pe_prev = pe->pe_prev;
+	pe->pe_queue = NULL;
+	spinlock_release(&pq->pq_lock);
+}
+
+void
+pollwaiter_settimeout(struct pollwaiter *pw, unsigned ticks)
+{
+	KASSERT(!timeout_pending(&pw->pw_timeout));
+	timeout_set(&pw->pw_timeout, ticks);
+}
+
+bool
+pollwaiter_wait(struct pollwaiter *pw)
+{
+	bool timedout;
+
+	spinlock_acquire(&pw->pw_lock);
+	while (!pw->pw_fired && !pw->pw_timedout) {
+		wchan_sleep(pw->pw_wchan, &pw->pw_lock);
+	}
+	pw->pw_fired = false;
+	timedout = pw->pw_timedout;
+	spinlock_release(&pw->pw_lock);
+	return timedout;
+}
@@ -32,6 +32,7 @@
  */
 #include <types.h>
 #include <kern/errno.h>
+#include <kern/poll.h>
 #include <lib.h>
 #include <synch.h>
 #include <vfs.h>
@@ -50,6 +51,7 @@ vnode_init(struct vnode *vn, const struct vnode_ops *ops,
 	vn->vn_ops = ops;
 	vn->vn_refcount = 1;
 	spinlock_init(&vn->vn_countlock);
+	spinlock_setname(&vn->vn_countlock, "vn_countlock");
 	vn->vn_fs = fs;
 	vn->vn_data = fsdata;
 	return 0;
@@ -176,3 +178,17 @@ vnode_check(struct vnode *v, const char *opstr)
 	spinlock_release(&v->vn_countlock);
 	/*vfs_biglock_release();*/
 }
+
+/*
+ * vop_poll for objects that never block.
+ */
+int
+vnode_poll_ready(struct vnode *vn, int events, int *revents,
+		 struct pollentry *pe)
+{
+	(void)vn;
+	(void)pe;
+
+	*revents = events & (POLLIN | POLLOUT);
+	return 0;
+}
@@ -32,7 +32,8 @@ int pagetable_init(int length){
     }
     pg -> pbase = ram_getfirst() & PAGE_FRAME;
     pg -> length = ((int)ram_getsize())/PAGE_SIZE;
-    spinlock_init(&pg->pagetable_lock);
+    spinlock_init_queued(&pg->pagetable_lock);
+    spinlock_setname(&pg->pagetable_lock, "pagetable_lock");
     return 1;
 }
 
@@ -80,6 +81,7 @@ void pagetable_remove_entries(pid_t pid){
 	spinlock_acquire(&pg->pagetable_lock);
 	for(i=0;i<pg->length;i++){
 		if(pg->pids[i]==pid){
+			freeppages((paddr_t) (i * PAGE_SIZE) + pg->pbase, 1);
 			pg ->control[i] =0;
 			pg->pids[i] = -1;
 			pg->v_pages[i] = 0x0;	
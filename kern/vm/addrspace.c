@@ -37,10 +37,52 @@
 #include <mips/tlb.h>
 #include <vfs.h>
 #include <current.h>
+#include <cpu.h>
+#include <synch.h>
+#include <slab.h>
+
+/*
+ * Address spaces come from a cache; each keeps its as_faultsem from
+ * one use to the next.
+ */
+static struct kmem_cache *as_cache;
+
+static
+int
+as_ctor(void *obj)
+{
+	struct addrspace *as = obj;
+
+	as->as_faultsem = sem_create("as_fault", 1);
+	if (as->as_faultsem == NULL) {
+		return ENOMEM;
+	}
+	return 0;
+}
+
+static
+void
+as_dtor(void *obj)
+{
+	struct addrspace *as = obj;
+
+	sem_destroy(as->as_faultsem);
+}
+
+void
+as_bootstrap(void)
+{
+	as_cache = kmem_cache_create("addrspace", sizeof(struct addrspace), 0,
+				     as_ctor, as_dtor);
+	if (as_cache == NULL) {
+		panic("as_bootstrap: Out of memory\n");
+	}
+}
+
 struct addrspace *
 as_create(void)
 {
-	struct addrspace *as = kmalloc(sizeof(struct addrspace));
+	struct addrspace *as = kmem_cache_alloc(as_cache);
 	if (as==NULL) {
 		return NULL;
 	}
@@ -54,14 +96,47 @@ as_create(void)
 	as->as_stackpbase = 0;
 	as->code_read_complete=0;
 	as->data_read_complete=0;
+	as->as_resident = 0;
+	as->v = NULL;
+	/* as_faultsem: as_ctor */
 	return as;
 }
 
+/*
+ * Page table entries are tagged by pid only, so this must be called
+ * by the process owning AS. An address space that never had a page
+ * faulted in (e.g. a new image execv gave up on) owns no entries and
+ * leaves the ones of its pid alone.
+ */
 void as_destroy(struct addrspace *as){
+  int i, spl;
+  uint32_t ehi, elo;
+  struct tlbshootdown ts;
+  pid_t pid = curproc->pid;
+
   dumbvm_can_sleep();
-  pagetable_remove_entries(curproc->pid);
-  vfs_close(as->v);
-  kfree(as);
+  if (as->as_resident > 0) {
+    pagetable_remove_entries(pid);
+
+    /* the pid may be reused: drop its translations too */
+    spl = splhigh();
+    for (i=0; i<NUM_TLB; i++) {
+      tlb_read(&ehi, &elo, i);
+      if ((pid_t)(ehi & 0xfff) == pid) {
+        tlb_write(TLBHI_INVALID(i), TLBLO_INVALID(), i);
+      }
+    }
+    splx(spl);
+
+    /* threads of ours may have run on other cpus too */
+    ts.ts_pid = pid;
+    ipi_tlbshootdown_broadcast(&ts);
+  }
+  if (as->v != NULL) {
+    vfs_close(as->v);
+  }
+  /* nothing can be faulting on a dying AS: as_faultsem is back at 1 */
+  kmem_cache_free(as_cache, as);
 }
 
 void
@@ -70,12 +145,14 @@ as_activate(void)
 	int i, spl;
 	struct addrspace *as;
 	uint32_t ehi,elo;
-	pid_t pid = curproc->pid;
-	(void) pid;
+	pid_t pid;
+
 	as = proc_getas();
 	if (as == NULL) {
+		/* kernel thread, or a process on its way out */
 		return;
 	}
+	pid = curproc->pid;
 
 	/* Disable interrupts on this CPU while frobbing the TLB. */
 	spl = splhigh();
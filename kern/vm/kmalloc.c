@@ -30,6 +30,9 @@
 #include <types.h>
 #include <lib.h>
 #include <spinlock.h>
+#include <spl.h>
+#include <cpu.h>
+#include <current.h>
 #include <vm.h>
 
 /*
@@ -121,6 +124,15 @@ fill_deadbeef(void *vptr, size_t len)
 #undef CHECKBEEF
 #undef CHECKGUARDS
 
+/*
+ * MAGAZINES puts a per-CPU cache of free blocks of each size in front
+ * of the shared pages; see below. It is on unless GUARDS or LABELS
+ * is, since blocks sitting in a magazine bypass their checks.
+ */
+#if !defined(GUARDS) && !defined(LABELS)
+#define MAGAZINES
+#endif
+
 ////////////////////////////////////////
 
 #if PAGE_SIZE == 4096
@@ -160,13 +172,14 @@ struct pageref {
 ////////////////////////////////////////
 
 /*
- * Use one spinlock for the whole thing. Making parts of the kmalloc
- * logic per-cpu is worthwhile for scalability; however, for the time
- * being at least we won't, because it adds a lot of complexity and in
- * OS/161 performance and scalability aren't super-critical.
+ * Use one spinlock for the pages and their bookkeeping. Most small
+ * allocations and frees never get here, though: with MAGAZINES they
+ * are served from per-CPU caches, which come here only to refill or
+ * drain in batches.
  */
 
-static struct spinlock kmalloc_spinlock = SPINLOCK_INITIALIZER;
+static struct spinlock kmalloc_spinlock =
+	SPINLOCK_QUEUED_INITIALIZER("kmalloc_spinlock");
 
 ////////////////////////////////////////
 
@@ -212,6 +225,53 @@ struct kheap_root {
 
 static struct kheap_root kheaproots[NUM_PAGEREFPAGES];
 
+/*
+ * Map from heap page to its pageref, so kfree can find the pageref
+ * (and with it the block size) without searching, and without the
+ * lock. A page goes in slot (address / PAGE_SIZE) % TOTAL_PAGEREFS,
+ * which can't collide as long as there's no more RAM than pagerefs.
+ * If there is, the second page to want a slot just isn't mapped and
+ * is found the slow way; kheap_pagemap_collided says whether to
+ * bother looking.
+ *
+ * Reading the map without the lock is safe for a block that is still
+ * allocated: its page can't be freed, so the pageref it maps to stays
+ * put. A stale or colliding slot shows up as a pageref for some other
+ * page.
+ */
+static struct pageref *volatile kheap_pagemap[TOTAL_PAGEREFS];
+static bool kheap_pagemap_collided;
+
+#define PAGEMAP_SLOT(va) (((va) / PAGE_SIZE) % TOTAL_PAGEREFS)
+
+/*
+ * Enter or remove PR in the map. Call with kmalloc_spinlock held.
+ */
+static
+void
+pagemap_add(struct pageref *pr)
+{
+	unsigned slot = PAGEMAP_SLOT(PR_PAGEADDR(pr));
+
+	if (kheap_pagemap[slot] == NULL) {
+		kheap_pagemap[slot] = pr;
+	}
+	else {
+		kheap_pagemap_collided = true;
+	}
+}
+
+static
+void
+pagemap_remove(struct pageref *pr)
+{
+	unsigned slot = PAGEMAP_SLOT(PR_PAGEADDR(pr));
+
+	if (kheap_pagemap[slot] == pr) {
+		kheap_pagemap[slot] = NULL;
+	}
+}
+
 /*
  * Allocate a page to hold pagerefs.
  */
@@ -844,6 +904,73 @@ remove_lists(struct pageref *pr, int blktype)
 	}
 }
 
+/*
+ * Find the pageref for the heap page containing the block at
+ * PTRADDR, which must not be free. Returns NULL if it isn't on a heap
+ * page. Call without kmalloc_spinlock.
+ */
+static
+struct pageref *
+subpage_lookup(vaddr_t ptraddr)
+{
+	struct pageref *pr;
+	vaddr_t page;
+
+	page = ptraddr & PAGE_FRAME;
+	pr = kheap_pagemap[PAGEMAP_SLOT(page)];
+	if (pr != NULL && PR_PAGEADDR(pr) == page) {
+		return pr;
+	}
+	if (!kheap_pagemap_collided) {
+		return NULL;
+	}
+
+	spinlock_acquire(&kmalloc_spinlock);
+	for (pr = allbase; pr != NULL; pr = pr->next_all) {
+		checksubpage(pr);
+		if (PR_PAGEADDR(pr) == page) {
+			break;
+		}
+	}
+	spinlock_release(&kmalloc_spinlock);
+	return pr;
+}
+
+/*
+ * Take one block off PR's freelist. Call with kmalloc_spinlock held.
+ */
+static
+void *
+subpage_popblock(struct pageref *pr)
+{
+	vaddr_t prpage;		// PR_PAGEADDR(pr)
+	vaddr_t fla;		// free list entry address
+	struct freelist *fl;	// free list entry
+	void *retptr;
+
+	KASSERT(pr->nfree > 0);
+	KASSERT(pr->freelist_offset < PAGE_SIZE);
+	prpage = PR_PAGEADDR(pr);
+	fla = prpage + pr->freelist_offset;
+	fl = (struct freelist *)fla;
+
+	retptr = fl;
+	fl = fl->next;
+	pr->nfree--;
+
+	if (fl != NULL) {
+		KASSERT(pr->nfree > 0);
+		fla = (vaddr_t)fl;
+		KASSERT(fla - prpage < PAGE_SIZE);
+		pr->freelist_offset = fla - prpage;
+	}
+	else {
+		KASSERT(pr->nfree == 0);
+		pr->freelist_offset = INVALID_OFFSET;
+	}
+	return retptr;
+}
+
 /*
  * Given a requested client size, return the block type, that is, the
  * index into the sizes[] array for the block size to use.
@@ -921,25 +1048,7 @@ subpage_kmalloc(size_t sz
 
 		doalloc: /* comes here after getting a whole fresh page */
 
-			KASSERT(pr->freelist_offset < PAGE_SIZE);
-			prpage = PR_PAGEADDR(pr);
-			fla = prpage + pr->freelist_offset;
-			fl = (struct freelist *)fla;
-
-			retptr = fl;
-			fl = fl->next;
-			pr->nfree--;
-
-			if (fl != NULL) {
-				KASSERT(pr->nfree > 0);
-				fla = (vaddr_t)fl;
-				KASSERT(fla - prpage < PAGE_SIZE);
-				pr->freelist_offset = fla - prpage;
-			}
-			else {
-				KASSERT(pr->nfree == 0);
-				pr->freelist_offset = INVALID_OFFSET;
-			}
+			retptr = subpage_popblock(pr);
 #ifdef GUARDS
 			retptr = establishguardband(retptr, clientsz, sz);
 #endif
@@ -1013,29 +1122,118 @@ subpage_kmalloc(size_t sz
 	pr->next_all = allbase;
 	allbase = pr;
 
+	pagemap_add(pr);
+
 	/* This is kind of cheesy, but avoids duplicating the alloc code. */
 	goto doalloc;
 }
 
 /*
- * Free a pointer previously returned from subpage_kmalloc. If the
- * pointer is not on any heap page we recognize, return -1.
+ * Put the block at BLOCKADDR back on PR's freelist. If that frees the
+ * whole page, drop the page from the heap and return its address for
+ * the caller to hand to free_kpages once it has let go of the lock;
+ * otherwise return 0. Call with kmalloc_spinlock held.
  */
 static
-int
-subpage_kfree(void *ptr)
+vaddr_t
+subpage_freeblock(struct pageref *pr, vaddr_t blockaddr)
 {
 	int blktype;		// index into sizes[] that we're using
-	vaddr_t ptraddr;	// same as ptr
-	struct pageref *pr;	// pageref for page we're freeing in
 	vaddr_t prpage;		// PR_PAGEADDR(pr)
-	vaddr_t fla;		// free list entry address
 	struct freelist *fl;	// free list entry
 	vaddr_t offset;		// offset into page
+
+	prpage = PR_PAGEADDR(pr);
+	blktype = PR_BLOCKTYPE(pr);
+	offset = blockaddr - prpage;
+	KASSERT(offset < PAGE_SIZE);
+
+	/*
+	 * We probably ought to check for free twice by seeing if the block
+	 * is already on the free list. But that's expensive, so we don't.
+	 */
+
+	fl = (struct freelist *)blockaddr;
+	if (pr->freelist_offset == INVALID_OFFSET) {
+		fl->next = NULL;
+	} else {
+		fl->next = (struct freelist *)(prpage + pr->freelist_offset);
+
+		/* this block should not already be on the free list! */
+#ifdef SLOW
+		{
+			struct freelist *fl2;
+
+			for (fl2 = fl->next; fl2 != NULL; fl2 = fl2->next) {
+				KASSERT(fl2 != fl);
+			}
+		}
+#else
+		/* check just the head */
+		KASSERT(fl != fl->next);
+#endif
+	}
+	pr->freelist_offset = offset;
+	pr->nfree++;
+
+	KASSERT(pr->nfree <= PAGE_SIZE / sizes[blktype]);
+	if (pr->nfree == PAGE_SIZE / sizes[blktype]) {
+		/* Whole page is free. */
+		remove_lists(pr, blktype);
+		pagemap_remove(pr);
+		freepageref(pr);
+		return prpage;
+	}
+	return 0;
+}
+
+/*
+ * Check that PTRADDR is a proper block of PR's page, and deadbeef it.
+ */
+static
+void
+subpage_checkfree(struct pageref *pr, vaddr_t ptraddr, void *ptr)
+{
+	int blktype;		// index into sizes[] that we're using
+	vaddr_t offset;		// offset into page
 #ifdef GUARDS
 	size_t blocksize, smallerblocksize;
 #endif
 
+	blktype = PR_BLOCKTYPE(pr);
+	KASSERT(blktype >= 0 && blktype < NSIZES);
+	offset = ptraddr - PR_PAGEADDR(pr);
+
+	/* Check for proper positioning and alignment */
+	if (offset >= PAGE_SIZE || offset % sizes[blktype] != 0) {
+		panic("kfree: subpage free of invalid addr %p\n", ptr);
+	}
+
+#ifdef GUARDS
+	blocksize = sizes[blktype];
+	smallerblocksize = blktype > 0 ? sizes[blktype - 1] : 0;
+	checkguardband(ptraddr, smallerblocksize, blocksize);
+#endif
+
+	/*
+	 * Clear the block to 0xdeadbeef to make it easier to detect
+	 * uses of dangling pointers.
+	 */
+	fill_deadbeef((void *)ptraddr, sizes[blktype]);
+}
+
+/*
+ * Free a pointer previously returned from subpage_kmalloc. If the
+ * pointer is not on any heap page we recognize, return -1.
+ */
+static
+int
+subpage_kfree(void *ptr)
+{
+	vaddr_t ptraddr;	// same as ptr
+	struct pageref *pr;	// pageref for page we're freeing in
+	vaddr_t freepage;	// page to give back, or 0
+
 	ptraddr = (vaddr_t)ptr;
 #ifdef GUARDS
 	if (ptraddr % PAGE_SIZE == 0) {
@@ -1061,100 +1259,259 @@ subpage_kfree(void *ptr)
 	ptraddr -= LABEL_PTROFFSET;
 #endif
 
-	spinlock_acquire(&kmalloc_spinlock);
+	pr = subpage_lookup(ptraddr);
+	if (pr == NULL) {
+		/* Not on any of our pages - not a subpage allocation */
+		return -1;
+	}
+	subpage_checkfree(pr, ptraddr, ptr);
 
+	spinlock_acquire(&kmalloc_spinlock);
+	checksubpages();
+	checksubpage(pr);
+	freepage = subpage_freeblock(pr, ptraddr);
 	checksubpages();
+	spinlock_release(&kmalloc_spinlock);
 
-	for (pr = allbase; pr; pr = pr->next_all) {
-		prpage = PR_PAGEADDR(pr);
-		blktype = PR_BLOCKTYPE(pr);
-		KASSERT(blktype >= 0 && blktype < NSIZES);
+	/* Call free_kpages without kmalloc_spinlock. */
+	if (freepage != 0) {
+		free_kpages(freepage);
+	}
 
-		/* check for corruption */
-		KASSERT(blktype>=0 && blktype<NSIZES);
-		checksubpage(pr);
+	return 0;
+}
 
-		if (ptraddr >= prpage && ptraddr < prpage + PAGE_SIZE) {
-			break;
-		}
-	}
+#ifdef MAGAZINES
+////////////////////////////////////////
+//
+// Per-CPU magazines.
+//
+// Each CPU keeps, for each block size, a magazine: a stack of free
+// blocks it can hand out and take back with interrupts off and no
+// lock at all. When the magazine runs dry it is refilled with half
+// a magazine's worth of blocks from the shared pages, under
+// kmalloc_spinlock; when it overflows, half of it is drained back.
+// So a CPU allocating and freeing at a steady rate takes the lock
+// once per batch instead of once per call.
+//
+// Blocks in a magazine are allocated as far as the pages (and
+// kheap_printstats) are concerned. To limit how much memory sits in
+// magazines, a magazine holds at most one page's worth of blocks.
+//
 
-	if (pr==NULL) {
-		/* Not on any of our pages - not a subpage allocation */
-		spinlock_release(&kmalloc_spinlock);
-		return -1;
-	}
+#define KMALLOC_MAXCPUS	32
+#define KMALLOC_MAGSIZE	16
 
-	offset = ptraddr - prpage;
+struct kmagazine {
+	unsigned km_count;
+	void *km_blocks[KMALLOC_MAGSIZE];
+};
 
-	/* Check for proper positioning and alignment */
-	if (offset >= PAGE_SIZE || offset % sizes[blktype] != 0) {
-		panic("kfree: subpage free of invalid addr %p\n", ptr);
+struct kmalloc_cpu {
+	struct kmagazine kc_mags[NSIZES];
+};
+
+static struct kmalloc_cpu *kmalloc_cpus[KMALLOC_MAXCPUS];
+
+/*
+ * Set up the magazines for a new CPU. Until this has been done the
+ * CPU uses the shared pages directly.
+ */
+void
+kmalloc_cpu_init(unsigned cpunum)
+{
+	struct kmalloc_cpu *kc;
+
+	if (cpunum >= KMALLOC_MAXCPUS) {
+		return;
 	}
+	kc = kmalloc(sizeof(*kc));
+	if (kc == NULL) {
+		panic("kmalloc: Out of memory for cpu %u magazines\n", cpunum);
+	}
+	bzero(kc, sizeof(*kc));
+	kmalloc_cpus[cpunum] = kc;
+}
 
-#ifdef GUARDS
-	blocksize = sizes[blktype];
-	smallerblocksize = blktype > 0 ? sizes[blktype - 1] : 0;
-	checkguardband(ptraddr, smallerblocksize, blocksize);
-#endif
+/*
+ * Magazine capacity for block type BLKTYPE.
+ */
+static
+unsigned
+kmag_capacity(unsigned blktype)
+{
+	unsigned n = PAGE_SIZE / sizes[blktype];
 
-	/*
-	 * Clear the block to 0xdeadbeef to make it easier to detect
-	 * uses of dangling pointers.
-	 */
-	fill_deadbeef((void *)ptraddr, sizes[blktype]);
+	return n < KMALLOC_MAGSIZE ? n : KMALLOC_MAGSIZE;
+}
 
-	/*
-	 * We probably ought to check for free twice by seeing if the block
-	 * is already on the free list. But that's expensive, so we don't.
-	 */
+/*
+ * Return the current CPU's magazine for BLKTYPE, or NULL if it has
+ * none. Call with interrupts off.
+ */
+static
+struct kmagazine *
+kmag_get(unsigned blktype)
+{
+	struct kmalloc_cpu *kc;
 
-	fla = prpage + offset;
-	fl = (struct freelist *)fla;
-	if (pr->freelist_offset == INVALID_OFFSET) {
-		fl->next = NULL;
-	} else {
-		fl->next = (struct freelist *)(prpage + pr->freelist_offset);
+	if (!CURCPU_EXISTS() || curcpu->c_number >= KMALLOC_MAXCPUS) {
+		return NULL;
+	}
+	kc = kmalloc_cpus[curcpu->c_number];
+	if (kc == NULL) {
+		return NULL;
+	}
+	return &kc->kc_mags[blktype];
+}
 
-		/* this block should not already be on the free list! */
-#ifdef SLOW
-		{
-			struct freelist *fl2;
+/*
+ * Refill an empty magazine halfway from pages that have free blocks.
+ * Doesn't get new pages; if none has any, the magazine stays empty.
+ */
+static
+void
+kmag_refill(struct kmagazine *m, unsigned blktype)
+{
+	struct pageref *pr;
+	unsigned want;
 
-			for (fl2 = fl->next; fl2 != NULL; fl2 = fl2->next) {
-				KASSERT(fl2 != fl);
-			}
+	KASSERT(m->km_count == 0);
+	want = (kmag_capacity(blktype) + 1) / 2;
+
+	spinlock_acquire(&kmalloc_spinlock);
+	checksubpages();
+	for (pr = sizebases[blktype];
+	     pr != NULL && m->km_count < want;
+	     pr = pr->next_samesize) {
+		KASSERT(PR_BLOCKTYPE(pr) == blktype);
+		checksubpage(pr);
+		while (pr->nfree > 0 && m->km_count < want) {
+			m->km_blocks[m->km_count++] = subpage_popblock(pr);
 		}
-#else
-		/* check just the head */
-		KASSERT(fl != fl->next);
-#endif
 	}
-	pr->freelist_offset = offset;
-	pr->nfree++;
+	checksubpages();
+	spinlock_release(&kmalloc_spinlock);
+}
 
-	KASSERT(pr->nfree <= PAGE_SIZE / sizes[blktype]);
-	if (pr->nfree == PAGE_SIZE / sizes[blktype]) {
-		/* Whole page is free. */
-		remove_lists(pr, blktype);
-		freepageref(pr);
-		/* Call free_kpages without kmalloc_spinlock. */
-		spinlock_release(&kmalloc_spinlock);
-		free_kpages(prpage);
-	}
-	else {
-		spinlock_release(&kmalloc_spinlock);
+/*
+ * Give back N blocks to their pages.
+ */
+static
+void
+kmag_drain(void **blocks, unsigned n)
+{
+	struct pageref *prs[KMALLOC_MAGSIZE];
+	vaddr_t freepages[KMALLOC_MAGSIZE];
+	unsigned i, nfreepages;
+	vaddr_t freepage;
+
+	KASSERT(n <= KMALLOC_MAGSIZE);
+
+	/* Look these up first; subpage_lookup may need the lock. */
+	for (i=0; i<n; i++) {
+		prs[i] = subpage_lookup((vaddr_t)blocks[i]);
+		KASSERT(prs[i] != NULL);
 	}
 
-#ifdef SLOWER /* Don't get the lock unless checksubpages does something. */
+	nfreepages = 0;
 	spinlock_acquire(&kmalloc_spinlock);
 	checksubpages();
+	for (i=0; i<n; i++) {
+		freepage = subpage_freeblock(prs[i], (vaddr_t)blocks[i]);
+		if (freepage != 0) {
+			freepages[nfreepages++] = freepage;
+		}
+	}
+	checksubpages();
 	spinlock_release(&kmalloc_spinlock);
-#endif
 
-	return 0;
+	for (i=0; i<nfreepages; i++) {
+		free_kpages(freepages[i]);
+	}
+}
+
+/*
+ * Allocate a block of type BLKTYPE from this CPU's magazine, or
+ * return NULL if that can't be done without getting a new page.
+ */
+static
+void *
+kmag_alloc(unsigned blktype)
+{
+	struct kmagazine *m;
+	void *ret;
+	int spl;
+
+	ret = NULL;
+	spl = splhigh();
+	m = kmag_get(blktype);
+	if (m != NULL) {
+		if (m->km_count == 0) {
+			kmag_refill(m, blktype);
+		}
+		if (m->km_count > 0) {
+			ret = m->km_blocks[--m->km_count];
+		}
+	}
+	splx(spl);
+	return ret;
+}
+
+/*
+ * Free PTR into this CPU's magazine. Returns false if PTR isn't a
+ * subpage block or the CPU has no magazines.
+ */
+static
+bool
+kmag_free(void *ptr)
+{
+	struct pageref *pr;
+	struct kmagazine *m;
+	void *drain[KMALLOC_MAGSIZE];
+	unsigned blktype, ndrain;
+	int spl;
+
+	pr = subpage_lookup((vaddr_t)ptr);
+	if (pr == NULL) {
+		return false;
+	}
+	blktype = PR_BLOCKTYPE(pr);
+
+	spl = splhigh();
+	m = kmag_get(blktype);
+	if (m == NULL) {
+		splx(spl);
+		return false;
+	}
+	subpage_checkfree(pr, (vaddr_t)ptr, ptr);
+
+	ndrain = 0;
+	if (m->km_count == kmag_capacity(blktype)) {
+		ndrain = m->km_count / 2;
+		m->km_count -= ndrain;
+		memcpy(drain, &m->km_blocks[m->km_count],
+		       ndrain * sizeof(drain[0]));
+	}
+	m->km_blocks[m->km_count++] = ptr;
+	splx(spl);
+
+	if (ndrain > 0) {
+		kmag_drain(drain, ndrain);
+	}
+	return true;
+}
+
+#else /* not MAGAZINES */
+
+void
+kmalloc_cpu_init(unsigned cpunum)
+{
+	(void)cpunum;
 }
 
+#endif /* MAGAZINES */
+
 //
 ////////////////////////////////////////////////////////////
 
@@ -1194,6 +1551,17 @@ kmalloc(size_t sz)
 		return (void *)address;
 	}
 
+#ifdef MAGAZINES
+	{
+		void *ptr;
+
+		ptr = kmag_alloc(blocktype(sz));
+		if (ptr != NULL) {
+			return ptr;
+		}
+	}
+#endif
+
 #ifdef LABELS
 	return subpage_kmalloc(sz, label);
 #else
@@ -1212,7 +1580,13 @@ kfree(void *ptr)
 	 */
 	if (ptr == NULL) {
 		return;
-	} else if (subpage_kfree(ptr)) {
+	}
+#ifdef MAGAZINES
+	if (kmag_free(ptr)) {
+		return;
+	}
+#endif
+	if (subpage_kfree(ptr)) {
 		KASSERT((vaddr_t)ptr%PAGE_SIZE==0);
 		free_kpages((vaddr_t)ptr);
 	}
@@ -0,0 +1,435 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * Object caches. See slab.h.
+ *
+ * A slab is kc_slabpages contiguous pages from alloc_kpages. Its
+ * struct kmem_slab sits in the last bytes; the objects fill the rest,
+ * starting at the slab's color offset. Each object is followed by
+ * one word: while the object is free, the next free object of the
+ * slab; while it is allocated, the slab it came from, which is how
+ * kmem_cache_free finds its way back without any lookup. (It can't
+ * go in the object itself, as with kmalloc's freelists, because a
+ * free object keeps its constructed contents.)
+ *
+ * Slabs are on one of three lists: full, partial, and empty.
+ * Allocation is from a partial slab if there is one, then an empty
+ * one, then a new one; a slab that becomes empty is kept, up to
+ * KMEM_MAXEMPTY per cache, and the rest are destroyed.
+ *
+ * Constructors and destructors are run without the cache's lock
+ * held, so they may allocate memory (including from other caches).
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <vm.h>
+#include <slab.h>
+
+#define KMEM_MINALIGN	8	/* default and minimum alignment */
+#define KMEM_COLORSTEP	32	/* step between colors (a cache line) */
+#define KMEM_MINOBJS	8	/* objects per slab to aim for */
+#define KMEM_MAXPAGES	4	/* ...but no bigger slabs than this */
+#define KMEM_MAXEMPTY	1	/* empty slabs kept per cache */
+
+struct kmem_slab {
+	struct kmem_slab *ks_next;	/* on a cache list */
+	struct kmem_slab *ks_prev;
+	struct kmem_cache *ks_cache;
+	vaddr_t ks_base;		/* first page */
+	size_t ks_color;		/* offset of the first object */
+	void *ks_free;			/* first free object */
+	unsigned ks_inuse;		/* objects allocated */
+};
+
+struct kmem_cache {
+	const char *kc_name;
+	size_t kc_size;			/* object size asked for */
+	size_t kc_linkoff;		/* offset of the link word */
+	size_t kc_bufsize;		/* object + link, aligned */
+	unsigned kc_slabpages;		/* pages per slab */
+	unsigned kc_perslab;		/* objects per slab */
+	size_t kc_colorstep;
+	size_t kc_maxcolor;		/* largest color offset */
+	int (*kc_ctor)(void *obj);
+	void (*kc_dtor)(void *obj);
+
+	struct spinlock kc_lock;	/* protects everything below */
+	size_t kc_color;		/* next slab's color offset */
+	struct kmem_slab *kc_full;
+	struct kmem_slab *kc_partial;
+	struct kmem_slab *kc_empty;
+	unsigned kc_nslabs;
+	unsigned kc_nempty;
+	unsigned kc_inuse;		/* objects allocated */
+
+	struct kmem_cache *kc_next;	/* on kmem_caches */
+};
+
+/* All caches, for kmem_cache_printstats. */
+static struct spinlock kmem_caches_lock =
+	SPINLOCK_NAMED_INITIALIZER("kmem_caches_lock");
+static struct kmem_cache *kmem_caches;
+
+/* The link word of object OBJ. */
+#define KMEM_LINK(kc, obj) \
+	(*(void **)((char *)(obj) + (kc)->kc_linkoff))
+
+/* Round N up to a multiple of A, a power of 2. */
+#define KMEM_ROUNDUP(n, a) (((n) + (a) - 1) & ~((size_t)(a) - 1))
+
+////////////////////////////////////////////////////////////
+// slab lists
+
+static
+void
+slab_push(struct kmem_slab **list, struct kmem_slab *ks)
+{
+	ks->ks_prev = NULL;
+	ks->ks_next = *list;
+	if (ks->ks_next != NULL) {
+		ks->ks_next->ks_prev = ks;
+	}
+	*list = ks;
+}
+
+static
+void
+slab_unlink(struct kmem_slab **list, struct kmem_slab *ks)
+{
+	if (ks->ks_prev != NULL) {
+		ks->ks_prev->ks_next = ks->ks_next;
+	}
+	else {
+		KASSERT(*list == ks);
+		*list = ks->ks_next;
+	}
+	if (ks->ks_next != NULL) {
+		ks->ks_next->ks_prev = ks->ks_prev;
+	}
+	ks->ks_next = ks->ks_prev = NULL;
+}
+
+////////////////////////////////////////////////////////////
+// slabs
+
+/*
+ * Address of object I of a slab at BASE with color offset COLOR.
+ */
+static
+void *
+slab_object(struct kmem_cache *kc, vaddr_t base, size_t color, unsigned i)
+{
+	return (void *)(base + color + i * kc->kc_bufsize);
+}
+
+/*
+ * Run the destructor on objects FIRST through kc_perslab-1 of a
+ * slab, then give its pages back.
+ */
+static
+void
+slab_release(struct kmem_cache *kc, vaddr_t base, size_t color,
+	     unsigned first)
+{
+	unsigned i;
+
+	if (kc->kc_dtor != NULL) {
+		for (i=first; i<kc->kc_perslab; i++) {
+			kc->kc_dtor(slab_object(kc, base, color, i));
+		}
+	}
+	free_kpages(base);
+}
+
+/*
+ * Make a new slab of constructed objects, all free, at color offset
+ * COLOR. Call without kc_lock.
+ */
+static
+struct kmem_slab *
+slab_create(struct kmem_cache *kc, size_t color)
+{
+	struct kmem_slab *ks;
+	vaddr_t base;
+	void *obj;
+	unsigned i;
+
+	base = alloc_kpages(kc->kc_slabpages);
+	if (base == 0) {
+		return NULL;
+	}
+
+	ks = (struct kmem_slab *)(base + kc->kc_slabpages * PAGE_SIZE
+				  - sizeof(struct kmem_slab));
+	ks->ks_next = ks->ks_prev = NULL;
+	ks->ks_cache = kc;
+	ks->ks_base = base;
+	ks->ks_color = color;
+	ks->ks_free = NULL;
+	ks->ks_inuse = 0;
+
+	/* Construct from the end, so the freelist is in address order. */
+	for (i = kc->kc_perslab; i-- > 0; ) {
+		obj = slab_object(kc, base, color, i);
+		if (kc->kc_ctor != NULL && kc->kc_ctor(obj) != 0) {
+			/* Undo the ones already done. */
+			slab_release(kc, base, color, i + 1);
+			return NULL;
+		}
+		KMEM_LINK(kc, obj) = ks->ks_free;
+		ks->ks_free = obj;
+	}
+	return ks;
+}
+
+/*
+ * Destroy an empty slab that's on no list. Call without kc_lock.
+ */
+static
+void
+slab_destroy(struct kmem_cache *kc, struct kmem_slab *ks)
+{
+	KASSERT(ks->ks_inuse == 0);
+	KASSERT(ks->ks_cache == kc);
+
+	/* KS is in the pages being freed; don't use it afterwards. */
+	slab_release(kc, ks->ks_base, ks->ks_color, 0);
+}
+
+////////////////////////////////////////////////////////////
+// caches
+
+struct kmem_cache *
+kmem_cache_create(const char *name, size_t size, size_t align,
+		  int (*ctor)(void *obj), void (*dtor)(void *obj))
+{
+	struct kmem_cache *kc;
+	size_t avail, slack;
+	unsigned npages;
+
+	KASSERT(size > 0);
+	if (align < KMEM_MINALIGN) {
+		align = KMEM_MINALIGN;
+	}
+	KASSERT((align & (align - 1)) == 0);
+
+	kc = kmalloc(sizeof(*kc));
+	if (kc == NULL) {
+		return NULL;
+	}
+	kc->kc_name = name;
+	kc->kc_size = size;
+	kc->kc_linkoff = KMEM_ROUNDUP(size, sizeof(void *));
+	kc->kc_bufsize = KMEM_ROUNDUP(kc->kc_linkoff + sizeof(void *), align);
+	kc->kc_colorstep = align > KMEM_COLORSTEP ? align : KMEM_COLORSTEP;
+
+	/* Use the smallest slab that holds KMEM_MINOBJS, if we can. */
+	for (npages = 1; npages < KMEM_MAXPAGES; npages++) {
+		avail = npages * PAGE_SIZE - sizeof(struct kmem_slab);
+		if (avail / kc->kc_bufsize >= KMEM_MINOBJS) {
+			break;
+		}
+	}
+	avail = npages * PAGE_SIZE - sizeof(struct kmem_slab);
+	if (avail < kc->kc_bufsize) {
+		panic("kmem_cache_create: %s: objects of %zu bytes are "
+		      "too big\n", name, size);
+	}
+	kc->kc_slabpages = npages;
+	kc->kc_perslab = avail / kc->kc_bufsize;
+
+	/* Colors use up the space left over at the end of each slab. */
+	slack = avail - kc->kc_perslab * kc->kc_bufsize;
+	kc->kc_maxcolor = slack - slack % kc->kc_colorstep;
+
+	kc->kc_ctor = ctor;
+	kc->kc_dtor = dtor;
+
+	spinlock_init(&kc->kc_lock);
+	spinlock_setname(&kc->kc_lock, name);
+	kc->kc_color = 0;
+	kc->kc_full = NULL;
+	kc->kc_partial = NULL;
+	kc->kc_empty = NULL;
+	kc->kc_nslabs = 0;
+	kc->kc_nempty = 0;
+	kc->kc_inuse = 0;
+
+	spinlock_acquire(&kmem_caches_lock);
+	kc->kc_next = kmem_caches;
+	kmem_caches = kc;
+	spinlock_release(&kmem_caches_lock);
+
+	return kc;
+}
+
+void
+kmem_cache_destroy(struct kmem_cache *kc)
+{
+	struct kmem_cache **kcp;
+	struct kmem_slab *ks;
+
+	KASSERT(kc->kc_inuse == 0);
+	KASSERT(kc->kc_full == NULL);
+	KASSERT(kc->kc_partial == NULL);
+
+	spinlock_acquire(&kmem_caches_lock);
+	for (kcp = &kmem_caches; *kcp != kc; kcp = &(*kcp)->kc_next) {
+		KASSERT(*kcp != NULL);
+	}
+	*kcp = kc->kc_next;
+	spinlock_release(&kmem_caches_lock);
+
+	while ((ks = kc->kc_empty) != NULL) {
+		slab_unlink(&kc->kc_empty, ks);
+		slab_destroy(kc, ks);
+	}
+	spinlock_cleanup(&kc->kc_lock);
+	kfree(kc);
+}
+
+void *
+kmem_cache_alloc(struct kmem_cache *kc)
+{
+	struct kmem_slab *ks;
+	size_t color;
+	void *obj;
+
+	spinlock_acquire(&kc->kc_lock);
+	ks = kc->kc_partial;
+	if (ks == NULL && kc->kc_empty != NULL) {
+		ks = kc->kc_empty;
+		slab_unlink(&kc->kc_empty, ks);
+		kc->kc_nempty--;
+		slab_push(&kc->kc_partial, ks);
+	}
+	if (ks == NULL) {
+		color = kc->kc_color;
+		kc->kc_color += kc->kc_colorstep;
+		if (kc->kc_color > kc->kc_maxcolor) {
+			kc->kc_color = 0;
+		}
+		spinlock_release(&kc->kc_lock);
+
+		ks = slab_create(kc, color);
+		if (ks == NULL) {
+			return NULL;
+		}
+
+		/*
+		 * Somebody else may have made one too while we
+		 * weren't looking; never mind, that just means there
+		 * are two partial slabs for a while.
+		 */
+		spinlock_acquire(&kc->kc_lock);
+		kc->kc_nslabs++;
+		slab_push(&kc->kc_partial, ks);
+	}
+
+	obj = ks->ks_free;
+	KASSERT(obj != NULL);
+	ks->ks_free = KMEM_LINK(kc, obj);
+	KMEM_LINK(kc, obj) = ks;
+	ks->ks_inuse++;
+	kc->kc_inuse++;
+	if (ks->ks_inuse == kc->kc_perslab) {
+		slab_unlink(&kc->kc_partial, ks);
+		slab_push(&kc->kc_full, ks);
+	}
+	spinlock_release(&kc->kc_lock);
+
+	return obj;
+}
+
+void
+kmem_cache_free(struct kmem_cache *kc, void *obj)
+{
+	struct kmem_slab *ks;
+
+	if (obj == NULL) {
+		return;
+	}
+
+	ks = KMEM_LINK(kc, obj);
+	if (ks == NULL || ks->ks_cache != kc) {
+		panic("kmem_cache_free: %s: %p is not an allocated object\n",
+		      kc->kc_name, obj);
+	}
+
+	spinlock_acquire(&kc->kc_lock);
+	KASSERT(ks->ks_inuse > 0);
+	KMEM_LINK(kc, obj) = ks->ks_free;
+	ks->ks_free = obj;
+	if (ks->ks_inuse == kc->kc_perslab) {
+		slab_unlink(&kc->kc_full, ks);
+		slab_push(&kc->kc_partial, ks);
+	}
+	ks->ks_inuse--;
+	kc->kc_inuse--;
+	if (ks->ks_inuse > 0) {
+		spinlock_release(&kc->kc_lock);
+		return;
+	}
+
+	/* Slab is now empty: keep it, or give it back. */
+	slab_unlink(&kc->kc_partial, ks);
+	if (kc->kc_nempty < KMEM_MAXEMPTY) {
+		slab_push(&kc->kc_empty, ks);
+		kc->kc_nempty++;
+		ks = NULL;
+	}
+	else {
+		kc->kc_nslabs--;
+	}
+	spinlock_release(&kc->kc_lock);
+
+	if (ks != NULL) {
+		slab_destroy(kc, ks);
+	}
+}
+
+void
+kmem_cache_printstats(void)
+{
+	struct kmem_cache *kc;
+
+	kprintf("%-16s %6s %5s %6s %6s %6s\n", "cache", "size", "pages",
+		"perslb", "slabs", "inuse");
+	spinlock_acquire(&kmem_caches_lock);
+	for (kc = kmem_caches; kc != NULL; kc = kc->kc_next) {
+		kprintf("%-16s %6zu %5u %6u %6u %6u\n", kc->kc_name,
+			kc->kc_size, kc->kc_slabpages, kc->kc_perslab,
+			kc->kc_nslabs, kc->kc_inuse);
+	}
+	spinlock_release(&kmem_caches_lock);
+}
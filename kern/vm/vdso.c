@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * Time and process pages mapped read-only into user address spaces.
+ * The mapping itself is done in vm_fault.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <clock.h>
+#include <membar.h>
+#include <spinlock.h>
+#include <mainbus.h>
+#include <vm.h>
+#include <vdso.h>
+
+static struct vdso_time *vdso_time;
+static struct spinlock vdso_lock = SPINLOCK_INITIALIZER;
+static uint64_t vdso_lasttick;		/* mainbus_ticks() at last update */
+
+void
+vdso_bootstrap(void)
+{
+	struct vdso_time *vt;
+	struct timespec ts;
+	vaddr_t page;
+
+	page = alloc_kpages(1);
+	if (page == 0) {
+		panic("vdso: Could not allocate time page\n");
+	}
+	bzero((void *)page, PAGE_SIZE);
+
+	/* Fill in the first snapshot before hardclock can see the page. */
+	vt = (struct vdso_time *)page;
+	gettime(&ts);
+	vt->vt_sec = ts.tv_sec;
+	vt->vt_nsec = ts.tv_nsec;
+	vt->vt_seq = 2;
+	membar_store_store();
+	vdso_time = vt;
+}
+
+/*
+ * Every CPU's hardclock calls this, since any of them (CPU 0
+ * included) may have stopped ticking while idle; the first call in
+ * each tick does the work. vdso_lock keeps the writers of the
+ * sequence count from overlapping.
+ */
+void
+vdso_update(void)
+{
+	struct timespec ts;
+	uint64_t tick;
+
+	if (vdso_time == NULL) {
+		return;
+	}
+
+	tick = mainbus_ticks();
+	spinlock_acquire(&vdso_lock);
+	if (tick == vdso_lasttick) {
+		spinlock_release(&vdso_lock);
+		return;
+	}
+	vdso_lasttick = tick;
+
+	gettime(&ts);
+
+	vdso_time->vt_seq++;
+	membar_store_store();
+	vdso_time->vt_sec = ts.tv_sec;
+	vdso_time->vt_nsec = ts.tv_nsec;
+	membar_store_store();
+	vdso_time->vt_seq++;
+	spinlock_release(&vdso_lock);
+}
+
+paddr_t
+vdso_timepage(void)
+{
+	if (vdso_time == NULL) {
+		return 0;
+	}
+	return (vaddr_t)vdso_time - MIPS_KSEG0;
+}
+
+void
+vdso_fillproc(paddr_t paddr, pid_t pid)
+{
+	struct vdso_proc *vp;
+
+	vp = (struct vdso_proc *)PADDR_TO_KVADDR(paddr);
+	vp->vp_pid = pid;
+}
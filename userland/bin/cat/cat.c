@@ -29,6 +29,7 @@
 
 #include <unistd.h>
 #include <string.h>
+#include <errno.h>
 #include <err.h>
 
 /*
@@ -36,6 +37,9 @@
  * Usage: cat [files]
  */
 
+/* Bytes asked of each sendfile call. */
+#define COPYCHUNK (1024*1024)
+
 
 
 /* Print a file that's already been opened. */
@@ -47,6 +51,21 @@ docat(const char *name, int fd)
 	int len, wr, wrtot;
 
 	/*
+	 * Let the kernel move the data if it can; it doesn't have to
+	 * pass through our buffer at all then.
+	 */
+	while ((len = sendfile(STDOUT_FILENO, fd, NULL, COPYCHUNK))>0) {
+		/* nothing */
+	}
+	if (len==0) {
+		return;
+	}
+	if (errno!=ENOSYS) {
+		err(1, "%s", name);
+	}
+
+	/*
+	 * Otherwise copy it by hand.
 	 * As long as we get more than zero bytes, we haven't hit EOF.
 	 * Zero means EOF. Less than zero means an error occurred.
 	 * We may read less than we asked for, though, in various cases
@@ -28,6 +28,7 @@
  */
 
 #include <unistd.h>
+#include <errno.h>
 #include <err.h>
 
 /*
@@ -35,6 +36,9 @@
  * Usage: cp oldfile newfile
  */
 
+/* Bytes asked of each sendfile call. */
+#define COPYCHUNK (1024*1024)
+
 
 /* Copy one file to another. */
 static
@@ -59,6 +63,18 @@ copy(const char *from, const char *to)
 	}
 
 	/*
+	 * Let the kernel move the data if it can; it doesn't have to
+	 * pass through our buffer at all then.
+	 */
+	while ((len = sendfile(tofd, fromfd, NULL, COPYCHUNK))>0) {
+		/* nothing */
+	}
+	if (len<0 && errno!=ENOSYS) {
+		err(1, "%s to %s", from, to);
+	}
+
+	/*
+	 * Otherwise copy it by hand.
 	 * As long as we get more than zero bytes, we haven't hit EOF.
 	 * Zero means EOF. Less than zero means an error occurred.
 	 * We may read less than we asked for, though, in various cases
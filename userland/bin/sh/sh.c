@@ -33,6 +33,8 @@
  * Usage:
  *     sh
  *     sh -c command
+ *
+ * Commands can be joined into a pipeline with |.
  */
 
 #include <sys/types.h>
@@ -58,6 +60,9 @@
 /* avoid making this unreasonably large; causes problems under dumbvm */
 #define CMDLINE_MAX 4096
 
+/* most commands in one pipeline */
+#define MAXPIPE 16
+
 /* struct to (portably) hold exit info */
 struct exitinfo {
 	unsigned val:8,
@@ -75,21 +80,21 @@ static pid_t bgpids[MAXBG];
 
 /*
  * can_bg
- * just checks for an open slot.
+ * just checks for N open slots.
  */
 static
 int
-can_bg(void)
+can_bg(int n)
 {
 	int i;
 
-	for (i = 0; i < MAXBG; i++) {
+	for (i = 0; i < MAXBG && n > 0; i++) {
 		if (bgpids[i] == 0) {
-			return 1;
+			n--;
 		}
 	}
 
-	return 0;
+	return n == 0;
 }
 
 /*
@@ -355,23 +360,100 @@ static struct {
 	{ NULL, NULL }
 };
 
+/*
+ * startcmd
+ * starts ARGS with INFD as its stdin and OUTFD as its stdout. CLOSEFD,
+ * if not -1, is a descriptor of ours the command mustn't keep (the
+ * read end of the pipe it writes to). returns the pid, or -1 after
+ * complaining.
+ */
+static
+pid_t
+startcmd(char **args, int infd, int outfd, int closefd)
+{
+	pid_t pid;
+#ifndef HOST
+	int fdmap[3];
+
+	/*
+	 * Start the command in one step if the kernel can. A plain
+	 * command shares all our descriptors; a pipeline stage gets
+	 * just its ends of the pipes and stderr. Fall back to
+	 * fork/execvp only if spawn isn't there.
+	 */
+	if (infd == STDIN_FILENO && outfd == STDOUT_FILENO) {
+		pid = spawnvp(args[0], args, NULL, 0);
+	}
+	else {
+		fdmap[0] = infd;
+		fdmap[1] = outfd;
+		fdmap[2] = STDERR_FILENO;
+		pid = spawnvp(args[0], args, fdmap, 3);
+	}
+	if (pid >= 0) {
+		return pid;
+	}
+	if (errno != ENOSYS) {
+		warn("%s", args[0]);
+		return -1;
+	}
+#endif
+
+	pid = fork();
+	switch (pid) {
+		case -1:
+			/* error */
+			warn("fork");
+			return -1;
+		case 0:
+			/* child */
+			if (infd != STDIN_FILENO) {
+				dup2(infd, STDIN_FILENO);
+				close(infd);
+			}
+			if (outfd != STDOUT_FILENO) {
+				dup2(outfd, STDOUT_FILENO);
+				close(outfd);
+			}
+			if (closefd >= 0) {
+				close(closefd);
+			}
+			execvp(args[0], args);
+			warn("%s", args[0]);
+			/*
+			 * Use _exit() instead of exit() in the child
+			 * process to avoid calling atexit() functions,
+			 * which would cause hostcompat (if present) to
+			 * reset the tty state and mess up our input
+			 * handling.
+			 */
+			_exit(1);
+		default:
+			break;
+	}
+	return pid;
+}
+
 /*
  * docommand
  * tokenizes the command line using strtok.  if there aren't any commands,
  * simply returns.  checks to see if it's a builtin, running it if it is.
- * otherwise, it's a standard command.  check for the '&', try to background
- * the job if possible, otherwise just run it and wait on it.
+ * otherwise, it's a standard command, or a pipeline of them joined
+ * with '|'.  check for the '&', try to background the job if possible,
+ * otherwise just run it and wait on it.
  */
 static
 void
 docommand(char *buf, struct exitinfo *ei)
 {
 	char *args[NARG_MAX + 1];
-	int nargs, i;
+	char **cmds[MAXPIPE];
+	pid_t pids[MAXPIPE];
+	int nargs, ncmds, nstarted, i;
+	int infd, outfd, pfds[2];
 	char *s;
-	pid_t pid;
 	int status;
-	int bg=0;
+	int bg=0, failed=0;
 	time_t startsecs, endsecs;
 	unsigned long startnsecs, endnsecs;
 
@@ -405,60 +487,110 @@ docommand(char *buf, struct exitinfo *ei)
 
 	if (nargs > 0 && !strcmp(args[nargs-1], "&")) {
 		/* background */
-		if (!can_bg()) {
-			printf("%s: Too many background jobs; wait for "
-			       "some to finish before starting more\n",
-			       args[0]);
-			exitinfo_exit(ei, 1);
-			return;
-		}
 		nargs--;
 		args[nargs] = NULL;
 		bg = 1;
 	}
 
+	/* split into pipeline stages at each | */
+	ncmds = 0;
+	cmds[ncmds++] = args;
+	for (i=0; i<nargs; i++) {
+		if (strcmp(args[i], "|")) {
+			continue;
+		}
+		if (ncmds >= MAXPIPE) {
+			printf("%s: Too many commands in pipeline\n", args[0]);
+			exitinfo_exit(ei, 1);
+			return;
+		}
+		args[i] = NULL;
+		cmds[ncmds++] = &args[i+1];
+	}
+	for (i=0; i<ncmds; i++) {
+		if (cmds[i][0] == NULL) {
+			printf("sh: Empty command in pipeline\n");
+			exitinfo_exit(ei, 1);
+			return;
+		}
+	}
+
+	if (bg && !can_bg(ncmds)) {
+		printf("%s: Too many background jobs; wait for "
+		       "some to finish before starting more\n",
+		       args[0]);
+		exitinfo_exit(ei, 1);
+		return;
+	}
+
 	if (timing) {
 		__time(&startsecs, &startnsecs);
 	}
 
-	pid = fork();
-	switch (pid) {
-		case -1:
-			/* error */
-			warn("fork");
-			exitinfo_exit(ei, 255);
-			return;
-		case 0:
-			/* child */
-			execvp(args[0], args);
-			warn("%s", args[0]);
-			/*
-			 * Use _exit() instead of exit() in the child
-			 * process to avoid calling atexit() functions,
-			 * which would cause hostcompat (if present) to
-			 * reset the tty state and mess up our input
-			 * handling.
-			 */
-			_exit(1);
-		default:
+	/*
+	 * Start each stage reading from the previous one's pipe. Our
+	 * copies of the pipe ends are closed as soon as the stages that
+	 * use them are started, so that each reader sees EOF once its
+	 * writer exits.
+	 */
+	nstarted = 0;
+	infd = STDIN_FILENO;
+	for (i=0; i<ncmds; i++) {
+		if (i < ncmds - 1) {
+			if (pipe(pfds) < 0) {
+				warn("pipe");
+				failed = 1;
+				break;
+			}
+			outfd = pfds[1];
+		}
+		else {
+			pfds[0] = -1;
+			outfd = STDOUT_FILENO;
+		}
+
+		pids[nstarted] = startcmd(cmds[i], infd, outfd, pfds[0]);
+		if (infd != STDIN_FILENO) {
+			close(infd);
+		}
+		if (outfd != STDOUT_FILENO) {
+			close(outfd);
+		}
+		infd = pfds[0];
+		if (pids[nstarted] < 0) {
+			failed = 1;
 			break;
+		}
+		nstarted++;
+	}
+	if (failed && infd >= 0 && infd != STDIN_FILENO) {
+		close(infd);
 	}
 
 	/* parent */
 	if (bg) {
 		/* background this command */
-		remember_bg(pid);
-		printf("[%d] %s ... &\n", pid, args[0]);
-		exitinfo_exit(ei, 0);
+		for (i=0; i<nstarted; i++) {
+			remember_bg(pids[i]);
+			printf("[%d] %s ... &\n", pids[i], cmds[i][0]);
+		}
+		exitinfo_exit(ei, failed);
 		return;
 	}
 
-	if (waitpid(pid, &status, 0) < 0) {
-		warn("waitpid");
-		exitinfo_exit(ei, 255);
+	/* the pipeline's status is the last command's */
+	for (i=0; i<nstarted; i++) {
+		if (waitpid(pids[i], &status, 0) < 0) {
+			warn("waitpid");
+			exitinfo_exit(ei, 255);
+		}
+		else if (i == ncmds - 1) {
+			readstatus(status, ei);
+		}
 	}
-	else {
-		readstatus(status, ei);
+	if (failed) {
+		exitinfo_exit(ei, 1);
+		return;
 	}
 
 	if (timing) {
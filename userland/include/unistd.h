@@ -57,6 +57,9 @@
  *     fstat:    sys/stat.h
  *     lstat:    sys/stat.h
  *     mkdir:    sys/stat.h
+ *     poll:     poll.h
+ *     readv:    sys/uio.h
+ *     writev:   sys/uio.h
  *
  * If this were standard Unix, more prototypes would go in other
  * header files as well, as follows:
@@ -146,16 +149,58 @@ int symlink(const char *target, const char *linkname);
 ssize_t readlink(const char *path, char *buf, size_t buflen);
 int dup2(int filehandle, int newhandle);
 int pipe(int filehandles[2]);
+int fcntl(int filehandle, int cmd, ...);
+ssize_t pread(int filehandle, void *buf, size_t size, off_t pos);
+ssize_t pwrite(int filehandle, const void *buf, size_t size, off_t pos);
+/* readv - see sys/uio.h */
+/* writev - see sys/uio.h */
 int __time(time_t *seconds, unsigned long *nanoseconds);
+int nanosleep(const struct timespec *req, struct timespec *rem);
 ssize_t __getcwd(char *buf, size_t buflen);
 /* stat - see sys/stat.h */
 /* lstat - see sys/stat.h */
 
+/*
+ * OS/161 extensions.
+ *
+ * spawn starts PROG with ARGS in a new child process, like fork and
+ * execv in one step. Descriptor i of the child is the caller's
+ * descriptor FDMAP[i] for i < NFDS (closed if FDMAP[i] is negative);
+ * with a NULL FDMAP the child gets all of the caller's descriptors.
+ * Returns the child's pid.
+ */
+pid_t spawn(const char *prog, char *const *args,
+	    const int *fdmap, int nfds);
+
+/*
+ * User threads. thread_create runs FUNC(ARG) in a new thread of the
+ * calling process, on the STACKSIZE bytes at STACK, which stay the
+ * caller's to manage; returning from FUNC is thread_exit with the
+ * return value. thread_join waits for thread TID and collects that
+ * status. _exit ends every thread of the process.
+ */
+int __thread_create(void (*entry)(void), void *arg1, void *arg2,
+		    void *stacktop);
+__DEAD void thread_exit(int status);
+int thread_join(int tid, int *status);
+
+/*
+ * sendfile copies up to COUNT bytes from INFD to OUTFD inside the
+ * kernel. Reading starts at *OFFSET (which is updated) if OFFSET is
+ * not NULL, else at INFD's seek position; writing is at OUTFD's.
+ * Returns the number of bytes copied, 0 at end of file.
+ */
+ssize_t sendfile(int outfd, int infd, off_t *offset, size_t count);
+
 /*
  * These are not themselves system calls, but wrapper routines in libc.
  */
 
 int execvp(const char *prog, char *const *args); /* calls execv */
+pid_t spawnvp(const char *prog, char *const *args,
+	      const int *fdmap, int nfds);		/* calls spawn */
+int thread_create(int (*func)(void *), void *arg,
+		  void *stack, size_t stacksize);	/* calls __thread_create */
 char *getcwd(char *buf, size_t buflen);		/* calls __getcwd */
 time_t time(time_t *seconds);			/* calls __time */
 
@@ -74,6 +74,16 @@ system(const char *cmd)
 
 	argv[nargs] = NULL;
 
+	/* Start it in one step if the kernel supports spawn. */
+	pid = spawn(argv[0], argv, NULL, 0);
+	if (pid >= 0) {
+		waitpid(pid, &status, 0);
+		return status;
+	}
+	if (errno != ENOSYS) {
+		return -1;
+	}
+
 	pid = fork();
 	switch (pid) {
 	    case -1:
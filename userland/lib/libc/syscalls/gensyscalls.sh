@@ -5,6 +5,9 @@
 #
 # Parses the kernel's syscalls.h into the body of syscalls.S
 #
+# Calls that libc implements itself without a trap (by reading the
+# kernel's vdso pages; see <kern/vdso.h>) are left out.
+#
 
 # tabs to spaces, just in case
 tr '\t' ' ' |\
@@ -16,6 +19,9 @@ awk '
     # And, do not read lines that do not match the approximate right pattern.
     look && /^#define SYS_/ && NF==3 {
 	sub("^SYS_", "", $2);
+	if ($2 == "__time" || $2 == "getpid") {
+	    next;
+	}
 	# print the name of the call and the number.
 	print $2, $3;
     }
@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#include <sys/types.h>
+#include <unistd.h>
+#include <kern/vdso.h>
+
+/*
+ * OS/161 call __time, done without a trap: the kernel keeps a
+ * snapshot of the clock in the shared time page and refreshes it
+ * on every clock tick. See <kern/vdso.h> for the protocol.
+ */
+
+static
+inline
+void
+vdso_barrier(void)
+{
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 instructions */
+		"sync;"
+		".set pop"		/* restore assembler mode */
+		: : : "memory");
+}
+
+int
+__time(time_t *seconds, unsigned long *nanoseconds)
+{
+	const struct vdso_time *vt = (const struct vdso_time *)VDSO_TIMEPAGE;
+	unsigned seq;
+	time_t sec;
+	unsigned long nsec;
+
+	do {
+		seq = vt->vt_seq;
+		vdso_barrier();
+		sec = vt->vt_sec;
+		nsec = vt->vt_nsec;
+		vdso_barrier();
+	} while ((seq & 1) != 0 || seq != vt->vt_seq);
+
+	if (seconds != NULL) {
+		*seconds = sec;
+	}
+	if (nanoseconds != NULL) {
+		*nanoseconds = nsec;
+	}
+	return 0;
+}
@@ -31,8 +31,9 @@
 
 /*
  * POSIX C function: retrieve time in seconds since the epoch.
- * Uses the OS/161 system call __time, which does the same thing
- * but also returns nanoseconds.
+ * Uses the OS/161 call __time, which does the same thing but also
+ * returns nanoseconds; it reads the kernel's time page, so this
+ * doesn't trap.
  */
 
 time_t
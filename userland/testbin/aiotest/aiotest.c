@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * aiotest - exercise asynchronous file I/O.
+ *
+ * Writes a file as NBLOCKS blocks with every write in flight at once,
+ * collects the completions, then reads the blocks back the same way
+ * (in reverse order, to mix up the offsets) and checks the contents.
+ */
+
+#include <aio.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <err.h>
+
+#define FILENAME  "aiotest.dat"
+#define NBLOCKS   16
+#define BLOCKSIZE 512
+
+static char wbuf[NBLOCKS][BLOCKSIZE];
+static char rbuf[NBLOCKS][BLOCKSIZE];
+
+/*
+ * Collect NBLOCKS completions and check each one moved a whole block.
+ */
+static
+void
+collect(const char *what)
+{
+	struct aio_event ev[NBLOCKS];
+	unsigned seen[NBLOCKS];
+	int n, i, total;
+
+	memset(seen, 0, sizeof(seen));
+	total = 0;
+	while (total < NBLOCKS) {
+		n = aio_wait(ev, NBLOCKS, 0);
+		if (n < 0) {
+			err(1, "aio_wait");
+		}
+		if (n == 0) {
+			errx(1, "%s: aio_wait: nothing outstanding after %d",
+			     what, total);
+		}
+		for (i=0; i<n; i++) {
+			if (ev[i].ae_data >= NBLOCKS || seen[ev[i].ae_data]) {
+				errx(1, "%s: bogus event data %u", what,
+				     ev[i].ae_data);
+			}
+			seen[ev[i].ae_data] = 1;
+			if (ev[i].ae_error != 0) {
+				errno = ev[i].ae_error;
+				err(1, "%s: block %u", what, ev[i].ae_data);
+			}
+			if (ev[i].ae_result != BLOCKSIZE) {
+				errx(1, "%s: block %u: %d bytes", what,
+				     ev[i].ae_data, (int)ev[i].ae_result);
+			}
+		}
+		total += n;
+	}
+	if (aio_wait(ev, NBLOCKS, AIO_NOWAIT) != 0) {
+		errx(1, "%s: extra events", what);
+	}
+}
+
+int
+main(void)
+{
+	struct aiocb cb;
+	int fd, i, j;
+
+	for (i=0; i<NBLOCKS; i++) {
+		for (j=0; j<BLOCKSIZE; j++) {
+			wbuf[i][j] = (char)(i * 31 + j);
+		}
+	}
+
+	fd = open(FILENAME, O_RDWR|O_CREAT|O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s", FILENAME);
+	}
+
+	for (i=0; i<NBLOCKS; i++) {
+		cb.aio_fildes = fd;
+		cb.aio_buf = wbuf[i];
+		cb.aio_nbytes = BLOCKSIZE;
+		cb.aio_data = i;
+		cb.aio_offset = (off_t)i * BLOCKSIZE;
+		if (aio_write(&cb) < 0) {
+			err(1, "aio_write %d", i);
+		}
+	}
+	collect("write");
+
+	for (i=NBLOCKS-1; i>=0; i--) {
+		cb.aio_fildes = fd;
+		cb.aio_buf = rbuf[i];
+		cb.aio_nbytes = BLOCKSIZE;
+		cb.aio_data = i;
+		cb.aio_offset = (off_t)i * BLOCKSIZE;
+		if (aio_read(&cb) < 0) {
+			err(1, "aio_read %d", i);
+		}
+	}
+	collect("read");
+
+	if (memcmp(wbuf, rbuf, sizeof(wbuf)) != 0) {
+		errx(1, "data read back does not match");
+	}
+
+	close(fd);
+	remove(FILENAME);
+	printf("aiotest: passed\n");
+	return 0;
+}
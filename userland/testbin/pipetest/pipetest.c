@@ -0,0 +1,238 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * pipetest - exercise pipes.
+ *
+ * A writer thread sends a numbered byte pattern down a pipe, first in
+ * small writes that go through the ring, then in one large write from
+ * a page-aligned buffer that is handed off a page at a time; the main
+ * thread reads it back in odd-sized pieces and checks it. Then two
+ * writers each send more than a ring's worth of page-aligned data at
+ * once, and the reader checks the two writes came out whole, one
+ * after the other. Last, checks that closing the write end gives
+ * EOF, and that writing with the read end closed fails with EPIPE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <err.h>
+
+#define PAGESIZE  4096
+#define SMALLSIZE 100
+#define NSMALL    200
+#define BIGPAGES  24
+#define TWOPAGES  8
+#define STACKSIZE 8192
+
+static char bigbuf[BIGPAGES * PAGESIZE] __attribute__((__aligned__(PAGESIZE)));
+static char twobuf[2][TWOPAGES * PAGESIZE]
+	__attribute__((__aligned__(PAGESIZE)));
+static char stack[STACKSIZE];
+static char stack2[2][STACKSIZE];
+static int fds[2];
+
+static
+char
+pattern(unsigned pos)
+{
+	return (char)(pos * 7 + pos / 251);
+}
+
+static
+int
+writer(void *unused)
+{
+	char buf[SMALLSIZE];
+	unsigned pos, i, j;
+	ssize_t r;
+
+	(void)unused;
+
+	pos = 0;
+	for (i=0; i<NSMALL; i++) {
+		for (j=0; j<SMALLSIZE; j++) {
+			buf[j] = pattern(pos + j);
+		}
+		r = write(fds[1], buf, SMALLSIZE);
+		if (r != SMALLSIZE) {
+			err(1, "small write");
+		}
+		pos += SMALLSIZE;
+	}
+
+	for (j=0; j<sizeof(bigbuf); j++) {
+		bigbuf[j] = pattern(pos + j);
+	}
+	r = write(fds[1], bigbuf, sizeof(bigbuf));
+	if (r != (ssize_t)sizeof(bigbuf)) {
+		err(1, "big write");
+	}
+
+	close(fds[1]);
+	return 0;
+}
+
+/*
+ * One of the two competing writers: NUM fills its buffer with 'A'
+ * or 'B' and writes it all at once.
+ */
+static
+int
+twowriter(void *num)
+{
+	unsigned n = (unsigned)num;
+	ssize_t r;
+
+	memset(twobuf[n], 'A' + n, sizeof(twobuf[n]));
+	r = write(fds[1], twobuf[n], sizeof(twobuf[n]));
+	if (r != (ssize_t)sizeof(twobuf[n])) {
+		err(1, "writer %u: write", n);
+	}
+	return 0;
+}
+
+static
+void
+twowriters(void)
+{
+	char buf[777];
+	char first;
+	unsigned pos, total, j;
+	int tid[2], status, i;
+	ssize_t r;
+
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+	for (i=0; i<2; i++) {
+		tid[i] = thread_create(twowriter, (void *)i, stack2[i],
+				       STACKSIZE);
+		if (tid[i] < 0) {
+			err(1, "thread_create");
+		}
+	}
+
+	/* each write must come out whole: all of one, then all of the other */
+	total = 2 * sizeof(twobuf[0]);
+	first = 0;
+	pos = 0;
+	while (pos < total) {
+		r = read(fds[0], buf, sizeof(buf));
+		if (r < 0) {
+			err(1, "read");
+		}
+		if (r == 0) {
+			errx(1, "EOF after %u bytes, expected %u", pos, total);
+		}
+		if (first == 0) {
+			first = buf[0];
+		}
+		for (j=0; j<(unsigned)r; j++) {
+			if (pos + j < sizeof(twobuf[0]) ?
+			    buf[j] != first : buf[j] != ('A' + 'B' - first)) {
+				errx(1, "byte %u: got %c; writes interleaved",
+				     pos + j, buf[j]);
+			}
+		}
+		pos += r;
+	}
+	for (i=0; i<2; i++) {
+		if (thread_join(tid[i], &status) < 0) {
+			err(1, "thread_join");
+		}
+	}
+	close(fds[0]);
+	close(fds[1]);
+	printf("pipetest: two writers ok\n");
+}
+
+int
+main(void)
+{
+	char buf[777];
+	unsigned pos, total, j;
+	int tid, status;
+	ssize_t r;
+
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+
+	tid = thread_create(writer, NULL, stack, STACKSIZE);
+	if (tid < 0) {
+		err(1, "thread_create");
+	}
+
+	total = NSMALL * SMALLSIZE + sizeof(bigbuf);
+	pos = 0;
+	while (1) {
+		r = read(fds[0], buf, sizeof(buf));
+		if (r < 0) {
+			err(1, "read");
+		}
+		if (r == 0) {
+			break;
+		}
+		for (j=0; j<(unsigned)r; j++) {
+			if (buf[j] != pattern(pos + j)) {
+				errx(1, "byte %u: got %d, expected %d",
+				     pos + j, buf[j], pattern(pos + j));
+			}
+		}
+		pos += r;
+	}
+	if (pos != total) {
+		errx(1, "EOF after %u bytes, expected %u", pos, total);
+	}
+	if (thread_join(tid, &status) < 0) {
+		err(1, "thread_join");
+	}
+	printf("pipetest: %u bytes ok\n", pos);
+
+	close(fds[0]);
+
+	twowriters();
+
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+	close(fds[0]);
+	r = write(fds[1], buf, 1);
+	if (r >= 0 || errno != EPIPE) {
+		errx(1, "write with no reader: expected EPIPE");
+	}
+	close(fds[1]);
+
+	printf("pipetest: passed\n");
+	return 0;
+}
@@ -0,0 +1,171 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * polltest - exercise O_NONBLOCK and poll.
+ *
+ * Reads an empty nonblocking pipe and checks for EAGAIN; fills it
+ * until a write comes up short or fails with EAGAIN; checks that poll
+ * with a timeout on an empty pipe times out, and that a writer thread
+ * wakes a poll that waits forever. Finally checks POLLHUP and
+ * POLLNVAL.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <errno.h>
+#include <err.h>
+
+#define STACKSIZE 8192
+
+static char stack[STACKSIZE];
+static char buf[1024];
+static int fds[2];
+
+static
+int
+writer(void *unused)
+{
+	(void)unused;
+
+	if (write(fds[1], "x", 1) != 1) {
+		err(1, "writer: write");
+	}
+	return 0;
+}
+
+static
+void
+setnonblock(int fd)
+{
+	int flags;
+
+	flags = fcntl(fd, F_GETFL);
+	if (flags < 0) {
+		err(1, "fcntl F_GETFL");
+	}
+	if (fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+		err(1, "fcntl F_SETFL");
+	}
+	if ((fcntl(fd, F_GETFL) & O_NONBLOCK) == 0) {
+		errx(1, "fcntl: O_NONBLOCK did not stick");
+	}
+}
+
+int
+main(void)
+{
+	struct pollfd pfd[2];
+	unsigned total;
+	int tid, status, r;
+	ssize_t len;
+
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+	setnonblock(fds[0]);
+	setnonblock(fds[1]);
+
+	len = read(fds[0], buf, sizeof(buf));
+	if (len >= 0 || errno != EAGAIN) {
+		errx(1, "read of empty pipe: expected EAGAIN");
+	}
+
+	memset(buf, 'a', sizeof(buf));
+	total = 0;
+	while (1) {
+		len = write(fds[1], buf, sizeof(buf));
+		if (len < 0) {
+			if (errno != EAGAIN) {
+				err(1, "write");
+			}
+			break;
+		}
+		total += len;
+		if (len < (ssize_t)sizeof(buf)) {
+			break;
+		}
+	}
+	printf("polltest: pipe filled after %u bytes\n", total);
+
+	pfd[0].fd = fds[1];
+	pfd[0].events = POLLOUT;
+	r = poll(pfd, 1, 0);
+	if (r != 0) {
+		errx(1, "poll on full pipe: expected 0, got %d", r);
+	}
+
+	/* drain it */
+	while (total > 0) {
+		len = read(fds[0], buf, sizeof(buf));
+		if (len <= 0) {
+			err(1, "read while draining");
+		}
+		total -= len;
+	}
+
+	pfd[0].fd = fds[0];
+	pfd[0].events = POLLIN;
+	r = poll(pfd, 1, 50);
+	if (r != 0) {
+		errx(1, "poll with timeout: expected 0, got %d", r);
+	}
+
+	tid = thread_create(writer, NULL, stack, STACKSIZE);
+	if (tid < 0) {
+		err(1, "thread_create");
+	}
+	r = poll(pfd, 1, -1);
+	if (r != 1 || (pfd[0].revents & POLLIN) == 0) {
+		errx(1, "poll: expected POLLIN, got %d/%d", r, pfd[0].revents);
+	}
+	if (thread_join(tid, &status) < 0) {
+		err(1, "thread_join");
+	}
+	if (read(fds[0], buf, sizeof(buf)) != 1) {
+		err(1, "read after poll");
+	}
+
+	close(fds[1]);
+	pfd[0].events = POLLIN;
+	pfd[1].fd = fds[1];
+	pfd[1].events = POLLIN;
+	r = poll(pfd, 2, 0);
+	if (r != 2 || (pfd[0].revents & POLLHUP) == 0 ||
+	    pfd[1].revents != POLLNVAL) {
+		errx(1, "poll after close: got %d/%d/%d",
+		     r, pfd[0].revents, pfd[1].revents);
+	}
+	close(fds[0]);
+
+	printf("polltest: passed\n");
+	return 0;
+}
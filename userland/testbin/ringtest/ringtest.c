@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 2013
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * ringtest - exercise the batched system call ring.
+ *
+ * Opens a file, writes it, seeks back, reads it, and closes it, all
+ * through sysring_enter, and checks every completion. Only the open
+ * goes in a batch of its own, since the rest needs its fd.
+ */
+
+#include <sys/sysring.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <err.h>
+
+#define FILENAME  "ringtest.dat"
+#define ENTRIES   64
+#define NBLOCKS   16
+#define BLOCKSIZE 128
+
+static struct sysring_sqe sqes[ENTRIES];
+static struct sysring_cqe cqes[ENTRIES];
+static struct sysring ring;
+
+static char wbuf[NBLOCKS][BLOCKSIZE];
+static char rbuf[NBLOCKS][BLOCKSIZE];
+
+static
+struct sysring_sqe *
+getsqe(int op, int fd, void *buf, unsigned len)
+{
+	struct sysring_sqe *sqe;
+
+	if (ring.sr_sqtail - ring.sr_sqhead == ENTRIES) {
+		errx(1, "submission ring full");
+	}
+	sqe = &sqes[ring.sr_sqtail % ENTRIES];
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->sqe_op = op;
+	sqe->sqe_fd = fd;
+	sqe->sqe_buf = buf;
+	sqe->sqe_len = len;
+	sqe->sqe_data = ring.sr_sqtail;
+	ring.sr_sqtail++;
+	return sqe;
+}
+
+/*
+ * Submit everything pending and check the completions; hands back
+ * the result of the first one.
+ */
+static
+long long
+submit(const char *what, long long expect)
+{
+	struct sysring_cqe *cqe;
+	unsigned pending;
+	long long first = 0;
+	int n, i;
+
+	pending = ring.sr_sqtail - ring.sr_sqhead;
+	n = sysring_enter(&ring, pending);
+	if (n < 0) {
+		err(1, "%s: sysring_enter", what);
+	}
+	if ((unsigned)n != pending) {
+		errx(1, "%s: ran %d of %u requests", what, n, pending);
+	}
+	for (i=0; i<n; i++) {
+		cqe = &cqes[ring.sr_cqhead % ENTRIES];
+		if (cqe->cqe_error) {
+			errno = cqe->cqe_error;
+			err(1, "%s: request %u", what, cqe->cqe_data);
+		}
+		if (i == 0) {
+			first = cqe->cqe_result;
+		}
+		else if (expect >= 0 && cqe->cqe_result != expect &&
+			 cqe->cqe_result != 0) {
+			errx(1, "%s: request %u: result %lld, expected %lld",
+			     what, cqe->cqe_data, cqe->cqe_result, expect);
+		}
+		ring.sr_cqhead++;
+	}
+	return first;
+}
+
+int
+main(void)
+{
+	struct sysring_sqe *sqe;
+	int fd, i, j;
+
+	ring.sr_entries = ENTRIES;
+	ring.sr_sqes = sqes;
+	ring.sr_cqes = cqes;
+
+	for (i=0; i<NBLOCKS; i++) {
+		for (j=0; j<BLOCKSIZE; j++) {
+			wbuf[i][j] = 'a' + (i + j) % 26;
+		}
+	}
+
+	sqe = getsqe(SYSRING_OP_OPEN, -1, (void *)FILENAME, 0664);
+	sqe->sqe_flags = O_RDWR|O_CREAT|O_TRUNC;
+	fd = submit("open", -1);
+	printf("ringtest: opened %s as fd %d\n", FILENAME, fd);
+
+	/*
+	 * One crossing for all of this: the writes, the seek back
+	 * (whose result is 0), the reads, and the close.
+	 */
+	for (i=0; i<NBLOCKS; i++) {
+		getsqe(SYSRING_OP_WRITE, fd, wbuf[i], BLOCKSIZE);
+	}
+	sqe = getsqe(SYSRING_OP_LSEEK, fd, NULL, 0);
+	sqe->sqe_off = 0;
+	sqe->sqe_flags = SEEK_SET;
+	for (i=0; i<NBLOCKS; i++) {
+		getsqe(SYSRING_OP_READ, fd, rbuf[i], BLOCKSIZE);
+	}
+	getsqe(SYSRING_OP_CLOSE, fd, NULL, 0);
+	submit("io", BLOCKSIZE);
+
+	if (memcmp(wbuf, rbuf, sizeof(wbuf))) {
+		errx(1, "data read back does not match");
+	}
+	printf("ringtest: %d blocks written and read back in one batch\n",
+	       NBLOCKS);
+	remove(FILENAME);
+	printf("ringtest: passed\n");
+	return 0;
+}
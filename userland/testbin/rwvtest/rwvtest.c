@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * rwvtest - exercise vectored and positional I/O.
+ *
+ * Writes a file with one writev from NPIECES buffers of different
+ * sizes, reads it back with preads at scattered offsets and checks
+ * that the seek position didn't move, overwrites a piece in the
+ * middle with pwrite, and finally reads the whole file back with one
+ * readv into differently-sized pieces.
+ */
+
+#include <sys/uio.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <err.h>
+
+#define FILENAME  "rwvtest.dat"
+#define NPIECES   8
+#define TOTAL     (NPIECES * (NPIECES + 1) / 2 * 100)
+
+static char data[TOTAL];
+static char back[TOTAL];
+
+static
+char
+pattern(unsigned pos)
+{
+	return (char)(pos * 13 + pos / 97);
+}
+
+int
+main(void)
+{
+	struct iovec iov[NPIECES];
+	unsigned i, pos;
+	ssize_t r;
+	off_t off;
+	int fd;
+
+	for (i=0; i<TOTAL; i++) {
+		data[i] = pattern(i);
+	}
+
+	fd = open(FILENAME, O_RDWR|O_CREAT|O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s", FILENAME);
+	}
+
+	/* pieces of 100, 200, ... bytes */
+	pos = 0;
+	for (i=0; i<NPIECES; i++) {
+		iov[i].iov_base = data + pos;
+		iov[i].iov_len = (i + 1) * 100;
+		pos += iov[i].iov_len;
+	}
+	r = writev(fd, iov, NPIECES);
+	if (r != TOTAL) {
+		err(1, "writev: %d", (int)r);
+	}
+
+	for (pos=0; pos + 300 <= TOTAL; pos += 733) {
+		r = pread(fd, back, 300, pos);
+		if (r != 300) {
+			err(1, "pread at %u", pos);
+		}
+		if (memcmp(back, data + pos, 300) != 0) {
+			errx(1, "pread at %u: wrong data", pos);
+		}
+	}
+	off = lseek(fd, 0, SEEK_CUR);
+	if (off != TOTAL) {
+		errx(1, "pread moved the seek position to %d", (int)off);
+	}
+
+	for (i=1000; i<1500; i++) {
+		data[i] = ~data[i];
+	}
+	if (pwrite(fd, data + 1000, 500, 1000) != 500) {
+		err(1, "pwrite");
+	}
+
+	/* pieces the other way around: 800, 700, ... bytes */
+	if (lseek(fd, 0, SEEK_SET) != 0) {
+		err(1, "lseek");
+	}
+	pos = 0;
+	for (i=0; i<NPIECES; i++) {
+		iov[i].iov_base = back + pos;
+		iov[i].iov_len = (NPIECES - i) * 100;
+		pos += iov[i].iov_len;
+	}
+	r = readv(fd, iov, NPIECES);
+	if (r != TOTAL) {
+		err(1, "readv: %d", (int)r);
+	}
+	if (memcmp(back, data, TOTAL) != 0) {
+		errx(1, "readv: wrong data");
+	}
+
+	if (pread(fd, back, 1, -1) >= 0 || errno != EINVAL) {
+		errx(1, "pread at -1: expected EINVAL");
+	}
+
+	close(fd);
+	remove(FILENAME);
+	printf("rwvtest: passed\n");
+	return 0;
+}
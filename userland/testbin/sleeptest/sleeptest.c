@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * sleeptest - exercise nanosleep.
+ *
+ * Sleeps for a few different lengths of time and checks with __time
+ * that each took at least as long as asked, and not wildly longer.
+ * Then checks that bad arguments are rejected.
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <err.h>
+
+/* Allow this much oversleep (ms) before complaining. */
+#define SLACK_MS 200
+
+static
+long
+now_ms(void)
+{
+	time_t secs;
+	unsigned long nsecs;
+
+	if (__time(&secs, &nsecs) < 0) {
+		err(1, "__time");
+	}
+	return (long)secs * 1000 + (long)(nsecs / 1000000);
+}
+
+static
+void
+trysleep(long ms)
+{
+	struct timespec ts;
+	long start, took;
+
+	ts.tv_sec = ms / 1000;
+	ts.tv_nsec = (ms % 1000) * 1000000;
+
+	start = now_ms();
+	if (nanosleep(&ts, NULL) < 0) {
+		err(1, "nanosleep %ld ms", ms);
+	}
+	took = now_ms() - start;
+
+	printf("nanosleep %ld ms: took %ld ms\n", ms, took);
+	if (took < ms) {
+		errx(1, "woke up early");
+	}
+	if (took > ms + SLACK_MS) {
+		errx(1, "overslept");
+	}
+}
+
+int
+main(void)
+{
+	struct timespec ts;
+
+	trysleep(0);
+	trysleep(1);
+	trysleep(50);
+	trysleep(250);
+	trysleep(1500);
+
+	ts.tv_sec = 0;
+	ts.tv_nsec = 1000000000;
+	if (nanosleep(&ts, NULL) == 0 || errno != EINVAL) {
+		errx(1, "nanosleep with tv_nsec 1000000000 didn't fail "
+		     "with EINVAL");
+	}
+	ts.tv_sec = -1;
+	ts.tv_nsec = 0;
+	if (nanosleep(&ts, NULL) == 0 || errno != EINVAL) {
+		errx(1, "nanosleep with negative tv_sec didn't fail "
+		     "with EINVAL");
+	}
+	if (nanosleep(NULL, NULL) == 0 || errno != EFAULT) {
+		errx(1, "nanosleep with NULL request didn't fail with EFAULT");
+	}
+
+	printf("sleeptest: passed\n");
+	return 0;
+}